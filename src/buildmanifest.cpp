@@ -0,0 +1,182 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * buildmanifest.cpp  -  progress of an index build kept in <base>.manifest
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "buildmanifest.hpp"
+
+using namespace std;
+
+static const char* s_manifest_magic   = "ngramtool-manifest";
+static const unsigned s_manifest_version = 1;
+static const char* s_phase_names[] = { "scanned", "parsing", "parsed", "merged" };
+
+// flush file (or directory) name to disk, return false on errors
+static bool sync_file(const string& name, bool directory) {
+    int fd = open(name.c_str(), directory ? O_RDONLY : O_WRONLY);
+    if (fd == -1)
+        return false;
+    bool ok = fsync(fd) == 0;
+    return close(fd) == 0 && ok;
+}
+
+void BuildManifest::save(const string& file) const {
+    string tmp = file + ".tmp";
+    {
+        ofstream o(tmp.c_str());
+        if (!o)
+            throw runtime_error("unable to open build manifest to write");
+
+        o << s_manifest_magic << ' ' << s_manifest_version << endl;
+        m_header.write(o);
+        for (size_t i = 0; i < m_inputs.size(); ++i)
+            o << "input " << m_input_sizes[i] << ' ' << m_inputs[i] << endl;
+        o << "phase " << s_phase_names[m_phase] << endl;
+        o << "position " << m_input_file << ' ' << m_input_pos << endl;
+        o << "text-size " << m_text_size << endl;
+        o << "tail " << m_tail.size();
+        for (size_t i = 0; i < m_tail.size(); ++i)
+            o << ' ' << m_tail[i];
+        o << endl;
+        for (size_t i = 0; i < m_runs.size(); ++i)
+            o << "run " << m_runs[i].m_bits << ' ' << m_runs[i].m_size
+                << ' ' << m_runs[i].m_name << endl;
+        if (m_ptable_size)
+            o << "ptable-size " << m_ptable_size << endl;
+
+        o.flush();
+        if (!o)
+            throw runtime_error("fail to write build manifest");
+    }
+
+    //the manifest must be on disk before it replaces the old one
+    if (!sync_file(tmp, false)) {
+        perror(tmp.c_str());
+        throw runtime_error("fail to sync build manifest");
+    }
+
+    if (rename(tmp.c_str(), file.c_str()) != 0) {
+        perror(file.c_str());
+        throw runtime_error("unable to replace build manifest");
+    }
+
+    //and so must the rename, else a crash may bring back the old one
+    string::size_type slash = file.rfind('/');
+    string dir = slash == string::npos ? string(".") :
+        (slash == 0 ? string("/") : file.substr(0, slash));
+    if (!sync_file(dir, true))
+        perror(dir.c_str());
+}
+
+bool BuildManifest::load(const string& file) {
+    ifstream f(file.c_str());
+    if (!f)
+        return false;
+
+    string key;
+    unsigned version = 0;
+    if (!(f >> key >> version) || key != s_manifest_magic)
+        throw runtime_error("not a build manifest");
+    if (version > s_manifest_version)
+        throw runtime_error("build manifest of unsupported version");
+
+    *this = BuildManifest();
+    while (f >> key) {
+        if (key == "input") {
+            boost::uint64_t size = 0;
+            string name;
+            f >> size;
+            f.get();
+            getline(f, name);
+            m_input_sizes.push_back(size);
+            m_inputs.push_back(name);
+        } else if (key == "phase") {
+            string phase;
+            f >> phase;
+            size_t i = 0;
+            while (i < 4 && phase != s_phase_names[i])
+                ++i;
+            if (i == 4)
+                throw runtime_error("unknown phase in build manifest");
+            m_phase = Phase(i);
+        } else if (key == "position") {
+            f >> m_input_file >> m_input_pos;
+        } else if (key == "text-size") {
+            f >> m_text_size;
+        } else if (key == "tail") {
+            size_t n = 0;
+            f >> n;
+            m_tail.resize(n);
+            for (size_t i = 0; i < n && f; ++i)
+                f >> m_tail[i];
+        } else if (key == "run") {
+            Run run;
+            f >> run.m_bits >> run.m_size;
+            f.get();
+            getline(f, run.m_name);
+            m_runs.push_back(run);
+        } else if (key == "ptable-size") {
+            f >> m_ptable_size;
+        } else if (!m_header.read_entry(key, f)) {
+            throw runtime_error("unknown entry in build manifest");
+        }
+        if (!f)
+            throw runtime_error("corrupted build manifest");
+    }
+    return true;
+}
+
+void BuildManifest::set_inputs(const vector<string>& files) {
+    m_inputs = files;
+    m_input_sizes.clear();
+    for (size_t i = 0; i < files.size(); ++i) {
+        struct stat st;
+        if (stat(files[i].c_str(), &st) != 0)
+            throw runtime_error("unable to stat input file " + files[i]);
+        m_input_sizes.push_back(st.st_size);
+    }
+}
+
+bool BuildManifest::same_build(const BuildManifest& other) const {
+    return m_header.m_mode == other.m_header.m_mode &&
+        m_header.m_width == other.m_header.m_width &&
+        m_header.m_alphabet == other.m_header.m_alphabet &&
+        m_header.m_compressed_text == other.m_header.m_compressed_text &&
+        m_inputs == other.m_inputs &&
+        m_input_sizes == other.m_input_sizes;
+}
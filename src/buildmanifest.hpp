@@ -0,0 +1,105 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * buildmanifest.hpp  -  progress of an index build kept in <base>.manifest
+ *
+ * text2ngram -o <base> rewrites the manifest each time more of the build is
+ * safely on disk: the vocabulary, each sorted temporary run together with
+ * the input position parsing has reached, the complete .ngram table and the
+ * final .ptable. text2ngram --resume reads it back and goes on from the
+ * last of these instead of starting over. The manifest is removed once the
+ * build is complete.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef BUILDMANIFEST_H
+#define BUILDMANIFEST_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+#include "ngramheader.hpp"
+
+struct BuildManifest {
+    enum Phase {
+        SCANNED,  // the vocabulary (alphabet) is known
+        PARSING,  // runs and text up to an input position are written
+        PARSED,   // all runs and the whole .ngram table are written
+        MERGED    // the final .ptable is written
+    };
+
+    // a temporary ptable run, see NGramStat::TempRun
+    struct Run {
+        std::string m_name;
+        unsigned    m_bits;
+        unsigned    m_size;
+    };
+
+    BuildManifest()
+        :m_phase(SCANNED), m_input_file(0), m_input_pos(0),
+        m_text_size(0), m_ptable_size(0) {}
+
+    /**
+     * write the manifest to file, through a temporary file which is synced
+     * to disk and then renamed over it, so that neither a crash nor a
+     * power loss leaves half a manifest behind
+     * throws runtime_error if the file can not be written
+     */
+    void save(const std::string& file) const;
+
+    /**
+     * read a manifest written by save()
+     * return false if the file does not exist, throws runtime_error if it
+     * is not a valid manifest
+     */
+    bool load(const std::string& file);
+
+    /**
+     * record the input files and their sizes, a build can only be resumed
+     * on the same input
+     */
+    void set_inputs(const std::vector<std::string>& files);
+
+    // whether other describes a build of the same kind on the same input
+    bool same_build(const BuildManifest& other) const;
+
+    NGramHeader                  m_header;      // of the index being built
+    std::vector<std::string>     m_inputs;
+    std::vector<boost::uint64_t> m_input_sizes;
+    Phase                        m_phase;
+    unsigned                     m_input_file;  // PARSING: where parsing
+    boost::uint64_t              m_input_pos;   // goes on
+    unsigned                     m_text_size;   // symbols of .ngram written
+    std::vector<boost::uint32_t> m_tail;        // parsed text in no run yet
+    std::vector<Run>             m_runs;
+    unsigned                     m_ptable_size; // MERGED
+};
+
+#endif /* ifndef BUILDMANIFEST_H */
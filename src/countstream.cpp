@@ -0,0 +1,311 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * countstream.cpp  -  n-gram count streams which can be merged
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstring>
+#include <algorithm>
+#include "countstream.hpp"
+#include "vocab.hpp"
+
+using namespace std;
+
+const char COUNT_MAGIC[4] = { '\0', 'N', 'G', 'C' };
+
+// stdio buffer size of count streams
+static const size_t io_buffer_size = 1 << 20;
+
+// read a varint of f into v, false at the end of f
+static bool get_varint(FILE* f, boost::uint64_t& v) {
+    v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int c = getc(f);
+        if (c == EOF)
+            return false;
+        v |= boost::uint64_t(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// read a line without its '\n' into line, false at the end of f
+static bool read_line(FILE* f, string& line) {
+    char buf[4096];
+    line.clear();
+    while (fgets(buf, sizeof(buf), f)) {
+        size_t len = strlen(buf);
+        if (len > 0 && buf[len - 1] == '\n') {
+            line.append(buf, len - 1);
+            return true;
+        }
+        line.append(buf, len);
+    }
+    return !line.empty();
+}
+
+// number of characters of UTF-8 text s
+static unsigned utf8_length(const string& s) {
+    unsigned n = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if ((s[i] & 0xC0) != 0x80)
+            ++n;
+    }
+    return n;
+}
+
+// number of blank separated words of s
+static unsigned word_count(const string& s) {
+    unsigned n = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] != ' ' && (i == 0 || s[i - 1] == ' '))
+            ++n;
+    }
+    return n;
+}
+
+CountReader::CountReader(FILE* f, const string& name, bool char_mode)
+    :m_file(f), m_name(name), m_char_mode(char_mode), m_started(false),
+    m_binary(false), m_prev_length(0), m_length(0), m_count(0) {
+    setvbuf(m_file, 0, _IOFBF, io_buffer_size);
+}
+
+void CountReader::check_header() {
+    int c = getc(m_file);
+    if (c != COUNT_MAGIC[0]) {
+        if (c != EOF)
+            ungetc(c, m_file);
+        return;
+    }
+
+    // the rest of the magic and the mode
+    char header[sizeof(COUNT_MAGIC)];
+    if (fread(header, 1, sizeof(header), m_file) != sizeof(header) ||
+            memcmp(header, COUNT_MAGIC + 1, sizeof(COUNT_MAGIC) - 1) != 0)
+        throw runtime_error("count stream " + m_name + " is neither text nor binary counts");
+    if (header[sizeof(header) - 1] != (m_char_mode ? 'c' : 'w'))
+        throw runtime_error("count stream " + m_name + (m_char_mode ?
+                    " has word n-grams, not char n-grams" :
+                    " has char n-grams, not word n-grams"));
+    m_binary = true;
+}
+
+bool CountReader::next() {
+    if (!m_started) {
+        check_header();
+        m_started = true;
+    }
+
+    m_prev.swap(m_ngram);
+    m_prev_length = m_length;
+    if (!(m_binary ? read_binary() : read_text())) {
+        if (ferror(m_file))
+            throw runtime_error("error reading count stream " + m_name);
+        m_length = 0;
+        return false;
+    }
+
+    if (m_prev_length > m_length || (m_prev_length == m_length &&
+                compare_ngrams(m_prev, m_ngram, m_char_mode) >= 0))
+        throw runtime_error("count stream " + m_name +
+                " is not in --by-length order at: " + m_ngram);
+    return true;
+}
+
+bool CountReader::read_binary() {
+    boost::uint64_t length;
+    if (!get_varint(m_file, length))
+        return false;
+
+    boost::uint64_t shared;
+    boost::uint64_t rest;
+    if (!get_varint(m_file, shared) || !get_varint(m_file, rest) ||
+            shared > m_prev.size() || length == 0)
+        throw runtime_error("corrupt binary count stream " + m_name);
+    m_ngram.assign(m_prev, 0, shared);
+    m_ngram.resize(shared + rest);
+    if ((rest > 0 && fread(&m_ngram[shared], 1, rest, m_file) != rest) ||
+            !get_varint(m_file, m_count) || m_count == 0)
+        throw runtime_error("corrupt binary count stream " + m_name);
+    m_length = length;
+    return true;
+}
+
+bool CountReader::read_text() {
+    if (!read_line(m_file, m_line))
+        return false;
+
+    // the count is the last field, a char n-gram may contain blanks
+    size_t sep = m_line.rfind(' ');
+    m_count = 0;
+    for (size_t i = sep + 1; sep != string::npos && i < m_line.size(); ++i) {
+        if (m_line[i] < '0' || m_line[i] > '9') {
+            m_count = 0;
+            break;
+        }
+        m_count = m_count * 10 + (m_line[i] - '0');
+    }
+    if (m_count == 0)
+        throw runtime_error("malformed line in count stream " + m_name + ": " + m_line);
+
+    m_ngram.assign(m_line, 0, sep);
+    m_length = m_char_mode ? utf8_length(m_ngram) : word_count(m_ngram);
+    if (m_length == 0)
+        throw runtime_error("malformed line in count stream " + m_name + ": " + m_line);
+    return true;
+}
+
+int CountReader::compare_ngrams(const string& a, const string& b,
+        bool char_mode) {
+    // UTF-8 byte order is code point order
+    if (char_mode)
+        return a.compare(b);
+
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a.size() && j < b.size()) {
+        size_t ei = a.find(' ', i);
+        size_t ej = b.find(' ', j);
+        if (ei == string::npos)
+            ei = a.size();
+        if (ej == string::npos)
+            ej = b.size();
+        int rc = compare_words(a.data() + i, ei - i, b.data() + j, ej - j);
+        if (rc != 0)
+            return rc;
+        i = ei + 1;
+        j = ej + 1;
+    }
+    return 0;
+}
+
+CountMerger::CountMerger(const vector<CountReader*>& readers)
+    :m_readers(readers), m_tree(readers.size(), readers.size()),
+    m_ended(readers.size(), 0), m_started(false), m_length(0), m_count(0) {}
+
+bool CountMerger::ahead(size_t a, size_t b) const {
+    size_t k = m_readers.size();
+    if (a == k || b == k)
+        return a == k;
+    if (m_ended[a] || m_ended[b])
+        return !m_ended[a];
+    int rc = m_readers[a]->compare(*m_readers[b]);
+    return rc < 0 || (rc == 0 && a < b);
+}
+
+void CountMerger::replay(size_t i) {
+    size_t winner = i;
+    for (size_t t = (i + m_readers.size()) / 2; t > 0; t /= 2) {
+        if (ahead(m_tree[t], winner))
+            swap(m_tree[t], winner);
+    }
+    m_tree[0] = winner;
+}
+
+bool CountMerger::next() {
+    if (m_readers.empty())
+        return false;
+
+    if (!m_started) {
+        // the tree starts with the virtual stream size() winning every
+        // match, then each stream is played in and beats it
+        for (size_t i = m_readers.size(); i-- > 0;)
+            advance(i);
+        m_started = true;
+    }
+
+    size_t w = m_tree[0];
+    if (m_ended[w])
+        return false;
+
+    m_ngram  = m_readers[w]->ngram();
+    m_length = m_readers[w]->length();
+    m_count  = m_readers[w]->count();
+    advance(w);
+
+    // equal n-grams of other streams are right behind
+    for (w = m_tree[0]; !m_ended[w] && m_readers[w]->length() == m_length &&
+            m_readers[w]->ngram() == m_ngram; w = m_tree[0]) {
+        m_count += m_readers[w]->count();
+        advance(w);
+    }
+    return true;
+}
+
+CountWriter::CountWriter(FILE* f, bool binary, bool char_mode)
+    :m_file(f), m_binary(binary) {
+    setvbuf(m_file, 0, _IOFBF, io_buffer_size);
+    if (m_binary) {
+        fwrite(COUNT_MAGIC, 1, sizeof(COUNT_MAGIC), m_file);
+        putc(char_mode ? 'c' : 'w', m_file);
+    }
+}
+
+void CountWriter::put_varint(boost::uint64_t v) {
+    while (v >= 0x80) {
+        putc(int(v & 0x7F) | 0x80, m_file);
+        v >>= 7;
+    }
+    putc(int(v), m_file);
+}
+
+void CountWriter::write(const string& ngram, unsigned length,
+        boost::uint64_t count) {
+    if (!m_binary) {
+        char buf[24];
+        char* p = buf + sizeof(buf);
+        *--p = '\n';
+        do {
+            *--p = char('0' + count % 10);
+            count /= 10;
+        } while (count > 0);
+        *--p = ' ';
+        fwrite(ngram.data(), 1, ngram.size(), m_file);
+        fwrite(p, 1, buf + sizeof(buf) - p, m_file);
+        return;
+    }
+
+    size_t shared = 0;
+    size_t n = min(ngram.size(), m_prev.size());
+    while (shared < n && ngram[shared] == m_prev[shared])
+        ++shared;
+    put_varint(length);
+    put_varint(shared);
+    put_varint(ngram.size() - shared);
+    fwrite(ngram.data() + shared, 1, ngram.size() - shared, m_file);
+    put_varint(count);
+    m_prev = ngram;
+}
+
+void CountWriter::flush() {
+    if (fflush(m_file) != 0 || ferror(m_file))
+        throw runtime_error("fail to write count stream");
+}
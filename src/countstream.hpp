@@ -0,0 +1,246 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * countstream.hpp  -  n-gram count streams which can be merged
+ *
+ * Extraction outputs an n-gram once the suffixes starting with it end, so
+ * n-grams of different lengths come out interleaved in an order which
+ * depends on the text. With --by-length the tools put out the n-grams by
+ * length instead, each length in symbol order. That order is the same for
+ * every index, so the count streams of several shards can be merged in one
+ * pass, summing the counts of equal n-grams (see ngramcluster and
+ * ngrammerge).
+ *
+ * Besides the "ngram count" lines a stream may be in binary form: a header
+ * of COUNT_MAGIC and 'c' or 'w' for char or word n-grams, then per n-gram
+ * the varints length (in symbols), bytes shared with the n-gram before,
+ * bytes of the rest, the rest itself and the count. Sorted n-grams share
+ * long prefixes, so this is much smaller than the text and needs no
+ * number parsing.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef COUNTSTREAM_H
+#define COUNTSTREAM_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
+
+/**
+ * output function adaptor: pass the N-grams on right away and keep the
+ * longer ones in a temporary file per length until finish() passes them
+ * on, so the output comes by length. Within a length the order of the
+ * extraction, which is symbol order, is kept
+ */
+template <typename CharT, typename Traits = std::char_traits<CharT> >
+class ByLengthOutput : boost::noncopyable {
+    public:
+        typedef std::basic_string<CharT, Traits> string_type;
+        typedef boost::function<void(const string_type& ngram,
+                unsigned count)> Func;
+
+        ByLengthOutput(const Func& f, unsigned N, unsigned M)
+            :m_func(f), m_N(N), m_files(M + 1, (FILE*)0) {}
+
+        ~ByLengthOutput() {
+            for (size_t n = 0; n < m_files.size(); ++n) {
+                if (m_files[n])
+                    fclose(m_files[n]);
+            }
+        }
+
+        void operator()(const string_type& s, unsigned count) {
+            size_t n = s.size();
+            if (n == m_N) {
+                m_func(s, count);
+                return;
+            }
+
+            if (!m_files[n] && !(m_files[n] = tmpfile()))
+                throw std::runtime_error("unable to open temporary file for n-grams");
+            if (fwrite(&count, sizeof(count), 1, m_files[n]) != 1 ||
+                    fwrite(s.data(), sizeof(CharT), n, m_files[n]) != n)
+                throw std::runtime_error("fail to write temporary file for n-grams");
+        }
+
+        // pass on the n-grams longer than N, shortest first
+        void finish() {
+            for (size_t n = m_N + 1; n < m_files.size(); ++n) {
+                FILE* f = m_files[n];
+                if (!f)
+                    continue;
+
+                rewind(f);
+                m_buf.resize(n);
+                unsigned count;
+                while (fread(&count, sizeof(count), 1, f) == 1) {
+                    if (fread(&m_buf[0], sizeof(CharT), n, f) != n)
+                        throw std::runtime_error("fail to read temporary file for n-grams");
+                    m_func(m_buf, count);
+                }
+                fclose(f);
+                m_files[n] = 0;
+            }
+        }
+
+    private:
+        Func               m_func;
+        size_t             m_N;
+        std::vector<FILE*> m_files; // n --> its n-grams, 0 if none yet
+        string_type        m_buf;
+};
+
+// first bytes of a binary count stream, no text line starts with '\0'
+extern const char COUNT_MAGIC[4];
+
+/**
+ * reads the "ngram count" lines of a count stream put out with
+ * --by-length, or the same in binary form, and checks that they come in
+ * that order
+ */
+class CountReader : boost::noncopyable {
+    public:
+        /**
+         * read from f (not closed), name is used in error messages.
+         * char_mode: n-grams are UTF-8 characters, else words each followed
+         * by a blank. f is given a large buffer, so nothing must have been
+         * read from it yet
+         */
+        CountReader(FILE* f, const std::string& name, bool char_mode);
+
+        /**
+         * move on to the next line, false at the end of the stream
+         * throws runtime_error on malformed or unsorted lines
+         */
+        bool next();
+
+        const std::string& ngram() const { return m_ngram; }
+        unsigned length() const { return m_length; }
+        boost::uint64_t count() const { return m_count; }
+
+        /**
+         * compare the current n-grams of two streams: by length, then
+         * symbol order
+         */
+        int compare(const CountReader& r) const {
+            if (m_length != r.m_length)
+                return m_length < r.m_length ? -1 : 1;
+            return compare_ngrams(m_ngram, r.m_ngram, m_char_mode);
+        }
+
+        /**
+         * symbol order of two n-grams of the same length: code points for
+         * chars, for words the order word ids are given in (see
+         * sort_vocab())
+         */
+        static int compare_ngrams(const std::string& a, const std::string& b,
+                bool char_mode);
+
+    private:
+        bool read_text();
+        bool read_binary();
+        void check_header();
+
+        FILE*           m_file;
+        std::string     m_name;
+        bool            m_char_mode;
+        bool            m_started;
+        bool            m_binary;
+        std::string     m_line;
+        std::string     m_ngram;
+        std::string     m_prev;     // ngram of the line before
+        unsigned        m_prev_length;
+        unsigned        m_length;
+        boost::uint64_t m_count;
+};
+
+/**
+ * merges count streams with a loser tree: next() moves on to the next
+ * n-gram of all streams together, its count being the sum of the counts in
+ * the streams which have it. Each step costs log2(streams) compares
+ */
+class CountMerger : boost::noncopyable {
+    public:
+        // the readers are owned by the caller and must not have been read
+        CountMerger(const std::vector<CountReader*>& readers);
+
+        // false once all streams have ended
+        bool next();
+
+        const std::string& ngram() const { return m_ngram; }
+        unsigned length() const { return m_length; }
+        boost::uint64_t count() const { return m_count; }
+
+    private:
+        // whether the stream a is ahead of b, stream size() stands first
+        bool ahead(size_t a, size_t b) const;
+        // play the stream i's current n-gram up the tree
+        void replay(size_t i);
+        void advance(size_t i) {
+            m_ended[i] = !m_readers[i]->next();
+            replay(i);
+        }
+
+        std::vector<CountReader*> m_readers;
+        std::vector<size_t>       m_tree;   // losers of the matches, m_tree[0] is the winner
+        std::vector<char>         m_ended;
+        bool                      m_started;
+        std::string               m_ngram;
+        unsigned                  m_length;
+        boost::uint64_t           m_count;
+};
+
+/**
+ * writes a count stream as text lines or in binary form to a file (not
+ * closed), with a large buffer
+ */
+class CountWriter : boost::noncopyable {
+    public:
+        CountWriter(FILE* f, bool binary, bool char_mode);
+
+        void write(const std::string& ngram, unsigned length,
+                boost::uint64_t count);
+
+        // throws runtime_error if anything could not be written
+        void flush();
+
+    private:
+        void put_varint(boost::uint64_t v);
+
+        FILE*       m_file;
+        bool        m_binary;
+        std::string m_prev;     // last n-gram written in binary
+};
+
+#endif /* ifndef COUNTSTREAM_H */
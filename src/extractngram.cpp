@@ -39,11 +39,13 @@
 #include <boost/shared_array.hpp>
 
 #include "tools.hpp"
-#include "itemmap.hpp"
 #include "vocab.hpp"
 #include "iconvert.hpp"
 #include "extractngram_cmdline.h"
 #include "ngramstat.hpp"
+#include "ngramheader.hpp"
+#include "countstream.hpp"
+#include "membudget.hpp"
 
 using namespace std;
 
@@ -192,6 +194,102 @@ void check_args(const gengetopt_args_info& args, unsigned N,unsigned M,unsigned
             cerr << "punctuation filtering is only supported in character n-gram mode" << endl;
             exit(EXIT_FAILURE);
     }
+
+    if (args.save_counts_flag && args.no_counts_flag) {
+            cerr << "--save-counts and --no-counts exclude each other" << endl;
+            exit(EXIT_FAILURE);
+    }
+
+    if (args.top_given && (args.top_arg < 1 || args.by_length_flag)) {
+            cerr << "--top needs a count >= 1 and puts out n-grams by count, not --by-length" << endl;
+            exit(EXIT_FAILURE);
+    }
+
+    if (args.mem_arg < 0) {
+            cerr << "--mem needs a size >= 0 in MB" << endl;
+            exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * extract N to M-grams from the count tables if they cover them, else by
+ * scanning the index
+ */
+template <typename NGram>
+void extract(const gengetopt_args_info& args, NGram& ngram,
+        unsigned N, unsigned M, unsigned freq,
+        typename NGram::OutputFunc& f) {
+    typedef typename NGram::string_type string_type;
+
+    if (args.save_counts_flag)
+        ngram.save_counts(N, M);
+
+    // --count does not care about the order, which is cheapest by length
+    bool length_order = args.by_length_flag || args.count_flag;
+    if (!args.no_counts_flag &&
+            ngram.extract_counts(N, M, freq, length_order, f))
+        return;
+
+    ByLengthOutput<typename string_type::value_type,
+        typename string_type::traits_type> by_length(f, N, M);
+    if (args.by_length_flag)
+        f = boost::ref(by_length);
+
+    ngram.extract_ngram(N,M,freq,f);
+    by_length.finish();
+}
+
+/**
+ * extract char ngrams from an index of SymT wide symbols
+ * chars maps the symbols back to characters, 0 if they are characters
+ */
+template <typename SymT>
+void extract_chars(const gengetopt_args_info& args, const NGramHeader& header,
+        const uchar_t* chars, unsigned N, unsigned M, unsigned freq) {
+    typedef NGramStat<SymT, typename symbol_traits<SymT>::type> NGram;
+    typedef WidenOutput<SymT, uchar_t, uchar_traits> Widen;
+
+    NGram ngram(10, args.input_arg, args.mmap_flag);
+    ngram.set_ptable_bits(header.m_ptable_bits);
+    ngram.set_compress_text(header.m_compressed_text);
+    ngram.set_top(args.top_given ? args.top_arg : 0);
+
+    CharOutputHelper out(cout,true,args.nopunct_flag, args.to_arg);
+    CharCountHelper count(true,args.nopunct_flag);
+    typename NGram::OutputFunc f;
+    if (args.count_flag)
+        f = Widen(boost::ref(count), chars);
+    else
+        f = Widen(boost::ref(out), chars);
+    extract(args, ngram, N, M, freq, f);
+    if (args.count_flag)
+        cout << count.count() << endl;
+}
+
+/**
+ * extract word ngrams from an index of SymT wide word ids
+ */
+template <typename SymT>
+void extract_words(const gengetopt_args_info& args, const NGramHeader& header,
+        unsigned N, unsigned M, unsigned freq) {
+    typedef NGramStat<SymT, typename symbol_traits<SymT>::type> NGram;
+    typedef WidenOutput<SymT, word_id> Widen;
+
+    NGram ngram(10, args.input_arg, args.mmap_flag);
+    ngram.set_ptable_bits(header.m_ptable_bits);
+    ngram.set_compress_text(header.m_compressed_text);
+    ngram.set_top(args.top_given ? args.top_arg : 0);
+
+    WordOutputHelper out(cout, true, args.nopunct_flag, args.to_arg);
+    WordCountHelper count(true,args.nopunct_flag);
+    typename NGram::OutputFunc f;
+    if (args.count_flag)
+        f = Widen(boost::ref(count));
+    else
+        f = Widen(boost::ref(out));
+    extract(args, ngram, N, M, freq, f);
+    if (args.count_flag)
+        cout << count.count() << endl;
 }
 
 int main(int argc,char* argv[]) {
@@ -213,26 +311,33 @@ int main(int argc,char* argv[]) {
     cerr << "start at: " << current_time();
 
     try {
+        init_mem_budget(args_info.mem_arg);
+
+        NGramHeader header;
+        bool has_header = header.load(string(args_info.input_arg) + ".header");
+        if (has_header &&
+                (header.m_mode == NGramHeader::CHAR_MODE) != bool(args_info.char_flag)) {
+            throw runtime_error(args_info.char_flag ?
+                    "this is a word ngram index, drop the -c flag" :
+                    "this is a char ngram index, add the -c flag");
+        }
+
         if (args_info.char_flag) { // character ngram
             g_filtering_table.reset(create_filtering_table(true,
                         args_info.nopunct_flag, args_info.nopunct_flag));
 
-            NGramStat<uchar_t, uchar_traits> ngram(10,
-                    args_info.input_arg,
-                    args_info.mmap_flag);
+            vector<uchar_t> chars(1, uchar_t());
+            chars.insert(chars.end(), header.m_alphabet.begin(),
+                    header.m_alphabet.end());
 
-            CharOutputHelper out(cout,true,args_info.nopunct_flag,
-                    args_info.to_arg);
-            CharCountHelper count(true,args_info.nopunct_flag);
-            NGramStat<uchar_t, uchar_traits>::OutputFunc f;
-            if (args_info.count_flag)
-                f = boost::ref(count);
+            if (!has_header) // old index of plain uchar_t
+                extract_chars<uchar_t>(args_info, header, 0, N, M, freq);
+            else if (header.m_width == 1)
+                extract_chars<unsigned char>(args_info, header, &chars[0], N, M, freq);
+            else if (header.m_width == 2)
+                extract_chars<uchar_t>(args_info, header, &chars[0], N, M, freq);
             else
-                f = boost::ref(out);
-
-            ngram.extract_ngram(N,M,freq,f);
-            if (args_info.count_flag)
-                cout << count.count() << endl;
+                throw runtime_error("unsupported symbol width for char ngrams");
         } else { // word ngrams
             string vocab = string(args_info.input_arg) + ".vocab";
             if (access(vocab.c_str(), R_OK)) {
@@ -242,22 +347,15 @@ int main(int argc,char* argv[]) {
                 throw runtime_error(msg.c_str());
             }
             load_vocab(string(args_info.input_arg) + ".vocab", g_vocab);
-            NGramStat<word_id> ngram(10,
-                    args_info.input_arg,
-                    args_info.mmap_flag);
-
-            WordOutputHelper out(cout, true, args_info.nopunct_flag,
-                    args_info.to_arg);
-            WordCountHelper count(true,args_info.nopunct_flag);
-            NGramStat<word_id>::OutputFunc f;
-            if (args_info.count_flag)
-                f = boost::ref(count);
-            else
-                f = boost::ref(out);
 
-            ngram.extract_ngram(N,M,freq,f);
-            if (args_info.count_flag)
-                cout << count.count() << endl;
+            if (!has_header) // old index of plain word_id
+                extract_words<word_id>(args_info, header, N, M, freq);
+            else if (header.m_width == 1)
+                extract_words<unsigned char>(args_info, header, N, M, freq);
+            else if (header.m_width == 2)
+                extract_words<uchar_t>(args_info, header, N, M, freq);
+            else
+                extract_words<unsigned>(args_info, header, N, M, freq);
         }
 
     } catch (bad_alloc& e) {
@@ -51,7 +51,12 @@ cmdline_parser_print_help (void)
   printf("   -nINT      --min-n=INT     extract N gram (where N >= n)\n");
   printf("   -mINT      --max-n=INT     extract N gram (N <= m) (max M=255,M=N if omitted)\n");
   printf("   -fINT      --freq=INT      extract N gram whose freq >= f (default='1')\n");
+  printf("              --top=INT       extract only the given number of most frequent N grams of each length, put out by length and decreasing count\n");
   printf("   -M         --mmap          use mmap() for faster operation (default=off)\n");
+  printf("              --by-length     put out the n-grams by length, each length in symbol order, so that outputs of several shards can be merged by ngramcluster (default=off)\n");
+  printf("              --save-counts   materialize the counts of all N to M grams into <input>.counts first, later runs within N to M with any freq read only those (default=off)\n");
+  printf("              --mem=INT       memory budget in MB for sorting the counts of --save-counts and for merging their lengths back into symbol order, 0 to size it from the available memory (default='0')\n");
+  printf("              --no-counts     scan the index even if <input>.counts holds the counts needed (default=off)\n");
   printf("              --count         only count the number of N-gram extracted (default=off)\n");
   printf("   -c         --char          extract char ngram (default=off)\n");
   printf("              --nopunct       exclude N gram with (CJK) punctuations and special symbols (non-word) (default=off)\n");
@@ -85,7 +90,12 @@ cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_i
   args_info->min_n_given = 0 ;
   args_info->max_n_given = 0 ;
   args_info->freq_given = 0 ;
+  args_info->top_given = 0 ;
   args_info->mmap_given = 0 ;
+  args_info->by_length_given = 0 ;
+  args_info->save_counts_given = 0 ;
+  args_info->mem_given = 0 ;
+  args_info->no_counts_given = 0 ;
   args_info->count_given = 0 ;
   args_info->char_given = 0 ;
   args_info->nopunct_given = 0 ;
@@ -94,6 +104,10 @@ cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_i
   args_info->input_arg = NULL; \
   args_info->freq_arg = 1 ;\
   args_info->mmap_flag = 0;\
+  args_info->by_length_flag = 0;\
+  args_info->save_counts_flag = 0;\
+  args_info->mem_arg = 0 ;\
+  args_info->no_counts_flag = 0;\
   args_info->count_flag = 0;\
   args_info->char_flag = 0;\
   args_info->nopunct_flag = 0;\
@@ -122,7 +136,12 @@ cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_i
         { "min-n",	1, NULL, 'n' },
         { "max-n",	1, NULL, 'm' },
         { "freq",	1, NULL, 'f' },
+        { "top",	1, NULL, 0 },
         { "mmap",	0, NULL, 'M' },
+        { "by-length",	0, NULL, 0 },
+        { "save-counts",	0, NULL, 0 },
+        { "mem",	1, NULL, 0 },
+        { "no-counts",	0, NULL, 0 },
         { "count",	0, NULL, 0 },
         { "char",	0, NULL, 'c' },
         { "nopunct",	0, NULL, 0 },
@@ -225,8 +244,78 @@ cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_i
 
 
         case 0:	/* Long option with no short option */
+          /* extract only the given number of most frequent N grams of each length, put out by length and decreasing count.  */
+          if (strcmp (long_options[option_index].name, "top") == 0)
+          {
+            if (args_info->top_given)
+              {
+                fprintf (stderr, "%s: `--top' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->top_given = 1;
+            args_info->top_arg = strtol (optarg,&stop_char,0);
+            break;
+          }
+          
+          /* put out the n-grams by length, each length in symbol order, so that outputs of several shards can be merged by ngramcluster.  */
+          else if (strcmp (long_options[option_index].name, "by-length") == 0)
+          {
+            if (args_info->by_length_given)
+              {
+                fprintf (stderr, "%s: `--by-length' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->by_length_given = 1;
+            args_info->by_length_flag = !(args_info->by_length_flag);
+            break;
+          }
+          
+          /* materialize the counts of all N to M grams into <input>.counts first, later runs within N to M with any freq read only those.  */
+          else if (strcmp (long_options[option_index].name, "save-counts") == 0)
+          {
+            if (args_info->save_counts_given)
+              {
+                fprintf (stderr, "%s: `--save-counts' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->save_counts_given = 1;
+            args_info->save_counts_flag = !(args_info->save_counts_flag);
+            break;
+          }
+          
+          /* memory budget in MB for sorting the counts of --save-counts and for merging their lengths back into symbol order, 0 to size it from the available memory.  */
+          else if (strcmp (long_options[option_index].name, "mem") == 0)
+          {
+            if (args_info->mem_given)
+              {
+                fprintf (stderr, "%s: `--mem' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->mem_given = 1;
+            args_info->mem_arg = strtol (optarg,&stop_char,0);
+            break;
+          }
+          
+          /* scan the index even if <input>.counts holds the counts needed.  */
+          else if (strcmp (long_options[option_index].name, "no-counts") == 0)
+          {
+            if (args_info->no_counts_given)
+              {
+                fprintf (stderr, "%s: `--no-counts' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->no_counts_given = 1;
+            args_info->no_counts_flag = !(args_info->no_counts_flag);
+            break;
+          }
+          
           /* only count the number of N-gram extracted.  */
-          if (strcmp (long_options[option_index].name, "count") == 0)
+          else if (strcmp (long_options[option_index].name, "count") == 0)
           {
             if (args_info->count_given)
               {
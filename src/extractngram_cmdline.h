@@ -29,7 +29,12 @@ struct gengetopt_args_info
   int min_n_arg;	/* extract N gram (where N >= n).  */
   int max_n_arg;	/* extract N gram (N <= m) (max M=255,M=N if omitted).  */
   int freq_arg;	/* extract N gram whose freq >= f (default='1').  */
+  int top_arg;	/* extract only the given number of most frequent N grams of each length, put out by length and decreasing count.  */
   int mmap_flag;	/* use mmap() for faster operation (default=off).  */
+  int by_length_flag;	/* put out the n-grams by length, each length in symbol order, so that outputs of several shards can be merged by ngramcluster (default=off).  */
+  int save_counts_flag;	/* materialize the counts of all N to M grams into <input>.counts first, later runs within N to M with any freq read only those (default=off).  */
+  int mem_arg;	/* memory budget in MB for sorting the counts of --save-counts and for merging their lengths back into symbol order, 0 to size it from the available memory (default='0').  */
+  int no_counts_flag;	/* scan the index even if <input>.counts holds the counts needed (default=off).  */
   int count_flag;	/* only count the number of N-gram extracted (default=off).  */
   int char_flag;	/* extract char ngram (default=off).  */
   int nopunct_flag;	/* exclude N gram with (CJK) punctuations and special symbols (non-word) (default=off).  */
@@ -41,7 +46,12 @@ struct gengetopt_args_info
   int min_n_given ;	/* Whether min-n was given.  */
   int max_n_given ;	/* Whether max-n was given.  */
   int freq_given ;	/* Whether freq was given.  */
+  int top_given ;	/* Whether top was given.  */
   int mmap_given ;	/* Whether mmap was given.  */
+  int by_length_given ;	/* Whether by-length was given.  */
+  int save_counts_given ;	/* Whether save-counts was given.  */
+  int mem_given ;	/* Whether mem was given.  */
+  int no_counts_given ;	/* Whether no-counts was given.  */
   int count_given ;	/* Whether count was given.  */
   int char_given ;	/* Whether char was given.  */
   int nopunct_given ;	/* Whether nopunct was given.  */
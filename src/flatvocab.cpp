@@ -0,0 +1,349 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * flatvocab.cpp  -  compact string <--> id map for large vocabularies
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include "flatvocab.hpp"
+#include "mmapfile.hpp"
+
+#if !defined(HAVE_SYSTEM_MMAP)
+class MmapFile {}; // load() reads the whole file instead
+#endif
+
+using namespace std;
+using boost::uint32_t;
+using boost::uint64_t;
+
+const FlatVocab::id_type FlatVocab::null_id = ~(FlatVocab::id_type)0;
+const uint32_t FlatVocab::s_empty_slot = ~(uint32_t)0;
+
+/**
+ * layout of a binary vocab file, all sections 8 byte aligned:
+ *   FileHeader
+ *   uint64_t offsets[size + 1]
+ *   char     arena[arena_bytes], padded with '\0' to a multiple of 8
+ *   Slot     table[table_slots]
+ */
+struct FlatVocab::FileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t size;
+    uint64_t arena_bytes;
+    uint64_t table_slots;
+};
+
+static const char     s_magic[8]   = { 'N', 'G', 'V', 'O', 'C', 'A', 'B', '\0' };
+static const uint32_t s_version    = 1;
+static const uint32_t s_byte_order = 0x01020304;
+
+static inline uint64_t align8(uint64_t n) { return (n + 7) & ~uint64_t(7); }
+
+FlatVocab::FlatVocab() {
+    clear();
+}
+
+FlatVocab::~FlatVocab() {
+}
+
+void FlatVocab::clear() {
+    Slot empty = { s_empty_slot, 0 };
+    m_map.reset();
+    vector<char>().swap(m_arena);
+    vector<uint64_t>(1, 0).swap(m_offsets);
+    vector<Slot>(1024, empty).swap(m_table);
+    sync_view();
+}
+
+void FlatVocab::sync_view() {
+    m_words = m_arena.empty() ? 0 : &m_arena[0];
+    m_offs  = &m_offsets[0];
+    m_slots = &m_table[0];
+    m_size  = m_offsets.size() - 1;
+    m_mask  = m_table.size() - 1;
+}
+
+// copy a mapped vocab into the vectors so it can grow
+void FlatVocab::unmap() {
+    vector<char>(m_words, m_words + m_offs[m_size]).swap(m_arena);
+    vector<uint64_t>(m_offs, m_offs + m_size + 1).swap(m_offsets);
+    vector<Slot>(m_slots, m_slots + m_mask + 1).swap(m_table);
+    m_map.reset();
+    sync_view();
+}
+
+/**
+ * MurmurHash64A by Austin Appleby, reading 8 bytes at a time.
+ * Much better distribution than the old shift-xor string hash and still only
+ * a couple of multiplications per word.
+ */
+uint64_t FlatVocab::hash(const char* s, size_t len) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = 0x8445d61a4e774912ULL ^ (len * m);
+
+    const char* end = s + (len & ~(size_t)7);
+    for (; s != end; s += 8) {
+        uint64_t k;
+        memcpy(&k, s, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    switch (len & 7) {
+        case 7: h ^= uint64_t((unsigned char)s[6]) << 48; // fall through
+        case 6: h ^= uint64_t((unsigned char)s[5]) << 40; // fall through
+        case 5: h ^= uint64_t((unsigned char)s[4]) << 32; // fall through
+        case 4: h ^= uint64_t((unsigned char)s[3]) << 24; // fall through
+        case 3: h ^= uint64_t((unsigned char)s[2]) << 16; // fall through
+        case 2: h ^= uint64_t((unsigned char)s[1]) << 8;  // fall through
+        case 1: h ^= uint64_t((unsigned char)s[0]);
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+/**
+ * return the slot holding the word, or the empty slot where it would go
+ */
+size_t FlatVocab::find_slot(const char* s, size_t len, uint32_t h) const {
+    size_t pos = h & m_mask;
+    while (m_slots[pos].m_id != s_empty_slot) {
+        if (m_slots[pos].m_hash == h && equal(m_slots[pos].m_id, s, len))
+            break;
+        pos = (pos + 1) & m_mask;
+    }
+    return pos;
+}
+
+FlatVocab::id_type FlatVocab::id(const char* s, size_t len) const {
+    const Slot& slot = m_slots[find_slot(s, len, uint32_t(hash(s, len)))];
+    return slot.m_id == s_empty_slot ? null_id : slot.m_id;
+}
+
+FlatVocab::id_type FlatVocab::add(const char* s, size_t len) {
+    if (mapped()) {
+        id_type i = id(s, len);
+        if (i != null_id)
+            return i;
+        unmap();
+    }
+
+    uint32_t h = uint32_t(hash(s, len));
+    Slot& slot = m_table[find_slot(s, len, h)];
+    if (slot.m_id != s_empty_slot)
+        return slot.m_id;
+
+    id_type id = size();
+    if (id >= s_empty_slot)
+        throw runtime_error("too many words for FlatVocab (max 2^32 - 1)");
+
+    m_arena.insert(m_arena.end(), s, s + len);
+    m_arena.push_back('\0');
+    m_offsets.push_back(m_arena.size());
+    slot.m_id   = uint32_t(id);
+    slot.m_hash = h;
+
+    // keep load factor below 1/2 so probe sequences stay short
+    if ((m_offsets.size() - 1) * 2 > m_table.size())
+        rehash(m_table.size() * 2);
+    sync_view();
+    return id;
+}
+
+void FlatVocab::rehash(size_t slots) {
+    assert((slots & (slots - 1)) == 0);
+
+    Slot empty = { s_empty_slot, 0 };
+    vector<Slot> table(slots, empty);
+    size_t mask = slots - 1;
+
+    for (size_t i = 0; i < m_table.size(); ++i) {
+        if (m_table[i].m_id == s_empty_slot)
+            continue;
+        size_t pos = m_table[i].m_hash & mask;
+        while (table[pos].m_id != s_empty_slot)
+            pos = (pos + 1) & mask;
+        table[pos] = m_table[i];
+    }
+
+    m_table.swap(table);
+}
+
+struct FlatVocab::WordLess {
+    WordLess(const FlatVocab& v):m_vocab(v) {}
+    bool operator()(uint32_t a, uint32_t b) const {
+        return strcmp(m_vocab[a], m_vocab[b]) < 0;
+    }
+    const FlatVocab& m_vocab;
+};
+
+void FlatVocab::renumber(id_type first, vector<id_type>& remap) {
+    assert(first <= size());
+    if (mapped())
+        unmap();
+
+    vector<uint32_t> order(size()); // new id --> old id
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = uint32_t(i);
+    sort(order.begin() + first, order.end(), WordLess(*this));
+
+    vector<char> arena;
+    vector<uint64_t> offsets;
+    arena.reserve(m_arena.size());
+    offsets.reserve(m_offsets.size());
+    offsets.push_back(0);
+    remap.resize(size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        const char* s = (*this)[order[i]];
+        arena.insert(arena.end(), s, s + length(order[i]) + 1);
+        offsets.push_back(arena.size());
+        remap[order[i]] = i;
+    }
+
+    // slots are placed by hash alone, only the ids in them change
+    for (size_t i = 0; i < m_table.size(); ++i) {
+        if (m_table[i].m_id != s_empty_slot)
+            m_table[i].m_id = uint32_t(remap[m_table[i].m_id]);
+    }
+
+    m_arena.swap(arena);
+    m_offsets.swap(offsets);
+    sync_view();
+}
+
+size_t FlatVocab::memory_usage() const {
+    return m_arena.capacity() + m_offsets.capacity() * sizeof(uint64_t) +
+        m_table.size() * sizeof(Slot);
+}
+
+void FlatVocab::save(const string& file) const {
+    FileHeader header;
+    memcpy(header.magic, s_magic, sizeof(header.magic));
+    header.version     = s_version;
+    header.byte_order  = s_byte_order;
+    header.size        = m_size;
+    header.arena_bytes = m_offs[m_size];
+    header.table_slots = m_mask + 1;
+
+    FILE* f = fopen(file.c_str(), "wb");
+    if (!f)
+        throw runtime_error("unable to open vocab file to write");
+
+    static const char pad[8] = { 0 };
+    size_t padding = size_t(align8(header.arena_bytes) - header.arena_bytes);
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+        fwrite(m_offs, sizeof(uint64_t), m_size + 1, f) == m_size + 1 &&
+        fwrite(m_words, 1, size_t(header.arena_bytes), f) == header.arena_bytes &&
+        fwrite(pad, 1, padding, f) == padding &&
+        fwrite(m_slots, sizeof(Slot), m_mask + 1, f) == m_mask + 1;
+    if (fclose(f) != 0 || !ok)
+        throw runtime_error("fail to write vocab file");
+}
+
+bool FlatVocab::is_binary_file(const string& file) {
+    char magic[sizeof(s_magic)];
+    FILE* f = fopen(file.c_str(), "rb");
+    if (!f)
+        return false;
+    bool ret = fread(magic, sizeof(magic), 1, f) == 1 &&
+        memcmp(magic, s_magic, sizeof(magic)) == 0;
+    fclose(f);
+    return ret;
+}
+
+void FlatVocab::load(const string& file) {
+    clear();
+
+    FileHeader header;
+    FILE* f = fopen(file.c_str(), "rb");
+    if (!f)
+        throw runtime_error("fail to open vocab file to read");
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+            memcmp(header.magic, s_magic, sizeof(s_magic)) != 0) {
+        fclose(f);
+        throw runtime_error("not a binary vocab file");
+    }
+    if (header.version != s_version || header.byte_order != s_byte_order) {
+        fclose(f);
+        throw runtime_error("binary vocab file of unsupported version or byte order");
+    }
+    if (header.table_slots == 0 ||
+            (header.table_slots & (header.table_slots - 1)) != 0) {
+        fclose(f);
+        throw runtime_error("corrupted vocab file");
+    }
+
+    uint64_t offsets_pos = sizeof(FileHeader);
+    uint64_t arena_pos   = offsets_pos + (header.size + 1) * sizeof(uint64_t);
+    uint64_t table_pos   = arena_pos + align8(header.arena_bytes);
+    uint64_t file_size   = table_pos + header.table_slots * sizeof(Slot);
+
+#if defined(HAVE_SYSTEM_MMAP)
+    fclose(f);
+    boost::scoped_ptr<MmapFile> map(new MmapFile(file.c_str()));
+    if (!map->open())
+        throw runtime_error("fail to mmap vocab file");
+    if (map->size() < file_size)
+        throw runtime_error("truncated vocab file");
+
+    const char* base = static_cast<const char*>(map->addr());
+    m_words = base + arena_pos;
+    m_offs  = reinterpret_cast<const uint64_t*>(base + offsets_pos);
+    m_slots = reinterpret_cast<const Slot*>(base + table_pos);
+    m_map.swap(map);
+#else
+    m_offsets.resize(size_t(header.size + 1));
+    m_arena.resize(size_t(align8(header.arena_bytes)));
+    m_table.resize(size_t(header.table_slots));
+    bool ok = fread(&m_offsets[0], sizeof(uint64_t), m_offsets.size(), f) == m_offsets.size() &&
+        (m_arena.empty() || fread(&m_arena[0], 1, m_arena.size(), f) == m_arena.size()) &&
+        fread(&m_table[0], sizeof(Slot), m_table.size(), f) == m_table.size();
+    fclose(f);
+    if (!ok)
+        throw runtime_error("truncated vocab file");
+    m_arena.resize(size_t(header.arena_bytes));
+    sync_view();
+#endif
+    m_size = size_t(header.size);
+    m_mask = size_t(header.table_slots - 1);
+}
@@ -0,0 +1,179 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * flatvocab.hpp  -  compact string <--> id map for large vocabularies
+ *
+ * FlatVocab keeps every word exactly once in a contiguous, '\0' separated
+ * string arena. Word ids index an offsets array into the arena, and the
+ * string --> id direction is an open-addressing (linear probing) table of
+ * 32 bit ids, each paired with 32 bits of the word's hash so that probing
+ * past other words and rehashing never touch the arena. Compared with
+ * ItemMap<std::string> there is no per-word node or std::string allocation,
+ * which cuts the memory needed for a large vocabulary to less than half and
+ * keeps lookups within a few cache lines.
+ *
+ * All three arrays are flat, so save() writes them out as they are and
+ * load() maps the file back with mmap(): opening the vocab of a large index
+ * neither parses nor rehashes anything, pages are read in as words are
+ * touched.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FLATVOCAB_H
+#define FLATVOCAB_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+
+class MmapFile;
+
+class FlatVocab : boost::noncopyable {
+    public:
+        typedef size_t id_type;
+        static const id_type null_id;
+
+        FlatVocab();
+
+        ~FlatVocab();
+
+        size_t size() const { return m_size; }
+
+        bool empty() const { return size() == 0; }
+
+        void clear();
+
+        /**
+         * add a word into vocab and return its id
+         * if the word already exists simply return its id
+         */
+        id_type add(const char* s, size_t len);
+
+        id_type add(const char* s) { return add(s, strlen(s)); }
+
+        id_type add(const std::string& s) { return add(s.data(), s.size()); }
+
+        /**
+         * get a word's id, return null_id if the word does not exist
+         * the word need not be '\0' terminated
+         */
+        id_type id(const char* s, size_t len) const;
+
+        id_type id(const std::string& s) const { return id(s.data(), s.size()); }
+
+        bool has_item(const char* s, size_t len) const {
+            return id(s, len) != null_id;
+        }
+
+        bool has_item(const std::string& s) const {
+            return id(s) != null_id;
+        }
+
+        /**
+         * return the '\0' terminated word of given id, the pointer stays
+         * valid until the next add(), clear() or load()
+         */
+        const char* operator[](id_type id) const {
+            return m_words + m_offs[id];
+        }
+
+        size_t length(id_type id) const {
+            return size_t(m_offs[id + 1] - m_offs[id] - 1);
+        }
+
+        /**
+         * give the words with ids >= first new ids in strcmp() order, so
+         * that comparing their ids compares the words. remap receives the
+         * new id of every old id (ids below first stay unchanged)
+         */
+        void renumber(id_type first, std::vector<id_type>& remap);
+
+        // bytes of heap held by the arena, offsets and hash table
+        size_t memory_usage() const;
+
+        /**
+         * write the vocab in binary form, ids are preserved
+         * throws runtime_error on io errors
+         */
+        void save(const std::string& file) const;
+
+        /**
+         * replace the content with a vocab written by save()
+         * The file is mapped read only where mmap() is available, the first
+         * add() then copies it into memory.
+         * throws runtime_error if the file can not be read or is not a
+         * binary vocab of this platform's byte order
+         */
+        void load(const std::string& file);
+
+        // true if the content is still a read only mapping of a file
+        bool mapped() const { return m_map.get() != 0; }
+
+        // check whether a file starts like a vocab written by save()
+        static bool is_binary_file(const std::string& file);
+
+        static boost::uint64_t hash(const char* s, size_t len);
+
+    private:
+        struct Slot {
+            boost::uint32_t m_id;
+            boost::uint32_t m_hash;
+        };
+
+        struct FileHeader;
+        struct WordLess;
+
+        size_t find_slot(const char* s, size_t len, boost::uint32_t h) const;
+        void rehash(size_t slots);
+        void sync_view();
+        void unmap();
+
+        bool equal(boost::uint32_t id, const char* s, size_t len) const {
+            return length(id) == len && memcmp((*this)[id], s, len) == 0;
+        }
+
+        static const boost::uint32_t s_empty_slot;
+
+        std::vector<char>            m_arena;   // all words, '\0' separated
+        std::vector<boost::uint64_t> m_offsets; // id --> arena offset, size() + 1 entries
+        std::vector<Slot>            m_table;   // open addressing table of ids
+
+        // what lookups actually read: either the vectors above or a mapped file
+        const char*                  m_words;
+        const boost::uint64_t*       m_offs;
+        const Slot*                  m_slots;
+        size_t                       m_size;
+        size_t                       m_mask;    // table size - 1
+        boost::scoped_ptr<MmapFile>  m_map;
+};
+
+#endif /* ifndef FLATVOCAB_H */
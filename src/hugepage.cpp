@@ -0,0 +1,164 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * hugepage.cpp  -  huge page backed memory blocks
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <new>
+#include <string>
+#include "hugepage.hpp"
+#include "mmapfile.h"
+#include "thread.hpp"
+
+#if defined(USE_POSIX_MMAP)
+#include <sys/mman.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+using namespace std;
+
+// smaller blocks come from malloc()
+static const size_t s_huge_page_size = 2 * 1024 * 1024;
+
+struct Block {
+    size_t      m_size;    // bytes actually mapped
+    PageBacking m_backing;
+};
+
+static Mutex                 s_mutex;
+static map<void*, Block>     s_blocks;
+static size_t                s_bytes[3];
+
+static size_t round_up(size_t bytes) {
+    return (bytes + s_huge_page_size - 1) / s_huge_page_size * s_huge_page_size;
+}
+
+#if defined(USE_POSIX_MMAP) && defined(MAP_ANONYMOUS)
+// madvise() succeeds even if transparent huge pages are turned off
+static bool transparent_huge_pages_enabled() {
+    ifstream f("/sys/kernel/mm/transparent_hugepage/enabled");
+    string s;
+    if (!getline(f, s))
+        return false;
+    return s.find("[never]") == string::npos;
+}
+
+// an anonymous mapping aligned to the huge page size
+static void* map_aligned(size_t bytes) {
+    size_t len = bytes + s_huge_page_size;
+    char* p = (char*)mmap(0, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return 0;
+
+    size_t head = (s_huge_page_size -
+            (size_t)p % s_huge_page_size) % s_huge_page_size;
+    if (head)
+        munmap(p, head);
+    munmap(p + head + bytes, len - head - bytes);
+    return p + head;
+}
+#endif
+
+static void* map_block(size_t bytes, Block& block) {
+    block.m_size    = bytes;
+    block.m_backing = SMALL_PAGES;
+    if (bytes < s_huge_page_size)
+        return malloc(bytes ? bytes : 1);
+
+#if defined(USE_POSIX_MMAP) && defined(MAP_ANONYMOUS)
+    block.m_size = round_up(bytes);
+    void* p;
+#if defined(MAP_HUGETLB)
+    // explicit huge pages, only there if the admin reserved some
+    p = mmap(0, block.m_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        block.m_backing = EXPLICIT_HUGE_PAGES;
+        return p;
+    }
+#endif
+    p = map_aligned(block.m_size);
+#if defined(MADV_HUGEPAGE)
+    static bool thp = transparent_huge_pages_enabled();
+    if (p && thp && madvise(p, block.m_size, MADV_HUGEPAGE) == 0)
+        block.m_backing = TRANSPARENT_HUGE_PAGES;
+#endif
+    return p;
+#else
+    return malloc(bytes);
+#endif
+}
+
+void* huge_alloc(size_t bytes) {
+    Block block;
+    void* p = map_block(bytes, block);
+    if (!p)
+        throw bad_alloc();
+
+    ScopedLock lock(s_mutex);
+    s_blocks[p] = block;
+    s_bytes[block.m_backing] += block.m_size;
+    return p;
+}
+
+void huge_free(void* p) {
+    if (!p)
+        return;
+
+    Block block;
+    {
+        ScopedLock lock(s_mutex);
+        map<void*, Block>::iterator it = s_blocks.find(p);
+        assert(it != s_blocks.end());
+        block = it->second;
+        s_blocks.erase(it);
+        s_bytes[block.m_backing] -= block.m_size;
+    }
+
+#if defined(USE_POSIX_MMAP) && defined(MAP_ANONYMOUS)
+    if (block.m_size >= s_huge_page_size) {
+        munmap(p, block.m_size);
+        return;
+    }
+#endif
+    free(p);
+}
+
+size_t huge_page_bytes(PageBacking backing) {
+    ScopedLock lock(s_mutex);
+    return s_bytes[backing];
+}
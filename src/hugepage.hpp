@@ -0,0 +1,115 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * hugepage.hpp  -  huge page backed memory blocks
+ *
+ * Sorting the ptable jumps all over the text buffer, with 4 KB pages a
+ * buffer of a few GB thrashes the TLB. huge_alloc() hands out large blocks
+ * backed by explicit huge pages (MAP_HUGETLB) when the system has reserved
+ * some, else by an aligned anonymous mapping advised to use transparent
+ * huge pages (MADV_HUGEPAGE), else by plain memory. HugePageAllocator puts
+ * std::vector on top of it.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HUGEPAGE_H
+#define HUGEPAGE_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+
+#include <cstddef>
+#include <new>
+
+// how the memory of a block is backed
+enum PageBacking {
+    SMALL_PAGES,
+    TRANSPARENT_HUGE_PAGES,
+    EXPLICIT_HUGE_PAGES
+};
+
+/**
+ * allocate a block of at least bytes, blocks smaller than a huge page come
+ * from malloc(). throws bad_alloc
+ */
+void* huge_alloc(size_t bytes);
+
+// release a block returned by huge_alloc()
+void huge_free(void* p);
+
+// bytes currently held by blocks of the given backing
+size_t huge_page_bytes(PageBacking backing);
+
+/**
+ * STL allocator over huge_alloc(), all instances are interchangeable
+ */
+template <typename T>
+class HugePageAllocator {
+    public:
+        typedef T              value_type;
+        typedef T*             pointer;
+        typedef const T*       const_pointer;
+        typedef T&             reference;
+        typedef const T&       const_reference;
+        typedef size_t         size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        template <typename U>
+        struct rebind { typedef HugePageAllocator<U> other; };
+
+        HugePageAllocator() {}
+        template <typename U>
+        HugePageAllocator(const HugePageAllocator<U>&) {}
+
+        pointer address(reference x) const { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+
+        pointer allocate(size_type n, const void* = 0) {
+            if (n > max_size())
+                throw std::bad_alloc();
+            return static_cast<pointer>(huge_alloc(n * sizeof(T)));
+        }
+
+        void deallocate(pointer p, size_type) { huge_free(p); }
+
+        size_type max_size() const { return size_type(-1) / sizeof(T); }
+
+        void construct(pointer p, const T& x) { new(p) T(x); }
+        void destroy(pointer p) { p->~T(); }
+};
+
+template <typename T, typename U>
+inline bool operator==(const HugePageAllocator<T>&, const HugePageAllocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const HugePageAllocator<T>&, const HugePageAllocator<U>&) {
+    return false;
+}
+
+#endif /* ifndef HUGEPAGE_H */
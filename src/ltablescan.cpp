@@ -0,0 +1,108 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ltablescan.cpp  -  find group boundaries in an ltable quickly
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ltablescan.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LTABLESCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static size_t lcp_run_scalar(const unsigned char* l, size_t size,
+        unsigned char min) {
+    size_t i = 0;
+    while (i < size && l[i] >= min)
+        ++i;
+    return i;
+}
+
+#ifdef LTABLESCAN_X86
+
+/**
+ * an entry x is >= min exactly when max(x, min) == x, the movemask of that
+ * compare has a 0 bit at each boundary and the first one is counted with
+ * __builtin_ctz()
+ */
+__attribute__((target("sse2")))
+static size_t lcp_run_sse2(const unsigned char* l, size_t size,
+        unsigned char min) {
+    const __m128i m = _mm_set1_epi8(char(min));
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(l + i));
+        unsigned ge = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(x, m), x));
+        if (ge != 0xffff)
+            return i + __builtin_ctz(~ge);
+    }
+    return i + lcp_run_scalar(l + i, size - i, min);
+}
+
+__attribute__((target("avx2")))
+static size_t lcp_run_avx2(const unsigned char* l, size_t size,
+        unsigned char min) {
+    const __m256i m = _mm256_set1_epi8(char(min));
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i*)(l + i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i*)(l + i + 32));
+        unsigned ge0 = _mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_max_epu8(x0, m), x0));
+        unsigned ge1 = _mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_max_epu8(x1, m), x1));
+        if ((ge0 & ge1) != 0xffffffffu) {
+            if (ge0 != 0xffffffffu)
+                return i + __builtin_ctz(~ge0);
+            return i + 32 + __builtin_ctz(~ge1);
+        }
+    }
+    return i + lcp_run_sse2(l + i, size - i, min);
+}
+
+#endif /* LTABLESCAN_X86 */
+
+size_t lcp_run(const unsigned char* ltable, size_t size, unsigned min) {
+    if (min == 0)
+        return size;
+    if (min > 255)
+        return 0;
+
+#ifdef LTABLESCAN_X86
+    static const int s_kernel = __builtin_cpu_supports("avx2") ? 2 :
+        (__builtin_cpu_supports("sse2") ? 1 : 0);
+    if (s_kernel == 2)
+        return lcp_run_avx2(ltable, size, (unsigned char)min);
+    if (s_kernel == 1)
+        return lcp_run_sse2(ltable, size, (unsigned char)min);
+#endif
+    return lcp_run_scalar(ltable, size, (unsigned char)min);
+}
@@ -0,0 +1,51 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ltablescan.hpp  -  find group boundaries in an ltable quickly
+ *
+ * ltable[i] is the number of symbols the suffixes at i - 1 and i have in
+ * common. A run of entries >= M extends the current M-gram group (and all
+ * shorter ones) without starting new n-grams, which is what almost every
+ * entry does once M is more than a few symbols. lcp_run() measures such
+ * runs 16 or 32 entries at a time with SSE2 or AVX2 compares, picked at
+ * run time, and byte by byte where neither is available.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef LTABLESCAN_H
+#define LTABLESCAN_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstddef>
+
+/**
+ * return the number of leading entries of ltable[0, size) which are >= min
+ */
+size_t lcp_run(const unsigned char* ltable, size_t size, unsigned min);
+
+#endif /* ifndef LTABLESCAN_H */
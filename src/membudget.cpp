@@ -0,0 +1,161 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * membudget.cpp  -  process wide memory budget
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fstream>
+#include <iostream>
+#include <sys/resource.h>
+#include "membudget.hpp"
+
+using namespace std;
+
+MemBudget::MemBudget():m_limit(0), m_used(0), m_peak(0) {
+}
+
+void MemBudget::set(const string& what, size_t bytes) {
+    ScopedLock lock(m_mutex);
+    size_t& item = m_items[what];
+    m_used = m_used - item + bytes;
+    item = bytes;
+    if (m_used > m_peak)
+        m_peak = m_used;
+}
+
+size_t MemBudget::used() const {
+    ScopedLock lock(m_mutex);
+    return m_used;
+}
+
+size_t MemBudget::available() const {
+    ScopedLock lock(m_mutex);
+    if (m_limit == 0)
+        return size_t(-1);
+    return m_used < m_limit ? m_limit - m_used : 0;
+}
+
+void MemBudget::phase(const string& name) {
+    ScopedLock lock(m_mutex);
+    if (!m_phase.empty()) {
+        cerr << "Peak memory of " << m_phase << ": "
+            << m_peak / (1024 * 1024) << " MB";
+        if (m_limit)
+            cerr << " of " << m_limit / (1024 * 1024) << " MB budget";
+        cerr << endl;
+    }
+    m_phase = name;
+    m_peak  = m_used;
+}
+
+// read a limit in bytes, 0 if the file is missing or says "max"
+static size_t read_limit(const string& file) {
+    ifstream f(file.c_str());
+    unsigned long long n = 0;
+    if (!(f >> n))
+        return 0;
+    return size_t(n) == n ? size_t(n) : size_t(-1);
+}
+
+static void take_min(size_t& m, size_t n) {
+    if (n && (m == 0 || n < m))
+        m = n;
+}
+
+// cgroup v2: the smallest memory.max from our cgroup up to the root
+static size_t cgroup_v2_limit() {
+    ifstream f("/proc/self/cgroup");
+    string s;
+    string path;
+    while (getline(f, s)) {
+        if (s.compare(0, 3, "0::") == 0)
+            path = s.substr(3);
+    }
+
+    size_t limit = 0;
+    if (path.empty())
+        return limit;
+    for (;;) {
+        take_min(limit, read_limit("/sys/fs/cgroup" + path + "/memory.max"));
+        if (path.empty())
+            break;
+        path.erase(path.rfind('/'));
+    }
+    return limit;
+}
+
+// MemAvailable (or MemTotal on old kernels) in bytes
+static size_t meminfo_available() {
+    ifstream f("/proc/meminfo");
+    string key;
+    unsigned long long kb;
+    size_t total = 0;
+    while (f >> key >> kb) {
+        if (key == "MemAvailable:")
+            return size_t(kb * 1024);
+        if (key == "MemTotal:")
+            total = size_t(kb * 1024);
+        f.ignore(256, '\n');
+    }
+    return total;
+}
+
+size_t MemBudget::detect_memory() {
+    size_t m = 0;
+    take_min(m, cgroup_v2_limit());
+    take_min(m, read_limit("/sys/fs/cgroup/memory/memory.limit_in_bytes"));
+    take_min(m, meminfo_available());
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_AS, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+        take_min(m, size_t(rl.rlim_cur));
+    return m;
+}
+
+MemBudget& mem_budget() {
+    static MemBudget budget;
+    return budget;
+}
+
+void init_mem_budget(int mem) {
+    size_t limit;
+    if (mem > 0) {
+        limit = size_t(mem) * 1024 * 1024;
+    } else {
+        // leave a quarter for what is not accounted for: stdio and iconv
+        // buffers, the page cache of temp files ...
+        limit = MemBudget::detect_memory() / 4 * 3;
+        if (limit == 0)
+            limit = 50 * 1024 * 1024;
+    }
+    mem_budget().set_limit(limit);
+    cerr << "Memory budget:   " << limit / (1024 * 1024) << " MB"
+        << (mem > 0 ? "" : " (detected)") << endl;
+}
@@ -0,0 +1,99 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * membudget.hpp  -  process wide memory budget
+ *
+ * MemBudget keeps the bytes held by each kind of large allocation (text
+ * buffer, ptable, vocab, ...) against a limit, which is either given or
+ * detected from the cgroup (v2 memory.max, v1 memory.limit_in_bytes) and
+ * /proc/meminfo. Sizing the text buffer from available() makes spills
+ * happen before the process outgrows its memory. Work is divided into
+ * named phases and the peak of each phase is reported when it ends.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef MEMBUDGET_H
+#define MEMBUDGET_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+
+#include <map>
+#include <string>
+#include <boost/utility.hpp>
+#include "thread.hpp"
+
+class MemBudget : boost::noncopyable {
+    public:
+        MemBudget();
+
+        // limit in bytes, 0 means unlimited
+        size_t limit() const { return m_limit; }
+        void set_limit(size_t bytes) { m_limit = bytes; }
+
+        /**
+         * record that bytes are now held for what, replacing the amount
+         * recorded for it before. set(what, 0) when it is freed
+         */
+        void set(const std::string& what, size_t bytes);
+
+        size_t used() const;
+
+        // bytes left under the limit, 0 if over it
+        size_t available() const;
+
+        /**
+         * end the current phase, reporting its peak on stderr, and start a
+         * new one. an empty name only ends the current phase
+         */
+        void phase(const std::string& name);
+
+        /**
+         * memory this process may use: the smallest of the cgroup limits
+         * and the memory the kernel considers available, 0 if unknown
+         */
+        static size_t detect_memory();
+
+    private:
+        mutable Mutex                 m_mutex;
+        size_t                        m_limit;
+        size_t                        m_used;
+        size_t                        m_peak;     // of the current phase
+        std::string                   m_phase;
+        std::map<std::string, size_t> m_items;
+};
+
+// the budget shared by the whole process
+MemBudget& mem_budget();
+
+/**
+ * set the limit of mem_budget() to mem MB, or to three quarters of the
+ * memory available to the process if mem is 0, and report it on stderr
+ */
+void init_mem_budget(int mem);
+
+#endif /* ifndef MEMBUDGET_H */
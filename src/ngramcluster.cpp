@@ -0,0 +1,264 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramcluster.cpp  -  count n-grams on several machines as one job
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include "tools.hpp"
+#include "countstream.hpp"
+#include "ngramcluster_cmdline.h"
+
+using namespace std;
+
+// the count stream of a worker
+struct Source {
+    enum Kind { FILE_SOURCE, PROCESS, SOCKET };
+
+    Source() : m_kind(FILE_SOURCE), m_file(0) {}
+
+    Kind   m_kind;
+    string m_name;
+    FILE*  m_file;
+};
+
+/**
+ * connect to the worker at HOST:PORT and return the socket. Workers may
+ * still be starting, so connecting is tried for a while
+ * throws runtime_error if the worker can not be reached
+ */
+int connect_worker(const string& address) {
+    size_t colon = address.rfind(':');
+    if (colon == string::npos)
+        throw runtime_error("worker address is not HOST:PORT: " + address);
+    string host = address.substr(0, colon);
+    string port = address.substr(colon + 1);
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addrs = 0;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs) != 0)
+        throw runtime_error("unable to resolve worker address " + address);
+
+    int fd = -1;
+    for (unsigned tries = 0; fd < 0 && tries < 30; ++tries) {
+        if (tries > 0)
+            sleep(1);
+        for (addrinfo* a = addrs; a && fd < 0; a = a->ai_next) {
+            fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+    freeaddrinfo(addrs);
+    if (fd < 0)
+        throw runtime_error("unable to connect to worker " + address);
+    return fd;
+}
+
+// open the count stream given as tcp:HOST:PORT, run:COMMAND or a file name
+void open_source(const string& spec, Source& s) {
+    s.m_name = spec;
+    if (spec.compare(0, 4, "tcp:") == 0) {
+        s.m_kind = Source::SOCKET;
+        s.m_file = fdopen(connect_worker(spec.substr(4)), "r");
+    } else if (spec.compare(0, 4, "run:") == 0) {
+        s.m_kind = Source::PROCESS;
+        s.m_file = popen(spec.c_str() + 4, "r");
+    } else {
+        s.m_kind = Source::FILE_SOURCE;
+        s.m_file = fopen(spec.c_str(), "r");
+    }
+    if (!s.m_file)
+        throw runtime_error("unable to open count stream " + spec);
+}
+
+// close the count stream, false if its worker process failed
+bool close_source(Source& s) {
+    FILE* f = s.m_file;
+    s.m_file = 0;
+    if (s.m_kind == Source::PROCESS)
+        return pclose(f) == 0;
+    fclose(f);
+    return true;
+}
+
+/**
+ * k-way merge of the count streams: n-grams equal in several streams are
+ * put out once with the sum of their counts, if that is >= freq
+ */
+void merge_streams(const vector<CountReader*>& readers, unsigned freq,
+        bool char_mode) {
+    CountMerger merger(readers);
+    CountWriter out(stdout, false, char_mode);
+    while (merger.next()) {
+        if (merger.count() >= freq)
+            out.write(merger.ngram(), merger.length(), merger.count());
+    }
+    out.flush();
+}
+
+/**
+ * run as a worker: wait for the coordinator on port, then run command
+ * with its output going to the coordinator. If command fails the
+ * connection is reset instead of closed, so that the coordinator does not
+ * take the output for a complete count stream
+ */
+int serve(int port, char** command, unsigned count) {
+    if (count == 0)
+        throw runtime_error("no worker command given after --");
+
+    char service[16];
+    sprintf(service, "%d", port);
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+    addrinfo* addrs = 0;
+    if (getaddrinfo(0, service, &hints, &addrs) != 0)
+        throw runtime_error("unable to get an address to listen on");
+
+    int fd = -1;
+    for (addrinfo* a = addrs; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        int on = 1;
+        if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+                    bind(fd, a->ai_addr, a->ai_addrlen) != 0 || listen(fd, 1) != 0)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+    if (fd < 0)
+        throw runtime_error("unable to listen on the worker port");
+
+    cerr << "Waiting for the coordinator on port " << port << endl;
+    int conn = accept(fd, 0, 0);
+    close(fd);
+    if (conn < 0)
+        throw runtime_error("unable to accept the coordinator connection");
+
+    cerr << "Running " << command[0] << " for the coordinator" << endl;
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(conn, STDOUT_FILENO);
+        close(conn);
+        vector<char*> argv(command, command + count);
+        argv.push_back(0);
+        execvp(argv[0], &argv[0]);
+        perror(argv[0]);
+        _exit(127);
+    }
+
+    int status = 0;
+    bool ok = pid > 0 && waitpid(pid, &status, 0) == pid &&
+        WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (!ok) {
+        linger reset = { 1, 0 };
+        setsockopt(conn, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        cerr << "worker command failed" << endl;
+    }
+    close(conn);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc,char* argv[]) {
+    gengetopt_args_info args_info;
+
+    /* let's call our cmdline parser */
+    if (cmdline_parser (argc, argv, &args_info) != 0)
+        return EXIT_FAILURE;
+
+    if (args_info.freq_arg < 1) {
+        cerr << "freq must be >= 1" << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<Source> sources;
+    vector<CountReader*> readers;
+    int rc = EXIT_SUCCESS;
+    try {
+        if (args_info.serve_given)
+            return serve(args_info.serve_arg, args_info.inputs, args_info.inputs_num);
+
+        if (args_info.inputs_num == 0)
+            throw runtime_error("no count streams to merge");
+
+        cerr << "start at: " << current_time();
+        // workers all start counting as their streams are opened
+        sources.resize(args_info.inputs_num);
+        for (unsigned i = 0; i < args_info.inputs_num; ++i) {
+            open_source(args_info.inputs[i], sources[i]);
+            readers.push_back(new CountReader(sources[i].m_file,
+                        sources[i].m_name, args_info.char_flag));
+        }
+
+        merge_streams(readers, args_info.freq_arg, args_info.char_flag);
+
+        for (size_t i = 0; i < sources.size(); ++i) {
+            if (!close_source(sources[i]))
+                throw runtime_error("worker failed: " + sources[i].m_name);
+        }
+    } catch (bad_alloc& e) {
+        cerr << "std::bad_alloc caught: out of memory" << endl;
+        rc = EXIT_FAILURE;
+    } catch (runtime_error& e) {
+        cerr << "runtime_error caught:" << e.what() << endl;
+        rc = EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < readers.size(); ++i)
+        delete readers[i];
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i].m_file)
+            close_source(sources[i]);
+    }
+
+    if (rc == EXIT_SUCCESS)
+        cerr << "end at: " << current_time();
+    return rc;
+}
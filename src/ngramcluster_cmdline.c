@@ -0,0 +1,202 @@
+/*
+  File autogenerated by gengetopt version 2.10
+  generated with the following command:
+  gengetopt -i ngramcluster.ggo -u -F ngramcluster_cmdline 
+
+  The developers of gengetopt consider the fixed text that goes in all
+  gengetopt output files to be in the public domain:
+  we make no copyright claims on it.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* If we use autoconf.  */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "getopt.h"
+
+#include "ngramcluster_cmdline.h"
+
+void
+cmdline_parser_print_version (void)
+{
+  printf ("%s %s\n", CMDLINE_PARSER_PACKAGE, CMDLINE_PARSER_VERSION);
+}
+
+void
+cmdline_parser_print_help (void)
+{
+  cmdline_parser_print_version ();
+  printf("\n"
+  "Purpose:\n"
+  "  Count N-grams of a corpus spread over several machines as one job: merge\n"
+  "  the count streams of workers, each counting its local shard, summing the\n"
+  "  counts of equal N-grams and applying the frequency threshold to the totals.\n"
+  "  \n"
+  "  A count stream is given as one of\n"
+  "    tcp:HOST:PORT  a worker started with `ngramcluster --serve PORT' on HOST\n"
+  "    run:COMMAND    a worker run as a local process (by /bin/sh)\n"
+  "    FILE           the output of a worker on a shared filesystem\n"
+  "  Workers run text2ngram or extractngram with --by-length and without -f, as\n"
+  "  counts below the threshold on each shard may still add up above it.\n"
+  "  \n"
+  "  Example:\n"
+  "  1. ngramcluster --serve 7000 -- extractngram -i shard -n1 -m3 --by-length\n"
+  "  on each machine, then\n"
+  "  ngramcluster -f5 tcp:host1:7000 tcp:host2:7000 > counts\n"
+  "  will count 1 to 3-grams of all shards and write those with freq >= 5.\n"
+  "  \n"
+  "  2. ngramcluster -f5 'run:text2ngram -n1 -m3 --by-length a.txt' 'run:text2ngram -n1 -m3 --by-length b.txt'\n"
+  "  the same with local worker processes. \n"
+  "\n"
+  "Usage: %s [OPTIONS]... [FILES]...\n", CMDLINE_PARSER_PACKAGE);
+  printf("   -h      --help       Print help and exit\n");
+  printf("   -V      --version    Print version and exit\n");
+  printf("   -c      --char       merge char ngram counts (UTF-8 encoded) (default=off)\n");
+  printf("   -fINT   --freq=INT   output N gram whose total freq >= f (default='1')\n");
+  printf("           --serve=INT  run as a worker: run the command given after -- for the first coordinator connecting to this TCP port, and send it its output\n");
+}
+
+
+static char *gengetopt_strdup (const char *s);
+
+/* gengetopt_strdup() */
+/* strdup.c replacement of strdup, which is not standard */
+char *
+gengetopt_strdup (const char *s)
+{
+  char *result = (char*)malloc(strlen(s) + 1);
+  if (result == (char*)0)
+    return (char*)0;
+  strcpy(result, s);
+  return result;
+}
+
+int
+cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_info)
+{
+  int c;	/* Character of the parsed option.  */
+  int missing_required_options = 0;
+
+  args_info->help_given = 0 ;
+  args_info->version_given = 0 ;
+  args_info->char_given = 0 ;
+  args_info->freq_given = 0 ;
+  args_info->serve_given = 0 ;
+#define clear_args() { \
+  args_info->char_flag = 0;\
+  args_info->freq_arg = 1 ;\
+}
+
+  clear_args();
+
+  args_info->inputs = NULL;
+  args_info->inputs_num = 0;
+
+  optarg = 0;
+  optind = 1;
+  opterr = 1;
+  optopt = '?';
+
+  while (1)
+    {
+      int option_index = 0;
+      char *stop_char;
+
+      static struct option long_options[] = {
+        { "help",	0, NULL, 'h' },
+        { "version",	0, NULL, 'V' },
+        { "char",	0, NULL, 'c' },
+        { "freq",	1, NULL, 'f' },
+        { "serve",	1, NULL, 0 },
+        { NULL,	0, NULL, 0 }
+      };
+
+      stop_char = 0;
+      c = getopt_long (argc, argv, "hVcf:", long_options, &option_index);
+
+      if (c == -1) break;	/* Exit from `while (1)' loop.  */
+
+      switch (c)
+        {
+        case 'h':	/* Print help and exit.  */
+          clear_args ();
+          cmdline_parser_print_help ();
+          exit (EXIT_SUCCESS);
+
+        case 'V':	/* Print version and exit.  */
+          clear_args ();
+          cmdline_parser_print_version ();
+          exit (EXIT_SUCCESS);
+
+        case 'c':	/* merge char ngram counts (UTF-8 encoded).  */
+          if (args_info->char_given)
+            {
+              fprintf (stderr, "%s: `--char' (`-c') option given more than once\n", CMDLINE_PARSER_PACKAGE);
+              clear_args ();
+              exit (EXIT_FAILURE);
+            }
+          args_info->char_given = 1;
+          args_info->char_flag = !(args_info->char_flag);
+          break;
+
+        case 'f':	/* output N gram whose total freq >= f.  */
+          if (args_info->freq_given)
+            {
+              fprintf (stderr, "%s: `--freq' (`-f') option given more than once\n", CMDLINE_PARSER_PACKAGE);
+              clear_args ();
+              exit (EXIT_FAILURE);
+            }
+          args_info->freq_given = 1;
+          args_info->freq_arg = strtol (optarg,&stop_char,0);
+          break;
+
+
+        case 0:	/* Long option with no short option */
+          /* run as a worker: run the command given after -- for the first coordinator connecting to this TCP port, and send it its output.  */
+          if (strcmp (long_options[option_index].name, "serve") == 0)
+          {
+            if (args_info->serve_given)
+              {
+                fprintf (stderr, "%s: `--serve' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->serve_given = 1;
+            args_info->serve_arg = strtol (optarg,&stop_char,0);
+            break;
+          }
+          
+
+        case '?':	/* Invalid option.  */
+          /* `getopt_long' already printed an error message.  */
+          exit (EXIT_FAILURE);
+
+        default:	/* bug: option not considered.  */
+          fprintf (stderr, "%s: option unknown: %c\n", CMDLINE_PARSER_PACKAGE, c);
+          abort ();
+        } /* switch */
+    } /* while */
+
+
+  if ( missing_required_options )
+    exit (EXIT_FAILURE);
+
+  if (optind < argc)
+    {
+      int i = 0 ;
+  
+      args_info->inputs_num = argc - optind ;
+      args_info->inputs = 
+        (char **)(malloc ((args_info->inputs_num)*sizeof(char *))) ;
+      while (optind < argc)
+        args_info->inputs[ i++ ] = gengetopt_strdup (argv[optind++]) ; 
+    }
+  
+  return 0;
+}
@@ -0,0 +1,49 @@
+/* ngramcluster_cmdline.h */
+
+/* File autogenerated by gengetopt version 2.10  */
+
+#ifndef NGRAMCLUSTER_CMDLINE_H
+#define NGRAMCLUSTER_CMDLINE_H
+
+/* If we use autoconf.  */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#ifndef CMDLINE_PARSER_PACKAGE
+#define CMDLINE_PARSER_PACKAGE "ngramcluster"
+#endif
+
+#ifndef CMDLINE_PARSER_VERSION
+#define CMDLINE_PARSER_VERSION ""
+#endif
+
+struct gengetopt_args_info
+{
+  int char_flag;	/* merge char ngram counts (UTF-8 encoded) (default=off).  */
+  int freq_arg;	/* output N gram whose total freq >= f (default='1').  */
+  int serve_arg;	/* run as a worker: run the command given after -- for the first coordinator connecting to this TCP port, and send it its output.  */
+
+  int help_given ;	/* Whether help was given.  */
+  int version_given ;	/* Whether version was given.  */
+  int char_given ;	/* Whether char was given.  */
+  int freq_given ;	/* Whether freq was given.  */
+  int serve_given ;	/* Whether serve was given.  */
+
+  char **inputs ; /* unamed options */
+  unsigned inputs_num ; /* unamed options number */
+} ;
+
+int cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_info);
+
+void cmdline_parser_print_help(void);
+void cmdline_parser_print_version(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* NGRAMCLUSTER_CMDLINE_H */
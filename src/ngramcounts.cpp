@@ -0,0 +1,338 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramcounts.cpp  -  materialized n-gram count tables of an index
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "ngramcounts.hpp"
+#include "membudget.hpp"
+
+using namespace std;
+using boost::uint32_t;
+using boost::uint64_t;
+
+/**
+ * layout of a count table file:
+ *   FileHeader
+ *   uint64_t starts[M - N + 1], sizes[M - N + 1]
+ *   Entry    entries of each n, by decreasing count and then by rank
+ */
+struct FileHeader {
+    char       magic[8];
+    uint32_t   version;
+    uint32_t   byte_order;
+    uint32_t   min_n;
+    uint32_t   max_n;
+    IndexStamp stamp;
+};
+
+static const char     s_magic[8]   = { 'N', 'G', 'C', 'O', 'U', 'N', 'T', '\0' };
+static const uint32_t s_version    = 3;
+static const uint32_t s_byte_order = 0x01020304;
+
+// what add() keeps of an n-gram until finish()
+struct CountTableWriter::CountPair {
+    uint32_t m_offset;
+    uint32_t m_count;
+    uint64_t m_rank;
+};
+
+// pairs read at a time from the temporary files
+static const size_t s_pair_block = 1 << 16;
+
+static uint64_t mtime_ns(const struct stat& st) {
+#if defined(__APPLE__)
+    return uint64_t(st.st_mtimespec.tv_sec) * 1000000000u + st.st_mtimespec.tv_nsec;
+#else
+    return uint64_t(st.st_mtim.tv_sec) * 1000000000u + st.st_mtim.tv_nsec;
+#endif
+}
+
+IndexStamp index_stamp(const string& base) {
+    struct stat ptable;
+    struct stat ngram;
+    string ptable_name = base + ".ptable";
+    string ngram_name  = base + ".ngram";
+    if (stat(ptable_name.c_str(), &ptable) != 0 ||
+            stat(ngram_name.c_str(), &ngram) != 0)
+        throw runtime_error("unable to stat index files");
+
+    IndexStamp stamp;
+    stamp.m_ptable_size  = ptable.st_size;
+    stamp.m_ptable_mtime = mtime_ns(ptable);
+    stamp.m_ngram_size   = ngram.st_size;
+    stamp.m_ngram_mtime  = mtime_ns(ngram);
+    return stamp;
+}
+
+CountTableWriter::CountTableWriter(const string& file, unsigned N, unsigned M,
+        const IndexStamp& stamp)
+:
+m_file(file),
+m_N(N),
+m_M(M),
+m_stamp(stamp),
+m_temp(M - N + 1, (FILE*)0),
+m_added(0)
+{
+    assert(N >= 1 && N <= M);
+}
+
+CountTableWriter::~CountTableWriter() {
+    for (size_t i = 0; i < m_temp.size(); ++i) {
+        if (m_temp[i])
+            fclose(m_temp[i]);
+    }
+}
+
+void CountTableWriter::add(unsigned n, unsigned offset, unsigned count) {
+    assert(n >= m_N && n <= m_M);
+    FILE*& f = m_temp[n - m_N];
+    if (!f && !(f = tmpfile()))
+        throw runtime_error("unable to open temporary file for n-gram counts");
+
+    CountPair p;
+    p.m_offset = offset;
+    p.m_count  = count;
+    p.m_rank   = m_added++;
+    if (fwrite(&p, sizeof(p), 1, f) != 1)
+        throw runtime_error("fail to write temporary file for n-gram counts");
+}
+
+/**
+ * The positions of each count in the sorted order come from a histogram of
+ * the counts. A pass over the n-grams of a length then puts every one whose
+ * position falls into the current block there, in symbol order among equal
+ * counts
+ */
+void CountTableWriter::finish() {
+    size_t lengths = m_temp.size();
+    vector<uint64_t> starts(lengths), sizes(lengths);
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, s_magic, sizeof(header.magic));
+    header.version    = s_version;
+    header.byte_order = s_byte_order;
+    header.min_n      = m_N;
+    header.max_n      = m_M;
+    header.stamp      = m_stamp;
+
+    string tmp = m_file + ".tmp";
+    FILE* out = fopen(tmp.c_str(), "wb");
+    if (!out)
+        throw runtime_error("unable to open count table file to write");
+
+    vector<CountPair> pairs(s_pair_block);
+    vector<CountTable::Entry> entries;
+    uint64_t pos = sizeof(header) + 2 * lengths * sizeof(uint64_t);
+    bool ok = fseek(out, long(pos), SEEK_SET) == 0;
+    try {
+        for (size_t i = 0; ok && i < lengths; ++i) {
+            FILE* f = m_temp[i];
+            uint64_t size = f ? uint64_t(ftell(f)) / sizeof(CountPair) : 0;
+
+            // count --> first position of its n-grams, highest count first
+            map<uint32_t, uint64_t> first;
+            for (uint64_t j = 0; j < size; j += pairs.size()) {
+                size_t n = read_pairs(f, j, size, pairs);
+                for (size_t k = 0; k < n; ++k)
+                    ++first[pairs[k].m_count];
+            }
+            uint64_t next = 0;
+            for (map<uint32_t, uint64_t>::reverse_iterator it = first.rbegin();
+                    it != first.rend(); ++it) {
+                uint64_t n = it->second;
+                it->second = next;
+                next += n;
+            }
+
+            size_t block = mem_budget().available() / 2 / sizeof(CountTable::Entry);
+            block = max(block, s_pair_block);
+            for (uint64_t lo = 0; ok && lo < size; lo += block) {
+                uint64_t hi = min(size, lo + block);
+                entries.resize(size_t(hi - lo));
+                mem_budget().set("count table block",
+                        entries.capacity() * sizeof(CountTable::Entry));
+
+                map<uint32_t, uint64_t> at(first);
+                for (uint64_t j = 0; j < size; j += pairs.size()) {
+                    size_t n = read_pairs(f, j, size, pairs);
+                    for (size_t k = 0; k < n; ++k) {
+                        uint64_t p = at[pairs[k].m_count]++;
+                        if (p < lo || p >= hi)
+                            continue;
+                        CountTable::Entry& e = entries[size_t(p - lo)];
+                        e.m_offset = pairs[k].m_offset;
+                        e.m_count  = pairs[k].m_count;
+                        e.m_rank   = pairs[k].m_rank;
+                    }
+                }
+                ok = fwrite(&entries[0], sizeof(CountTable::Entry),
+                        entries.size(), out) == entries.size();
+            }
+            vector<CountTable::Entry>().swap(entries);
+            mem_budget().set("count table block", 0);
+
+            if (f) {
+                fclose(f);
+                m_temp[i] = 0;
+            }
+            starts[i] = pos;
+            sizes[i]  = size;
+            pos += size * sizeof(CountTable::Entry);
+        }
+    } catch (...) {
+        mem_budget().set("count table block", 0);
+        fclose(out);
+        remove(tmp.c_str());
+        throw;
+    }
+
+    ok = ok && fseek(out, 0, SEEK_SET) == 0 &&
+        fwrite(&header, sizeof(header), 1, out) == 1 &&
+        fwrite(&starts[0], sizeof(uint64_t), lengths, out) == lengths &&
+        fwrite(&sizes[0], sizeof(uint64_t), lengths, out) == lengths;
+    if (fclose(out) != 0 || !ok) {
+        remove(tmp.c_str());
+        throw runtime_error("fail to write count table file");
+    }
+
+    if (rename(tmp.c_str(), m_file.c_str()) != 0) {
+        perror(m_file.c_str());
+        throw runtime_error("unable to replace count table file");
+    }
+}
+
+// read the pairs [first, min(size, first + pairs.size())) of f into pairs
+size_t CountTableWriter::read_pairs(FILE* f, uint64_t first, uint64_t size,
+        vector<CountPair>& pairs) {
+    size_t n = size_t(min(uint64_t(pairs.size()), size - first));
+    if (first == 0)
+        rewind(f);
+    if (fread(&pairs[0], sizeof(CountPair), n, f) != n)
+        throw runtime_error("fail to read temporary file for n-gram counts");
+    return n;
+}
+
+CountTable::CountTable():m_file(0), m_N(0), m_M(0) {
+    memset(&m_stamp, 0, sizeof(m_stamp));
+}
+
+CountTable::~CountTable() {
+    close();
+}
+
+void CountTable::close() {
+    if (m_file) {
+        fclose(m_file);
+        m_file = 0;
+    }
+    m_N = m_M = 0;
+    m_starts.clear();
+    m_sizes.clear();
+}
+
+bool CountTable::open(const string& file) {
+    close();
+    FILE* f = fopen(file.c_str(), "rb");
+    if (!f)
+        return false;
+
+    FileHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+            memcmp(header.magic, s_magic, sizeof(s_magic)) != 0) {
+        fclose(f);
+        throw runtime_error("not a count table file");
+    }
+    if (header.version != s_version || header.byte_order != s_byte_order) {
+        fclose(f);
+        throw runtime_error("count table file of unsupported version or byte order");
+    }
+
+    size_t lengths = header.max_n - header.min_n + 1;
+    if (header.min_n < 1 || header.min_n > header.max_n || header.max_n > 255) {
+        fclose(f);
+        throw runtime_error("corrupted count table file");
+    }
+    m_starts.resize(lengths);
+    m_sizes.resize(lengths);
+    if (fread(&m_starts[0], sizeof(uint64_t), lengths, f) != lengths ||
+            fread(&m_sizes[0], sizeof(uint64_t), lengths, f) != lengths) {
+        fclose(f);
+        throw runtime_error("truncated count table file");
+    }
+
+    m_file = f;
+    m_N = header.min_n;
+    m_M = header.max_n;
+    m_stamp = header.stamp;
+    return true;
+}
+
+void CountTable::seek(unsigned n, uint64_t i) {
+    assert(m_file && n >= m_N && n <= m_M);
+    if (fseek(m_file, long(m_starts[n - m_N] + i * sizeof(Entry)), SEEK_SET) != 0)
+        throw runtime_error("fail to seek in count table file");
+}
+
+// the counts decrease, binary search for the first one below freq
+uint64_t CountTable::frequent(unsigned n, unsigned freq) {
+    uint64_t lo = 0;
+    uint64_t hi = size(n);
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        Entry e;
+        seek(n, mid);
+        if (fread(&e, sizeof(e), 1, m_file) != 1)
+            throw runtime_error("truncated count table file");
+        if (e.m_count >= freq)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void CountTable::read(unsigned n, uint64_t first, size_t count,
+        vector<Entry>& out) {
+    out.resize(count);
+    if (count == 0)
+        return;
+    seek(n, first);
+    if (fread(&out[0], sizeof(Entry), count, m_file) != count)
+        throw runtime_error("truncated count table file");
+}
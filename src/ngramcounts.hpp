@@ -0,0 +1,171 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramcounts.hpp  -  materialized n-gram count tables of an index
+ *
+ * Scanning the ptable and ltable of a large index takes long, and running
+ * extractngram again with another -f or N means doing it again. A count
+ * table file <base>.counts keeps, for each n of the range it was built
+ * for, every distinct n-gram of the index as its text offset in .ngram,
+ * its count and its rank in the order of the scan which found them (in
+ * symbol order within each n). The entries of each n are sorted by
+ * decreasing count, so the n-grams with count >= freq are a prefix
+ * found by binary search, and only those are read and fetched from the
+ * text. The file records the sizes and modification times of the .ptable
+ * and .ngram it was built from, and is only used with exactly these.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef NGRAMCOUNTS_H
+#define NGRAMCOUNTS_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+
+// identifies the files of an index, which a rebuild or append changes
+struct IndexStamp {
+    boost::uint64_t m_ptable_size;
+    boost::uint64_t m_ptable_mtime; // in nanoseconds
+    boost::uint64_t m_ngram_size;
+    boost::uint64_t m_ngram_mtime;
+
+    bool operator==(const IndexStamp& s) const {
+        return m_ptable_size == s.m_ptable_size &&
+            m_ptable_mtime == s.m_ptable_mtime &&
+            m_ngram_size == s.m_ngram_size &&
+            m_ngram_mtime == s.m_ngram_mtime;
+    }
+};
+
+/**
+ * stamp of the index at file name base
+ * throws runtime_error if its .ptable or .ngram can not be stat()ed
+ */
+IndexStamp index_stamp(const std::string& base);
+
+/**
+ * builds a count table file from the n-grams of an index coming in symbol
+ * order for each n (lengths may interleave, as in an extract_ngram() scan),
+ * their ranks record the order they came in
+ */
+class CountTableWriter : boost::noncopyable {
+    public:
+        // count N to M-grams of the index of stamp into file, written by finish()
+        CountTableWriter(const std::string& file, unsigned N, unsigned M,
+                const IndexStamp& stamp);
+        ~CountTableWriter();
+
+        /**
+         * add the next n-gram of length n, found at offset of the text
+         * throws runtime_error on temporary file errors
+         */
+        void add(unsigned n, unsigned offset, unsigned count);
+
+        /**
+         * sort the n-grams of each length by count and write the file.
+         * The n-grams are placed by a counting sort, in blocks as large as
+         * mem_budget() allows, each block taking one pass over the n-grams
+         * throws runtime_error on io errors
+         */
+        void finish();
+
+    private:
+        struct CountPair;
+
+        static size_t read_pairs(FILE* f, boost::uint64_t first,
+                boost::uint64_t size, std::vector<CountPair>& pairs);
+
+        std::string        m_file;
+        unsigned           m_N;
+        unsigned           m_M;
+        IndexStamp         m_stamp;
+        std::vector<FILE*> m_temp; // n - N --> its (offset, count, rank)
+        boost::uint64_t    m_added;
+};
+
+/**
+ * reads the count table file written by CountTableWriter
+ */
+class CountTable : boost::noncopyable {
+    public:
+        struct Entry {
+            boost::uint32_t m_offset; // of the n-gram in .ngram
+            boost::uint32_t m_count;
+            boost::uint64_t m_rank;   // in the scan of all N to M-grams
+        };
+
+        CountTable();
+        ~CountTable();
+
+        /**
+         * open a count table file, return false if there is none
+         * throws runtime_error if it is not a count table of this
+         * platform's byte order
+         */
+        bool open(const std::string& file);
+
+        void close();
+
+        unsigned min_n() const { return m_N; }
+        unsigned max_n() const { return m_M; }
+
+        // the index the table was built from
+        const IndexStamp& stamp() const { return m_stamp; }
+
+        // number of distinct n-grams of length n
+        boost::uint64_t size(unsigned n) const { return m_sizes[n - m_N]; }
+
+        /**
+         * number of n-grams of length n whose count >= freq, they are the
+         * first entries of n
+         */
+        boost::uint64_t frequent(unsigned n, unsigned freq);
+
+        /**
+         * read count entries of n starting at first into out
+         * throws runtime_error on io errors
+         */
+        void read(unsigned n, boost::uint64_t first, size_t count,
+                std::vector<Entry>& out);
+
+    private:
+        void seek(unsigned n, boost::uint64_t i);
+
+        FILE*                        m_file;
+        unsigned                     m_N;
+        unsigned                     m_M;
+        IndexStamp                   m_stamp;
+        std::vector<boost::uint64_t> m_starts; // n - N --> file offset of its entries
+        std::vector<boost::uint64_t> m_sizes;  // n - N --> number of entries
+};
+
+#endif /* ifndef NGRAMCOUNTS_H */
@@ -0,0 +1,198 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramhash.hpp  -  count short n-grams in hash tables
+ *
+ * For small M there is no need to sort every suffix of the text: each
+ * n-gram of up to M symbols is packed into a 64 bit key (symbol_bits bits
+ * per symbol, the first symbol highest) and counted in open addressing
+ * tables. The tables are partitioned by hash, and a partition whose table
+ * would outgrow the memory given is written out to a temporary file and
+ * started afresh. Since symbols are never 0, a key tells its own length,
+ * and ordering keys as integers orders n-grams by length and then by
+ * symbols, which is the order the n-grams are put out in.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef NGRAMHASH_H
+#define NGRAMHASH_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
+
+using std::basic_string;
+using std::string;
+using std::vector;
+
+// whether M-grams of symbols up to symbol_bits bits wide fit into a key
+inline bool hash_key_fits(unsigned M, unsigned symbol_bits) {
+    return M * symbol_bits <= 64;
+}
+
+template <typename CharT, typename Traits = std::char_traits<CharT> >
+class NGramHash : boost::noncopyable {
+    public:
+        typedef basic_string<CharT, Traits> string_type;
+        typedef boost::function<void(const string_type& ngram,
+                unsigned count)> OutputFunc;
+
+        /**
+         * count N to M-grams of symbols up to symbol_bits bits wide
+         * (hash_key_fits() must hold) in at most memory KB of tables
+         */
+        NGramHash(unsigned N, unsigned M, unsigned symbol_bits,
+                unsigned memory);
+        ~NGramHash();
+
+        // comma separated directories to take in turn for temporary files
+        void set_temp_dir(const string& dirs);
+
+        /**
+         * put out only the k most frequent n-grams of each length (0: all),
+         * by length and each length by decreasing count (equal counts in
+         * symbol order). They are chosen on the packed keys, in a min-heap
+         * of k entries per length
+         */
+        void set_top(unsigned k) { m_top = k; }
+
+        // what parse_files() expects of NGramStat
+        const string& budget_name() const { return m_budget_name; }
+        void set_input_position(unsigned, boost::uint64_t) {}
+
+        void parse_begin();
+
+        // count the n-grams ending in buf, buf goes on the text before
+        void parse_buf(const string_type& buf);
+
+        /**
+         * output the n-grams whose count >= freq, by length and each
+         * length in symbol order
+         * throws runtime_error on temporary file errors
+         */
+        void parse_end(unsigned freq, OutputFunc& output);
+
+    private:
+        struct Entry {
+            boost::uint64_t m_key;    // 0: empty slot
+            unsigned        m_count;
+        };
+
+        struct KeyLess {
+            bool operator()(const Entry& a, const Entry& b) const {
+                return a.m_key < b.m_key;
+            }
+        };
+
+        // ranks the kept n-grams, the worst one is at the top of the heap
+        struct MoreFrequent {
+            bool operator()(const Entry& a, const Entry& b) const {
+                return a.m_count > b.m_count ||
+                    (a.m_count == b.m_count && a.m_key < b.m_key);
+            }
+        };
+
+        struct Partition {
+            Partition():m_used(0), m_spill(0) {}
+
+            vector<Entry> m_slots;
+            size_t        m_used;
+            string        m_name;   // temporary file of its spilled entries
+            FILE*         m_spill;
+        };
+
+        // an n-gram whose slot is being prefetched
+        struct Pending {
+            boost::uint64_t m_key;    // 0: none
+            boost::uint64_t m_hash;
+        };
+
+        // sorted entries of a partition waiting to be put out
+        struct SortedRun {
+            FILE*  m_file;
+            Entry  m_entry;
+        };
+
+        static const unsigned s_partition_bits = 6;
+        static const size_t   s_initial_slots  = 1024;
+        static const unsigned s_prefetch       = 16; // n-grams in flight
+
+        static boost::uint64_t mix(boost::uint64_t key) {
+            key *= 0x9e3779b97f4a7c15ULL;
+            return key ^ (key >> 29);
+        }
+
+        Partition& partition(boost::uint64_t h) {
+            return m_parts[h >> (64 - s_partition_bits)];
+        }
+
+        void add(boost::uint64_t key);
+        void count(boost::uint64_t key, boost::uint64_t h);
+        void flush_pending();
+        void grow(Partition& p);
+        void spill(Partition& p);
+        void reload(Partition& p);
+        void collect(Partition& p, unsigned freq, vector<Entry>& out);
+        void release(Partition& p);
+        unsigned length(boost::uint64_t key) const;
+        void output(const Entry& e, OutputFunc& output);
+        void keep(const Entry& e, OutputFunc& output);
+        void output_top(OutputFunc& output);
+        void write_entries(FILE* f, const Entry* e, size_t n, const string& name);
+        bool read_entry(FILE* f, Entry& e, const string& name);
+        void charge();
+        string next_temp_name();
+
+        static void insert(vector<Entry>& slots, const Entry& e);
+
+        unsigned                m_N;
+        unsigned                m_M;
+        unsigned                m_bits;
+        size_t                  m_max_slots; // all tables together
+        size_t                  m_slots;     // allocated now
+        bool                    m_limited;   // by m_max_slots, while counting
+        bool                    m_spilled;
+        unsigned                m_top;
+        vector<vector<Entry> >  m_best;      // n --> heap of the top n-grams
+        vector<Partition>       m_parts;
+        vector<boost::uint64_t> m_window;    // n --> key of the n-gram ending here
+        unsigned                m_seen;      // symbols so far, up to M
+        Pending                 m_pending[s_prefetch];
+        unsigned                m_next_pending;
+        vector<string>          m_temp_dirs;
+        size_t                  m_next_temp_dir;
+        string                  m_budget_name;
+        string_type             m_ngram;
+};
+
+#include "ngramhash.tcc"
+#endif /* ifndef NGRAMHASH_H */
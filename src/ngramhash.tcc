@@ -0,0 +1,429 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramhash.tcc  -  count short n-grams in hash tables
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstdio>
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
+
+#include "tools.hpp"
+#include "membudget.hpp"
+
+using namespace std;
+
+template <typename CharT, typename Traits>
+NGramHash<CharT, Traits>::NGramHash(unsigned N, unsigned M,
+        unsigned symbol_bits, unsigned memory)
+:
+m_N(N),
+m_M(M),
+m_bits(symbol_bits),
+m_max_slots(size_t(memory) * 1024 / sizeof(Entry)),
+m_slots(0),
+m_limited(true),
+m_spilled(false),
+m_top(0),
+m_parts(size_t(1) << s_partition_bits),
+m_seen(0),
+m_next_pending(0),
+m_next_temp_dir(0)
+{
+    assert(N >= 1 && N <= M && hash_key_fits(M, symbol_bits));
+    m_max_slots = max(m_max_slots, m_parts.size() * s_initial_slots * 2);
+}
+
+template <typename CharT, typename Traits>
+NGramHash<CharT, Traits>::~NGramHash() {
+    for (size_t i = 0; i < m_parts.size(); ++i) {
+        if (m_parts[i].m_spill) {
+            fclose(m_parts[i].m_spill);
+            remove(m_parts[i].m_name.c_str());
+        }
+    }
+    mem_budget().set("hash tables", 0);
+}
+
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::set_temp_dir(const string& dirs) {
+    split(dirs, m_temp_dirs, ",");
+    m_next_temp_dir = 0;
+}
+
+//return next temp file name, taking the temp dirs in turn
+template <typename CharT, typename Traits>
+string NGramHash<CharT, Traits>::next_temp_name() {
+    string name = next_temp_filename("NGramHash");
+    if (m_temp_dirs.empty())
+        return name;
+
+    const string& dir = m_temp_dirs[m_next_temp_dir];
+    m_next_temp_dir = (m_next_temp_dir + 1) % m_temp_dirs.size();
+    return dir + "/" + name;
+}
+
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::charge() {
+    mem_budget().set("hash tables", m_slots * sizeof(Entry));
+}
+
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::parse_begin() {
+    for (size_t i = 0; i < m_parts.size(); ++i) {
+        m_parts[i].m_slots.assign(s_initial_slots, Entry());
+        m_parts[i].m_used = 0;
+    }
+    m_slots = m_parts.size() * s_initial_slots;
+    charge();
+    m_window.assign(m_M + 1, 0);
+    m_seen = 0;
+    for (unsigned i = 0; i < s_prefetch; ++i)
+        m_pending[i].m_key = 0;
+    m_next_pending = 0;
+}
+
+/**
+ * Parse text in buf: every symbol ends one n-gram of each length, their
+ * keys are made from those of the n-grams ending one symbol before
+ */
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::parse_buf(const string_type& buf) {
+    for (size_t i = 0; i < buf.size(); ++i) {
+        boost::uint64_t s = buf[i];
+        unsigned top = m_seen < m_M ? m_seen + 1 : m_M;
+        for (unsigned n = top; n > 1; --n)
+            m_window[n] = (m_window[n - 1] << m_bits) | s;
+        m_window[1] = s;
+        m_seen = top;
+
+        for (unsigned n = m_N; n <= top; ++n)
+            add(m_window[n]);
+    }
+}
+
+/**
+ * count key once its slot is likely in the cache: the slot is prefetched
+ * now and the key counted s_prefetch n-grams later, so that the cache
+ * misses of that many n-grams overlap instead of stalling one by one
+ */
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::add(boost::uint64_t key) {
+    boost::uint64_t h = mix(key);
+#ifdef __GNUC__
+    Partition& p = partition(h);
+    __builtin_prefetch(&p.m_slots[h & (p.m_slots.size() - 1)], 1);
+#endif
+
+    Pending& slot = m_pending[m_next_pending];
+    if (slot.m_key != 0)
+        count(slot.m_key, slot.m_hash);
+    slot.m_key  = key;
+    slot.m_hash = h;
+    m_next_pending = (m_next_pending + 1) % s_prefetch;
+}
+
+// count the n-grams still waiting for their slots
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::flush_pending() {
+    for (unsigned i = 0; i < s_prefetch; ++i) {
+        Pending& slot = m_pending[(m_next_pending + i) % s_prefetch];
+        if (slot.m_key != 0)
+            count(slot.m_key, slot.m_hash);
+        slot.m_key = 0;
+    }
+}
+
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::count(boost::uint64_t key, boost::uint64_t h) {
+    Partition& p = partition(h);
+    size_t mask = p.m_slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        Entry& e = p.m_slots[i];
+        if (e.m_key == key) {
+            ++e.m_count;
+            return;
+        }
+        if (e.m_key == 0) {
+            e.m_key   = key;
+            e.m_count = 1;
+            if (++p.m_used * 10 > p.m_slots.size() * 7)
+                grow(p);
+            return;
+        }
+    }
+}
+
+// put e into slots, where its key is not yet
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::insert(vector<Entry>& slots, const Entry& e) {
+    size_t mask = slots.size() - 1;
+    size_t i = mix(e.m_key) & mask;
+    while (slots[i].m_key != 0)
+        i = (i + 1) & mask;
+    slots[i] = e;
+}
+
+/**
+ * double the table of p, or write it out if that would take more memory
+ * than given. Once counting is over there is no limit, a partition has to
+ * fit in memory on its own
+ */
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::grow(Partition& p) {
+    size_t n = p.m_slots.size();
+    if (m_limited && m_slots + n > m_max_slots) {
+        spill(p);
+        return;
+    }
+
+    vector<Entry> slots(n * 2, Entry());
+    for (size_t i = 0; i < n; ++i) {
+        if (p.m_slots[i].m_key != 0)
+            insert(slots, p.m_slots[i]);
+    }
+    p.m_slots.swap(slots);
+    m_slots += n;
+    charge();
+}
+
+// append the entries of p to its temporary file and empty its table
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::spill(Partition& p) {
+    if (!p.m_spill) {
+        p.m_name  = next_temp_name();
+        p.m_spill = fopen(p.m_name.c_str(), "w+b");
+        if (!p.m_spill)
+            throw runtime_error("unable to open temporary file for n-gram counts");
+    }
+
+    for (size_t i = 0; i < p.m_slots.size(); ++i) {
+        if (p.m_slots[i].m_key != 0)
+            write_entries(p.m_spill, &p.m_slots[i], 1, p.m_name);
+    }
+    fill(p.m_slots.begin(), p.m_slots.end(), Entry());
+    p.m_used  = 0;
+    m_spilled = true;
+}
+
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::write_entries(FILE* f, const Entry* e,
+        size_t n, const string& name) {
+    for (size_t i = 0; i < n; ++i) {
+        if (fwrite(&e[i].m_key, sizeof(e[i].m_key), 1, f) != 1 ||
+                fwrite(&e[i].m_count, sizeof(e[i].m_count), 1, f) != 1) {
+            perror(name.c_str());
+            throw runtime_error("fail to write temporary file for n-gram counts");
+        }
+    }
+}
+
+template <typename CharT, typename Traits>
+bool NGramHash<CharT, Traits>::read_entry(FILE* f, Entry& e,
+        const string& name) {
+    if (fread(&e.m_key, sizeof(e.m_key), 1, f) != 1)
+        return false;
+    if (fread(&e.m_count, sizeof(e.m_count), 1, f) != 1) {
+        perror(name.c_str());
+        throw runtime_error("fail to read temporary file for n-gram counts");
+    }
+    return true;
+}
+
+// count the entries spilled of p into its table again
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::reload(Partition& p) {
+    p.m_slots.assign(s_initial_slots, Entry());
+    m_slots += s_initial_slots;
+    rewind(p.m_spill);
+
+    Entry e;
+    while (read_entry(p.m_spill, e, p.m_name)) {
+        size_t mask = p.m_slots.size() - 1;
+        size_t i = mix(e.m_key) & mask;
+        while (p.m_slots[i].m_key != 0 && p.m_slots[i].m_key != e.m_key)
+            i = (i + 1) & mask;
+        if (p.m_slots[i].m_key != 0) {
+            p.m_slots[i].m_count += e.m_count;
+        } else {
+            p.m_slots[i] = e;
+            if (++p.m_used * 10 > p.m_slots.size() * 7)
+                grow(p);
+        }
+    }
+    if (ferror(p.m_spill))
+        throw runtime_error("fail to read temporary file for n-gram counts");
+}
+
+// append the entries of p with count >= freq to out
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::collect(Partition& p, unsigned freq,
+        vector<Entry>& out) {
+    for (size_t i = 0; i < p.m_slots.size(); ++i) {
+        if (p.m_slots[i].m_key != 0 && p.m_slots[i].m_count >= freq)
+            out.push_back(p.m_slots[i]);
+    }
+}
+
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::release(Partition& p) {
+    m_slots -= p.m_slots.size();
+    vector<Entry>().swap(p.m_slots);
+    p.m_used = 0;
+    charge();
+}
+
+// number of symbols packed into a key
+template <typename CharT, typename Traits>
+unsigned NGramHash<CharT, Traits>::length(boost::uint64_t key) const {
+    unsigned n = 1;
+    while (n < m_M && (key >> (n * m_bits)) != 0)
+        ++n;
+    return n;
+}
+
+// unpack the n-gram of a key and put it out
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::output(const Entry& e, OutputFunc& output) {
+    unsigned n = length(e.m_key);
+
+    boost::uint64_t mask = (boost::uint64_t(1) << m_bits) - 1;
+    m_ngram.resize(n);
+    for (unsigned i = 0; i < n; ++i)
+        m_ngram[n - 1 - i] = CharT((e.m_key >> (i * m_bits)) & mask);
+    output(m_ngram, e.m_count);
+}
+
+/**
+ * put out an n-gram, or with set_top() offer it to the heap of its length.
+ * Keys come in increasing order, so one only replaces the worst if it is
+ * more frequent
+ */
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::keep(const Entry& e, OutputFunc& output) {
+    if (!m_top) {
+        this->output(e, output);
+        return;
+    }
+
+    if (m_best.empty())
+        m_best.resize(m_M + 1);
+    vector<Entry>& best = m_best[length(e.m_key)];
+    MoreFrequent more;
+    if (best.size() < m_top) {
+        best.push_back(e);
+    } else if (e.m_count > best.front().m_count) {
+        pop_heap(best.begin(), best.end(), more);
+        best.back() = e;
+    } else {
+        return;
+    }
+    push_heap(best.begin(), best.end(), more);
+}
+
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::output_top(OutputFunc& output) {
+    for (size_t n = 0; n < m_best.size(); ++n) {
+        sort_heap(m_best[n].begin(), m_best[n].end(), MoreFrequent());
+        for (size_t i = 0; i < m_best[n].size(); ++i)
+            this->output(m_best[n][i], output);
+    }
+    vector<vector<Entry> >().swap(m_best);
+}
+
+/**
+ * Without spilling all counts are in memory, and the n-grams kept are
+ * sorted at once. Else the tables are written out and each partition in
+ * turn is counted again from its file, which then takes its sorted
+ * n-grams to be merged with those of the others
+ */
+template <typename CharT, typename Traits>
+void NGramHash<CharT, Traits>::parse_end(unsigned freq, OutputFunc& output) {
+    flush_pending();
+    m_limited = false;
+    KeyLess less;
+
+    if (!m_spilled) {
+        vector<Entry> kept;
+        for (size_t i = 0; i < m_parts.size(); ++i) {
+            collect(m_parts[i], freq, kept);
+            release(m_parts[i]);
+        }
+        mem_budget().set("hash counts", kept.capacity() * sizeof(Entry));
+        sort(kept.begin(), kept.end(), less);
+        for (size_t i = 0; i < kept.size(); ++i)
+            keep(kept[i], output);
+        mem_budget().set("hash counts", 0);
+        output_top(output);
+        return;
+    }
+
+    cerr << "Merging spilled n-gram counts..." << endl;
+    for (size_t i = 0; i < m_parts.size(); ++i) {
+        if (m_parts[i].m_used > 0)
+            spill(m_parts[i]);
+        release(m_parts[i]);
+    }
+
+    vector<SortedRun> runs;
+    for (size_t i = 0; i < m_parts.size(); ++i) {
+        Partition& p = m_parts[i];
+        if (!p.m_spill)
+            continue;
+
+        vector<Entry> kept;
+        reload(p);
+        collect(p, freq, kept);
+        release(p);
+        sort(kept.begin(), kept.end(), less);
+
+        if (!freopen(p.m_name.c_str(), "w+b", p.m_spill)) {
+            p.m_spill = 0;
+            throw runtime_error("unable to reopen temporary file for n-gram counts");
+        }
+        write_entries(p.m_spill, kept.empty() ? 0 : &kept[0], kept.size(), p.m_name);
+        rewind(p.m_spill);
+
+        SortedRun run;
+        run.m_file = p.m_spill;
+        if (read_entry(run.m_file, run.m_entry, p.m_name))
+            runs.push_back(run);
+    }
+
+    // few runs, the smallest key is looked for among them all
+    while (!runs.empty()) {
+        size_t min = 0;
+        for (size_t i = 1; i < runs.size(); ++i) {
+            if (runs[i].m_entry.m_key < runs[min].m_entry.m_key)
+                min = i;
+        }
+        keep(runs[min].m_entry, output);
+        if (!read_entry(runs[min].m_file, runs[min].m_entry, "n-gram counts"))
+            runs.erase(runs.begin() + min);
+    }
+    output_top(output);
+}
@@ -0,0 +1,144 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramheader.cpp  -  description of an ngram index kept in <base>.header
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fstream>
+#include <stdexcept>
+#include "ngramheader.hpp"
+
+using namespace std;
+
+static const char* s_header_magic   = "ngramtool-index";
+static const unsigned s_header_version = 1;
+
+unsigned symbol_width(size_t count) {
+    if (count <= 0x100)
+        return 1;
+    else if (count <= 0x10000)
+        return 2;
+    return 4;
+}
+
+unsigned symbol_bits(size_t count) {
+    unsigned bits = 1;
+    while (bits < 64 && (count - 1) >> bits)
+        ++bits;
+    return bits;
+}
+
+void NGramHeader::save(const string& file) const {
+    ofstream o(file.c_str());
+    if (!o)
+        throw runtime_error("unable to open ngram header file to write");
+
+    o << s_header_magic << ' ' << s_header_version << endl;
+    write(o);
+
+    if (!o)
+        throw runtime_error("fail to write ngram header file");
+}
+
+void NGramHeader::write(ostream& o) const {
+    o << "mode " << (m_mode == CHAR_MODE ? "char" : "word") << endl;
+    o << "width " << m_width << endl;
+    if (m_ptable_bits)
+        o << "ptable-bits " << m_ptable_bits << endl;
+    if (m_compressed_text)
+        o << "text varbyte" << endl;
+    if (m_mode == CHAR_MODE) {
+        o << "alphabet " << m_alphabet.size() << endl;
+        for (size_t i = 0; i < m_alphabet.size(); ++i)
+            o << m_alphabet[i] << endl;
+    }
+}
+
+bool NGramHeader::load(const string& file) {
+    ifstream f(file.c_str());
+    if (!f)
+        return false;
+
+    string key;
+    unsigned version = 0;
+    if (!(f >> key >> version) || key != s_header_magic)
+        throw runtime_error("not a ngram header file");
+    if (version > s_header_version)
+        throw runtime_error("ngram header file of unsupported version");
+
+    m_alphabet.clear();
+    m_ptable_bits = 0;
+    m_compressed_text = false;
+    while (f >> key) {
+        if (!read_entry(key, f))
+            throw runtime_error("unknown entry in ngram header file");
+        if (!f)
+            throw runtime_error("corrupted ngram header file");
+    }
+
+    if (m_width != 1 && m_width != 2 && m_width != 4)
+        throw runtime_error("unsupported symbol width in ngram header file");
+    if (m_ptable_bits > 32)
+        throw runtime_error("unsupported ptable width in ngram header file");
+    return true;
+}
+
+bool NGramHeader::read_entry(const string& key, istream& f) {
+    if (key == "mode") {
+        string mode;
+        f >> mode;
+        if (mode == "char")
+            m_mode = CHAR_MODE;
+        else if (mode == "word")
+            m_mode = WORD_MODE;
+        else
+            throw runtime_error("unknown mode in ngram header file");
+    } else if (key == "width") {
+        f >> m_width;
+    } else if (key == "ptable-bits") {
+        f >> m_ptable_bits;
+    } else if (key == "text") {
+        string text;
+        f >> text;
+        if (text == "varbyte")
+            m_compressed_text = true;
+        else if (text != "raw")
+            throw runtime_error("unknown text encoding in ngram header file");
+    } else if (key == "alphabet") {
+        size_t n = 0;
+        f >> n;
+        m_alphabet.resize(n);
+        for (size_t i = 0; i < n && f; ++i)
+            f >> m_alphabet[i];
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,141 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramheader.hpp  -  description of an ngram index kept in <base>.header
+ *
+ * text2ngram stores each symbol of the .ngram table in as few bytes as the
+ * vocabulary (word mode) or the alphabet (char mode) allows: 1, 2 or 4.
+ * Char mode symbols are remapped densely and in code point order, so the
+ * sort order of the table is unchanged. The header records the width and
+ * the alphabet so extractngram can read the table back. Indexes without a
+ * header are the older fixed width ones (sizeof(word_id) or uchar_t).
+ * It also records the width of the bit packed .ptable entries.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef NGRAMHEADER_H
+#define NGRAMHEADER_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+
+#include "unicode.hpp"
+
+struct NGramHeader {
+    enum Mode { WORD_MODE, CHAR_MODE };
+
+    NGramHeader(Mode mode = WORD_MODE, unsigned width = 0)
+        :m_mode(mode), m_width(width), m_ptable_bits(0),
+        m_compressed_text(false) {}
+
+    /**
+     * write the header to file
+     * throws runtime_error if the file can not be written
+     */
+    void save(const std::string& file) const;
+
+    /**
+     * read a header written by save()
+     * return false if the file does not exist, throws runtime_error if it
+     * is not a valid header
+     */
+    bool load(const std::string& file);
+
+    // write the entries (all but the magic line) to o
+    void write(std::ostream& o) const;
+
+    /**
+     * read the value of the entry key from f
+     * return false if key is not a header entry
+     */
+    bool read_entry(const std::string& key, std::istream& f);
+
+    Mode                 m_mode;
+    unsigned             m_width;    // bytes per symbol in .ngram
+    std::vector<uchar_t> m_alphabet; // char mode: symbol i + 1 is m_alphabet[i]
+    unsigned             m_ptable_bits; // width of packed .ptable entries, 0 if unpacked
+    bool                 m_compressed_text; // .ngram written by NGramText::compress()
+};
+
+/**
+ * smallest symbol width (1, 2 or 4 bytes) able to hold symbols [0, count)
+ */
+unsigned symbol_width(size_t count);
+
+// smallest number of bits able to hold symbols [0, count)
+unsigned symbol_bits(size_t count);
+
+// char_traits used for the symbols of each width
+template <typename SymT>
+struct symbol_traits {
+    typedef std::char_traits<SymT> type;
+};
+
+template <>
+struct symbol_traits<uchar_t> {
+    typedef std::uchar_traits type;
+};
+
+/**
+ * output function adaptor: widen an ngram of narrow symbols back into
+ * WideT (through table if given) and pass it on to the real output function
+ */
+template <typename SymT, typename WideT,
+         typename WideTraits = std::char_traits<WideT> >
+class WidenOutput {
+    public:
+        typedef std::basic_string<WideT, WideTraits> wide_string;
+        typedef boost::function<void(const wide_string& ngram,
+                unsigned count)> Func;
+
+        WidenOutput(const Func& f, const WideT* table = 0)
+            :m_func(f), m_table(table) {}
+
+        template <typename String>
+        void operator()(const String& s, unsigned count) {
+            m_buf.resize(s.size());
+            if (m_table) {
+                for (size_t i = 0; i < s.size(); ++i)
+                    m_buf[i] = m_table[s[i]];
+            } else {
+                for (size_t i = 0; i < s.size(); ++i)
+                    m_buf[i] = WideT(s[i]);
+            }
+            m_func(m_buf, count);
+        }
+
+    private:
+        Func         m_func;
+        const WideT* m_table;
+        wide_string  m_buf;
+};
+
+#endif /* ifndef NGRAMHEADER_H */
@@ -0,0 +1,118 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngrammerge.cpp  -  merge sorted n-gram count files
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "tools.hpp"
+#include "countstream.hpp"
+#include "ngrammerge_cmdline.h"
+
+using namespace std;
+
+int main(int argc,char* argv[]) {
+    gengetopt_args_info args_info;
+
+    /* let's call our cmdline parser */
+    if (cmdline_parser (argc, argv, &args_info) != 0)
+        return EXIT_FAILURE;
+
+    if (args_info.freq_arg < 1) {
+        cerr << "freq must be >= 1" << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (args_info.inputs_num == 0) {
+        cerr << "no count files to merge" << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<FILE*> files;
+    vector<CountReader*> readers;
+    FILE* out = stdout;
+    int rc = EXIT_SUCCESS;
+    try {
+        cerr << "start at: " << current_time();
+        for (unsigned i = 0; i < args_info.inputs_num; ++i) {
+            string name = args_info.inputs[i];
+            FILE* f = name == "-" ? stdin : fopen(name.c_str(), "rb");
+            if (!f)
+                throw runtime_error("unable to open count file " + name);
+            files.push_back(f);
+            readers.push_back(new CountReader(f, name, args_info.char_flag));
+        }
+
+        if (args_info.output_given && !(out = fopen(args_info.output_arg, "wb"))) {
+            out = stdout;
+            throw runtime_error(string("unable to open ") + args_info.output_arg);
+        }
+
+        CountMerger merger(readers);
+        CountWriter writer(out, args_info.binary_flag, args_info.char_flag);
+        boost::uint64_t ngrams = 0;
+        while (merger.next()) {
+            if (merger.count() >= unsigned(args_info.freq_arg)) {
+                writer.write(merger.ngram(), merger.length(), merger.count());
+                ++ngrams;
+            }
+        }
+        writer.flush();
+        cerr << ngrams << " n-grams written" << endl;
+    } catch (bad_alloc& e) {
+        cerr << "std::bad_alloc caught: out of memory" << endl;
+        rc = EXIT_FAILURE;
+    } catch (runtime_error& e) {
+        cerr << "runtime_error caught:" << e.what() << endl;
+        rc = EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < readers.size(); ++i)
+        delete readers[i];
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i] != stdin)
+            fclose(files[i]);
+    }
+    if (out != stdout && fclose(out) != 0 && rc == EXIT_SUCCESS) {
+        cerr << "fail to write " << args_info.output_arg << endl;
+        rc = EXIT_FAILURE;
+    }
+
+    if (rc == EXIT_SUCCESS)
+        cerr << "end at: " << current_time();
+    return rc;
+}
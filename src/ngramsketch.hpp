@@ -0,0 +1,141 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramsketch.hpp  -  approximate n-gram counts in fixed memory
+ *
+ * NGramSketch streams the text through a count-min sketch (with
+ * conservative update) and a HyperLogLog estimator per n-gram length.
+ * Once the sketch puts an n-gram at freq or above, its text is kept in a
+ * candidate table of fixed capacity, and these candidates are what is put
+ * out, with their sketch counts. A count is never too low, and with
+ * probability 1 - delta at most epsilon * (n-grams counted) too high.
+ * Memory depends on epsilon, delta, the candidate capacity and the
+ * HyperLogLog precision only, not on the corpus.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef NGRAMSKETCH_H
+#define NGRAMSKETCH_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
+
+#include "ngramwindow.hpp"
+
+using std::basic_string;
+using std::string;
+using std::vector;
+
+template <typename CharT, typename Traits = std::char_traits<CharT> >
+class NGramSketch : boost::noncopyable {
+    public:
+        typedef basic_string<CharT, Traits> string_type;
+        typedef boost::function<void(const string_type& ngram,
+                unsigned count)> OutputFunc;
+
+        /**
+         * count N to M-grams, reporting those estimated at >= freq.
+         * epsilon, delta: error bounds of the counts (0, 1)
+         * candidates: how many n-grams can be reported at most
+         * hll_bits: HyperLogLog precision, 2^hll_bits registers per length
+         */
+        NGramSketch(unsigned N, unsigned M, unsigned freq, double epsilon,
+                double delta, unsigned candidates, unsigned hll_bits);
+        ~NGramSketch();
+
+        // what parse_files() expects of NGramStat
+        const string& budget_name() const { return m_budget_name; }
+        void set_input_position(unsigned, boost::uint64_t) {}
+
+        void parse_begin();
+
+        // count the n-grams ending in buf, buf goes on the text before
+        void parse_buf(const string_type& buf);
+
+        /**
+         * output the candidates by length, each length in symbol order,
+         * and report the n-gram totals and distinct estimates on stderr
+         */
+        void parse_end(OutputFunc& output);
+
+        // estimated number of distinct n-grams of length n
+        double distinct(unsigned n) const;
+
+    private:
+        struct Candidate {
+            boost::uint64_t m_hash;
+            unsigned        m_text;  // offset in m_texts
+            unsigned        m_n;
+        };
+
+        struct CandidateLess {
+            CandidateLess(const CharT* texts):m_texts(texts) {}
+            bool operator()(const Candidate& a, const Candidate& b) const {
+                if (a.m_n != b.m_n)
+                    return a.m_n < b.m_n;
+                return Traits::compare(m_texts + a.m_text,
+                        m_texts + b.m_text, a.m_n) < 0;
+            }
+            const CharT* m_texts;
+        };
+
+        void add(unsigned n, boost::uint64_t h);
+        unsigned estimate(unsigned n, boost::uint64_t h) const;
+        void add_candidate(unsigned n, boost::uint64_t h);
+
+        unsigned                m_N;
+        unsigned                m_M;
+        unsigned                m_freq;
+        size_t                  m_width;     // counters per sketch row
+        unsigned                m_depth;     // rows per sketch
+        unsigned                m_hll_bits;
+        double                  m_epsilon;
+        double                  m_delta;
+
+        // per length n - N: depth rows of width counters each
+        vector<vector<unsigned> >       m_sketches;
+        vector<vector<unsigned char> >  m_registers;   // HyperLogLog
+        vector<boost::uint64_t>         m_totals;      // n-grams counted
+
+        size_t                  m_capacity;
+        vector<Candidate>       m_candidates;
+        vector<unsigned>        m_slots;     // candidate index + 1, 0: empty
+        string_type             m_texts;
+        boost::uint64_t         m_missed;    // frequent, but no room left
+
+        NGramWindow<CharT>      m_window;    // the n-grams ending here
+        string                  m_budget_name;
+        mutable vector<size_t>  m_cells;     // of the n-gram being counted
+};
+
+#include "ngramsketch.tcc"
+#endif /* ifndef NGRAMSKETCH_H */
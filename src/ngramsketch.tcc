@@ -0,0 +1,217 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramsketch.tcc  -  approximate n-gram counts in fixed memory
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <iostream>
+
+#include "membudget.hpp"
+
+using namespace std;
+
+template <typename CharT, typename Traits>
+NGramSketch<CharT, Traits>::NGramSketch(unsigned N, unsigned M,
+        unsigned freq, double epsilon, double delta, unsigned candidates,
+        unsigned hll_bits)
+:
+m_N(N),
+m_M(M),
+m_freq(freq),
+m_width(size_t(ceil(exp(1.0) / epsilon))),
+m_depth(unsigned(ceil(log(1.0 / delta)))),
+m_hll_bits(hll_bits),
+m_epsilon(epsilon),
+m_delta(delta),
+m_capacity(candidates),
+m_missed(0),
+m_window(M)
+{
+    assert(N >= 1 && N <= M && epsilon > 0 && delta > 0 && delta < 1);
+    m_depth = max(m_depth, 1u);
+}
+
+template <typename CharT, typename Traits>
+NGramSketch<CharT, Traits>::~NGramSketch() {
+    mem_budget().set("count-min sketches", 0);
+    mem_budget().set("hyperloglog registers", 0);
+    mem_budget().set("sketch candidates", 0);
+}
+
+template <typename CharT, typename Traits>
+void NGramSketch<CharT, Traits>::parse_begin() {
+    unsigned lengths = m_M - m_N + 1;
+    m_sketches.assign(lengths, vector<unsigned>(m_width * m_depth, 0));
+    m_registers.assign(lengths, vector<unsigned char>(size_t(1) << m_hll_bits, 0));
+    m_totals.assign(lengths, 0);
+    mem_budget().set("count-min sketches",
+            lengths * m_width * m_depth * sizeof(unsigned));
+    mem_budget().set("hyperloglog registers", lengths << m_hll_bits);
+
+    size_t slots = 1;
+    while (slots < m_capacity * 2)
+        slots *= 2;
+    m_candidates.clear();
+    m_candidates.reserve(m_capacity);
+    m_slots.assign(slots, 0);
+    m_texts.clear();
+    m_texts.reserve(m_capacity * m_M);
+    mem_budget().set("sketch candidates", m_capacity * sizeof(Candidate) +
+            slots * sizeof(unsigned) + m_capacity * m_M * sizeof(CharT));
+
+    m_window.clear();
+    m_missed = 0;
+    m_cells.resize(m_depth);
+}
+
+// Parse text in buf: every symbol ends one n-gram of each length
+template <typename CharT, typename Traits>
+void NGramSketch<CharT, Traits>::parse_buf(const string_type& buf) {
+    for (size_t i = 0; i < buf.size(); ++i) {
+        m_window.push(buf[i]);
+        for (unsigned n = m_N; n <= m_window.size(); ++n)
+            add(n, m_window.hash(n));
+    }
+}
+
+/**
+ * count n-gram of length n and hash h: conservative update raises only
+ * the counters at the minimum, which keeps the overestimates down
+ */
+template <typename CharT, typename Traits>
+void NGramSketch<CharT, Traits>::add(unsigned n, boost::uint64_t h) {
+    unsigned k = n - m_N;
+    ++m_totals[k];
+
+    // HyperLogLog: register from the top bits, rank of the rest
+    boost::uint64_t rest = h << m_hll_bits;
+    unsigned char rank = 1;
+    while (rank <= 64 - m_hll_bits && !(rest >> 63)) {
+        ++rank;
+        rest <<= 1;
+    }
+    unsigned char& reg = m_registers[k][h >> (64 - m_hll_bits)];
+    if (rank > reg)
+        reg = rank;
+
+    vector<unsigned>& sketch = m_sketches[k];
+    unsigned count = estimate(n, h) + 1;
+    for (unsigned d = 0; d < m_depth; ++d) {
+        if (sketch[m_cells[d]] < count)
+            sketch[m_cells[d]] = count;
+    }
+
+    if (count >= m_freq)
+        add_candidate(n, h);
+}
+
+// sketch count of n-gram of length n and hash h, its cells into m_cells
+template <typename CharT, typename Traits>
+unsigned NGramSketch<CharT, Traits>::estimate(unsigned n,
+        boost::uint64_t h) const {
+    const vector<unsigned>& sketch = m_sketches[n - m_N];
+    // the rows' hashes are h1 + d * h2 (Kirsch and Mitzenmacher)
+    boost::uint64_t h1 = h & 0xffffffffu;
+    boost::uint64_t h2 = (h >> 32) | 1;
+    unsigned count = ~0u;
+    for (unsigned d = 0; d < m_depth; ++d) {
+        m_cells[d] = d * m_width + size_t((h1 + d * h2) % m_width);
+        count = min(count, sketch[m_cells[d]]);
+    }
+    return count;
+}
+
+// keep the text of n-gram of length n and hash h, which ends here
+template <typename CharT, typename Traits>
+void NGramSketch<CharT, Traits>::add_candidate(unsigned n, boost::uint64_t h) {
+    size_t mask = m_slots.size() - 1;
+    size_t i = h & mask;
+    for (; m_slots[i] != 0; i = (i + 1) & mask) {
+        const Candidate& c = m_candidates[m_slots[i] - 1];
+        if (c.m_hash == h && c.m_n == n)
+            return;
+    }
+
+    if (m_candidates.size() == m_capacity) {
+        ++m_missed;
+        return;
+    }
+
+    Candidate c;
+    c.m_hash = h;
+    c.m_text = unsigned(m_texts.size());
+    c.m_n    = n;
+    m_texts.resize(m_texts.size() + n);
+    m_window.copy(n, &m_texts[c.m_text]);
+    m_candidates.push_back(c);
+    m_slots[i] = unsigned(m_candidates.size());
+}
+
+template <typename CharT, typename Traits>
+double NGramSketch<CharT, Traits>::distinct(unsigned n) const {
+    const vector<unsigned char>& regs = m_registers[n - m_N];
+    double m = double(regs.size());
+    double sum = 0;
+    size_t zeros = 0;
+    for (size_t j = 0; j < regs.size(); ++j) {
+        sum += ldexp(1.0, -int(regs[j]));
+        if (regs[j] == 0)
+            ++zeros;
+    }
+
+    double alpha = m >= 128 ? 0.7213 / (1 + 1.079 / m) :
+        (m >= 64 ? 0.709 : (m >= 32 ? 0.697 : 0.673));
+    double e = alpha * m * m / sum;
+    if (e <= 2.5 * m && zeros > 0)
+        e = m * log(m / zeros);   // linear counting for small sets
+    return e;
+}
+
+template <typename CharT, typename Traits>
+void NGramSketch<CharT, Traits>::parse_end(OutputFunc& output) {
+    for (unsigned n = m_N; n <= m_M; ++n) {
+        boost::uint64_t total = m_totals[n - m_N];
+        cerr << n << "-grams: " << total << ", about "
+            << (unsigned long)(distinct(n) + 0.5) << " distinct, counts at most "
+            << (unsigned long)(ceil(m_epsilon * total)) << " too high with probability "
+            << 1 - m_delta << endl;
+    }
+    if (m_missed > 0)
+        cerr << "warning: all " << m_capacity << " candidates were taken, "
+            << "frequent n-grams were missed " << m_missed
+            << " times, raise --candidates or lower --epsilon" << endl;
+
+    sort(m_candidates.begin(), m_candidates.end(), CandidateLess(m_texts.data()));
+    string_type ngram;
+    for (size_t i = 0; i < m_candidates.size(); ++i) {
+        const Candidate& c = m_candidates[i];
+        ngram.assign(m_texts, c.m_text, c.m_n);
+        output(ngram, estimate(c.m_n, c.m_hash));
+    }
+}
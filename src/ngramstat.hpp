@@ -43,8 +43,14 @@
 #include <cwchar>
 #include <boost/utility.hpp>
 #include <boost/function.hpp>
+#include <boost/cstdint.hpp>
 
 #include "unicode.hpp"
+#include "hugepage.hpp"
+#include "membudget.hpp"
+#include "thread.hpp"
+#include "ngramtext.hpp"
+#include "ngramcounts.hpp"
 
 using std::basic_string;
 using std::char_traits;
@@ -66,6 +72,32 @@ class NGramStat : boost::noncopyable {
         typedef boost::function<void(const string_type& ngram, 
                 unsigned count)> OutputFunc;
 
+        // a sorted temporary ptable waiting to be merged
+        struct TempRun {
+            string   m_name;
+            unsigned m_bits;  // width of its packed entries
+            unsigned m_size;  // number of entries
+        };
+
+        // how far an index build has got on disk, see set_checkpoint()
+        struct ParseState {
+            enum Phase {
+                PARSING,  // the runs so far and the text before them
+                PARSED,   // all runs and the whole .ngram file
+                MERGED    // the final .ptable, only the .ltable is missing
+            };
+
+            Phase           m_phase;
+            vector<TempRun> m_runs;
+            unsigned        m_text_size;   // symbols of .ngram written
+            string_type     m_tail;        // parsed, but in no run yet
+            unsigned        m_input_file;  // where parsing goes on, as
+            boost::uint64_t m_input_pos;   // given to set_input_position()
+            unsigned        m_ptable_bits; // PARSED, MERGED
+            unsigned        m_ptable_size; // MERGED
+        };
+        typedef boost::function<void(const ParseState& state)> CheckpointFunc;
+
         NGramStat(unsigned memory, const string& file_name_base = "",
                 bool use_mmap = false);
         ~NGramStat();
@@ -75,26 +107,280 @@ class NGramStat : boost::noncopyable {
 //        void parse(const string& str, const string& encoding = "UTF-8");
         void parse_begin();
         void parse_end();
+        /**
+         * end parsing and extract N to M-grams right away. If the text was
+         * spilled to a temporary index (see auto_spill()), the n-grams are
+         * counted as the disk merge produces the sorted suffixes, and no
+         * final .ptable or .ltable is written
+         */
+        void parse_end(unsigned N, unsigned M, unsigned freq,
+                OutputFunc& output);
         void parse_buf(const string_type& buf);
 //        void parse(const string_type& str);
+
+        /**
+         * have f called whenever more of an index build is safely on disk:
+         * after each temporary run, once all text is parsed and once the
+         * final ptable is written. The state passed to f lets resume() go
+         * on from there in another process
+         */
+        void set_checkpoint(const CheckpointFunc& f) { m_checkpoint = f; }
+
+        /**
+         * where in its input the caller is, call it before parse_buf() so
+         * that a checkpoint knows where parsing has to go on
+         */
+        void set_input_position(unsigned file, boost::uint64_t pos) {
+            m_input_file = file;
+            m_input_pos  = pos;
+        }
+
+        /**
+         * go on with a build that was checkpointed as state. For PARSING
+         * it replaces parse_begin(), parse_buf() then goes on from the
+         * input position of the state. PARSED and MERGED builds are
+         * finished right away, in place of parse_begin() .. parse_end()
+         * Runs written after the checkpoint of state are removed
+         */
+        void resume(const ParseState& state);
+
+        /**
+         * add text to the existing index at the file name base instead of
+         * building a new one, bits is the width of its ptable entries.
+         * Parse the new text with parse_buf() between append_begin() and
+         * append_end(). It is indexed on its own, together with the last
+         * 255 symbols of the old text whose suffixes now run on into it,
+         * and then merged into the old ptable in one pass. Only the
+         * ltable entries at the seams are computed again. The old .ngram
+         * must be raw text of CharT symbols
+         */
+        void append_begin(unsigned bits);
+        void append_end();
+
+        /**
+         * make this in-memory NGramStat a shard of a sharded build: it
+         * parses part of the text into a temporary index of its own, for
+         * merge_shards() to merge. Shards parse side by side, so name is
+         * put before their items in the memory budget. Call it before
+         * parse_begin()
+         */
+        void set_shard(const string& name);
+
+        // prefix of the memory budget items of this NGramStat
+        const string& budget_name() const { return m_budget_name; }
+
+        /**
+         * build the index at the file name base from shards which parsed
+         * consecutive parts of the text, in place of parse_begin() ..
+         * parse_end(). Their texts are concatenated and their ptables
+         * merged in one pass, except for the suffixes in the last 255
+         * symbols of each shard, which run on into the next one now and
+         * are sorted again. Shard ltable entries are kept but at the seams
+         */
+        void merge_shards(const vector<NGramStat*>& shards);
         void extract_ngram(unsigned N,
                 unsigned M,
                 unsigned freq,
                 OutputFunc& output) ;
+
+        /**
+         * materialize the count tables of the N to M-grams of the index at
+         * the file name base into <base>.counts (see ngramcounts.hpp)
+         * throws runtime_error on io errors
+         */
+        void save_counts(unsigned N, unsigned M);
+
+        /**
+         * extract N to M-grams from <base>.counts instead of scanning the
+         * index. They come in the order of extract_ngram(), or by length
+         * and each length in symbol order, or as described for set_top().
+         * return false, having put out nothing, if there are no count
+         * tables of [N, M] built from the current index files, or if in
+         * the order of extract_ngram() they do not fit into mem_budget()
+         */
+        bool extract_counts(unsigned N, unsigned M, unsigned freq,
+                bool by_length, OutputFunc& output);
 //        void extract_ngram(unsigned N,
 //                unsigned M,
 //                unsigned freq,
 //                std::ostream& os = std::cout,
 //                const string& encoding = "UTF-8");
-        void set_temp_dir(const string& dir){};
+
+        /**
+         * width of the bit packed .ptable entries, known after parse_end()
+         * 0 means plain unsigned entries (indexes made by older versions),
+         * readers must set the width recorded for the index before
+         * extract_ngram()
+         */
+        unsigned ptable_bits() const { return m_ptable_bits; }
+        void set_ptable_bits(unsigned bits) { m_ptable_bits = bits; }
+
+        /**
+         * whether the .ngram text table is compressed (see ngramtext.hpp)
+         * set it before parse_end() to build a compressed index, or before
+         * extract_ngram() to read one
+         */
+        bool compress_text() const { return m_compress_text; }
+        void set_compress_text(bool compress) { m_compress_text = compress; }
+
+        /**
+         * directories for temporary ptable runs and spilled indexes, given
+         * as a comma separated list. Runs are striped round-robin over
+         * them, so with one directory per disk both spilling and the
+         * merge readers spread their I/O over all disks. An empty list
+         * means the current directory
+         */
+        const vector<string>& temp_dirs() const { return m_temp_dirs; }
+        void set_temp_dir(const string& dirs);
+
+        /**
+         * with auto spill on, an in-memory NGramStat (no file name base)
+         * whose text buffer fills up moves on to a temporary index in
+         * temp_dirs(), which the destructor removes again. without it a
+         * full buffer is an error
+         */
+        bool auto_spill() const { return m_auto_spill; }
+        void set_auto_spill(bool spill) { m_auto_spill = spill; }
+
+        /**
+         * sort and write temporary runs on a background thread. At the
+         * first spill a second text buffer and ptable of the same size are
+         * allocated, if the memory budget has room for them, and parsing
+         * goes on in one while the other is written out
+         */
+        bool background_spill() const { return m_background_spill; }
+        void set_background_spill(bool spill) { m_background_spill = spill; }
+
+        /**
+         * number of threads computing the ltable. Adjacent ptable entries
+         * are compared independently of each other, so the ptable is cut
+         * into one chunk per thread
+         */
+        unsigned threads() const { return m_threads; }
+        void set_threads(unsigned n) { m_threads = n ? n : 1; }
+
+        /**
+         * keep only the k most frequent n-grams of each length, 0 for all.
+         * They are put out after the scan, by length and each length by
+         * decreasing count (equal counts in symbol order). The scan holds
+         * k n-grams of each length in a min-heap and copies the text of an
+         * n-gram only when it gets in
+         */
+        unsigned top() const { return m_top; }
+        void set_top(unsigned k) { m_top = k; }
 
     private: //{{{
+        // the large in-memory tables live on huge pages where possible
+        typedef vector<unsigned, HugePageAllocator<unsigned> > PTable;
+        typedef vector<unsigned char, HugePageAllocator<unsigned char> > LTable;
 
         struct NGram{
             string_type  m_text;
             unsigned m_count;
         };
 
+        // puts count table entries back into the order of the scan
+        struct RankLess {
+            bool operator()(const CountTable::Entry& a,
+                    const CountTable::Entry& b) const {
+                return a.m_rank < b.m_rank;
+            }
+        };
+
+        // ranks the kept n-grams, the worst one is at the top of the heap
+        struct MoreFrequent {
+            bool operator()(const NGram& a, const NGram& b) const {
+                return a.m_count > b.m_count ||
+                    (a.m_count == b.m_count && a.m_text < b.m_text);
+            }
+        };
+
+        // counts N to M-grams over suffixes coming in sorted order
+        class Extractor {
+            public:
+                /**
+                 * top: see set_top(). with table given the n-grams go
+                 * there instead of to output
+                 */
+                Extractor(unsigned N, unsigned M, unsigned freq,
+                        unsigned top, OutputFunc& output,
+                        CountTableWriter* table = 0);
+
+                /**
+                 * account for the next suffix, which has lcp symbols in
+                 * common with the previous one. return true if it starts
+                 * new ngrams, its text must then be given to start()
+                 */
+                bool push(unsigned lcp);
+
+                // the suffix starts at offset of text, which must outlive finish()
+                void start(const NGramText<CharT, Traits>& text,
+                        unsigned offset);
+
+                // account for run more suffixes sharing M symbols or more
+                void repeat(size_t run) {
+                    for (unsigned j = m_N;j <= m_M;++j)
+                        m_counts[j] += run;
+                }
+
+                // output the ngrams still being counted and the top ones
+                void finish();
+
+                unsigned max_n() const { return m_M; }
+
+            private:
+                void flush(unsigned from);
+                void keep(unsigned n);
+                bool has_prefix(unsigned n);
+
+                unsigned         m_N;
+                unsigned         m_M;
+                unsigned         m_freq;
+                unsigned         m_top;
+                unsigned         m_from;   //smallest n to restart in start()
+                OutputFunc&      m_output;
+                CountTableWriter* m_table;
+                // the n-grams being counted are all prefixes of the last
+                // suffix started, m_counts[n] counts its n-gram. Its text is
+                // only fetched into m_prefix once an n-gram is put out
+                const NGramText<CharT, Traits>* m_text;
+                unsigned         m_offset;
+                bool             m_fetched;
+                CharT            m_fetch_buf[256];
+                string_type      m_prefix;
+                vector<unsigned> m_counts;
+                string_type      m_ngram;
+                vector<vector<NGram> > m_best; //n --> heap of the top n-grams
+        };
+
+        // a full text buffer to be written out as a temporary run
+        struct SpillJob {
+            CharT*   m_buffer;
+            PTable*  m_ptable;
+            string   m_name;
+            unsigned m_start_offset;
+            unsigned m_bits;
+            unsigned m_text_size;  // symbols of text to append to .ngram
+            string   m_error;      // what went wrong on the background thread
+        };
+
+        // boost::function copies its target, so hand threads a pointer
+        struct RunSpillJob {
+            RunSpillJob(NGramStat* stat):m_stat(stat) {}
+            void operator()();
+            NGramStat* m_stat;
+        };
+
+        // lcps of count adjacent pairs in offsets[0, count], into out
+        struct LcpJob {
+            void operator()() const;
+            const NGramStat*                m_stat;
+            const NGramText<CharT, Traits>* m_text;  // 0: the text buffer
+            const unsigned*                 m_offsets;
+            size_t                          m_count;
+            unsigned char*                  m_out;
+        };
+
         /**
          * compare two wide string pointed by ptable index
          * if the first 255 chars of the two string are equal
@@ -111,22 +397,59 @@ class NGramStat : boost::noncopyable {
             const CharT* m_buf;
         };
 
+        // cmp_ptable over a text table
+        struct cmp_text {
+            cmp_text(const NGramText<CharT, Traits>& text):m_text(&text){}
+            bool operator()(unsigned lhs,unsigned rhs) const {
+                int rc = m_text->compare(lhs,rhs,255);
+                return (rc < 0 || (rc == 0 && lhs < rhs));
+            }
+            private:
+            const NGramText<CharT, Traits>* m_text;
+        };
+
         void alloc_mem();
 //        void preprocess_w(ustring& buf) const;
 //        string_type preprocess(ustring& buf)
 //            const {return string_type();}
         void calc_ltable();
         void save_temp_buffer();
+        void alloc_spare();
+        void write_run(SpillJob& job);
+        void wait_spill();
+        void checkpoint(typename ParseState::Phase phase);
+        void commit_checkpoint();
+        void spill_to_disk();
+        void open_ngram_file();
+        void remove_temp_index() const;
+        void remove_temp_runs() const;
+        void write_temp_ptable();
         void write_ltable() const;
-        void write_ltable(const CharT* ngram_table,const string ptable_filename) const;
-        void write_ptable(const string& name,unsigned start_offset) const;
-        void merge_ptables();
+        void write_ltable(const NGramText<CharT, Traits>& text,
+                const string ptable_filename, unsigned ptable_size) const;
+        void compress_ngram_file() const;
+        void write_ptable(const PTable& ptable,const string& name,
+                unsigned start_offset,unsigned bits) const;
+        void finish_parse(Extractor* stream);
+        void merge_ptables(Extractor* stream);
+        void scan_index(unsigned N, unsigned M, unsigned freq,
+                OutputFunc& output, CountTableWriter* table);
+        void merge_append();
+        int compare_suffix(const CharT* s1,const CharT* s2) const;
         void add_ptable_node(unsigned start,unsigned end);
         unsigned char calc_common_words(const CharT* s1,const CharT* s2) const;
-        string next_temp_ptable_filename() const;
-        void fetch_ngram(unsigned N,CharT* s,string_type& ngram) const;
-        void fetch_ngrams(unsigned N,unsigned M,CharT* s,vector<NGram>& ngrams) const;
-        unsigned ptable_entry(unsigned* ptable,FILE* fp,unsigned pos) const;
+        void calc_lcps(const NGramText<CharT, Traits>* text,
+                const unsigned* offsets, size_t count, unsigned char* out) const;
+        void calc_lcps_parallel(const NGramText<CharT, Traits>* text,
+                const unsigned* offsets, size_t count, unsigned char* out) const;
+        string next_temp_ptable_filename();
+        string temp_run_filename(size_t k) const;
+        void remove_orphan_runs() const;
+
+        void charge(const string& what, size_t bytes) const {
+            mem_budget().set(m_budget_name + what, bytes);
+        }
+        unsigned ptable_entry(const void* ptable,FILE* fp,unsigned pos) const;
         unsigned char ltable_entry(unsigned char* ltable,FILE* fp,unsigned pos) const;
         unsigned ptable_entry(unsigned pos);
         unsigned char ltable_entry(unsigned pos);
@@ -152,10 +475,35 @@ class NGramStat : boost::noncopyable {
         unsigned       m_buffersize;      //in-memory buffer size in terms of uchar_t
         CharT*         m_buffer;
         string_type        m_buf_remain;
-        vector<unsigned>      *m_ptable;
-        vector<unsigned char> *m_ltable;
-        vector<string>         m_tempfiles;
+        PTable                *m_ptable;
+        LTable                *m_ltable;
+        vector<TempRun>        m_tempruns;
+        unsigned               m_ptable_bits;
+        bool                   m_compress_text;
+        vector<string>         m_temp_dirs;
+        unsigned               m_next_temp_dir;   //where the next run goes
+        bool                   m_auto_spill;
+        bool                   m_is_temp_index;   //index files are ours to remove
+        bool                   m_background_spill;
+        CharT*                 m_spare_buffer;    //being written out while m_buffer fills
+        PTable*                m_spare_ptable;
+        SpillJob               m_spill_job;
+        Thread                 m_spill_thread;
+        unsigned               m_threads;
+        unsigned               m_top;
+        CheckpointFunc         m_checkpoint;
+        ParseState             m_pending;         //state once the spill is on disk
+        bool                   m_has_pending;
+        unsigned               m_input_file;
+        boost::uint64_t        m_input_pos;
+        string                 m_append_base;     //index being appended to
+        unsigned               m_append_bits;     //its ptable width
+        unsigned               m_append_size;     //its text size
+        unsigned               m_append_offset;   //where the temporary index starts
+        bool                   m_append_compress;
+        string                 m_budget_name;
         static const CharT s_terminal;
+        static const unsigned s_ltable_block = 1 << 20; //ltable entries per write
 //}}}
 };
 
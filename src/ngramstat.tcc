@@ -35,6 +35,7 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <cerrno>
 #include <cassert>
 #include <cwchar>
 #include <cwctype>
@@ -42,9 +43,12 @@
 #include <stdexcept>
 #include <boost/progress.hpp>
 #include <boost/ref.hpp>
+#include <boost/shared_array.hpp>
 
 #include "iconvert.hpp"
 #include "mmapfile.hpp"
+#include "packedarray.hpp"
+#include "ltablescan.hpp"
 
 using namespace std;
 using boost::progress_display;
@@ -59,6 +63,8 @@ const CharT NGramStat<CharT, Traits>::s_terminal = CharT();
  * @param memory indicate how many memory to use (in MB)
  *        The memory allocated will be freed either by calling
  *        \ref clear() or when the destructor is called.
+ *        0 allocates nothing, for an NGramStat which only merges
+ *        shards (see \ref merge_shards()).
  * @param file_name_base base name for ptable and ltable file
  *        if empty ltable will be built in memory.
  * @param use_mmap use mmap() call for disk operation.
@@ -73,14 +79,34 @@ m_mem_size(memory),
 m_buffersize(0),
 m_buffer(0),
 m_ptable(0),
-m_ltable(0)
+m_ltable(0),
+m_ptable_bits(0),
+m_compress_text(false),
+m_next_temp_dir(0),
+m_auto_spill(false),
+m_is_temp_index(false),
+m_background_spill(false),
+m_spare_buffer(0),
+m_spare_ptable(0),
+m_threads(1),
+m_top(0),
+m_has_pending(false),
+m_input_file(0),
+m_input_pos(0),
+m_append_bits(0),
+m_append_size(0),
+m_append_offset(0),
+m_append_compress(false)
 {
-    alloc_mem();
+    if (m_mem_size)
+        alloc_mem();
 }
 
 template <typename CharT,typename Traits>
 NGramStat<CharT, Traits>::~NGramStat(){
     clear();
+    if (m_is_temp_index)
+        remove_temp_index();
 }
 
 /**
@@ -88,12 +114,25 @@ NGramStat<CharT, Traits>::~NGramStat(){
  */
 template <typename CharT,typename Traits>
 void NGramStat<CharT, Traits>::clear() {
-    delete[] m_buffer;
+    if (m_spill_thread.running())
+        m_spill_thread.join();
+    huge_free(m_spare_buffer);
+    m_spare_buffer = 0;
+    delete m_spare_ptable;
+    m_spare_ptable = 0;
+
+    huge_free(m_buffer);
     m_buffer = 0;
     delete m_ptable;
     m_ptable = 0;
     delete m_ltable;
     m_ltable = 0;
+
+    charge("text buffer", 0);
+    charge("ptable", 0);
+    charge("ltable", 0);
+    charge("spare text buffer", 0);
+    charge("spare ptable", 0);
 }
 
 template <typename CharT,typename Traits>
@@ -105,28 +144,40 @@ void NGramStat<CharT, Traits>::alloc_mem() {
     cerr << "Try to allocate " << m_mem_size/1024 << " MB for processing" <<
         endl;
 
-    unsigned char_count;
+    boost::uint64_t bytes = boost::uint64_t(m_mem_size) * 1024;
+    boost::uint64_t count;
 
     if (m_filename_base.empty())
         //LTable is in memory
-        char_count = m_mem_size * 1024 / (sizeof(CharT) + sizeof(unsigned) +
+        count = bytes / (sizeof(CharT) + sizeof(unsigned) +
                 sizeof(unsigned char));
     else
-        char_count = m_mem_size * 1024 / (sizeof(CharT) + sizeof(unsigned));
+        count = bytes / (sizeof(CharT) + sizeof(unsigned));
+
+    //ptable entries are unsigned offsets into the buffer
+    const boost::uint64_t max_count = ~0u - m_extra_buffersize - 1;
+    unsigned char_count = unsigned(std::min(count, max_count));
 
     //reserve memory in advance to prevent unexcepted mem allocation
     //when vector grows, which may exceed the system's limit
-    m_ptable = new vector<unsigned>;
+    m_ptable = new PTable;
     m_ptable->reserve(char_count);
     if (m_filename_base.empty()) {
-        m_ltable = new vector<unsigned char>;
+        m_ltable = new LTable;
         m_ltable->reserve(char_count);
     }
 
     m_buffersize = char_count;
-    m_buffer = new CharT[m_buffersize + 1 + m_extra_buffersize];
+    m_buffer = static_cast<CharT*>(huge_alloc(sizeof(CharT) *
+                (m_buffersize + 1 + m_extra_buffersize)));
     m_buffer[m_buffersize + m_extra_buffersize] = s_terminal;
 
+    charge("text buffer",
+            sizeof(CharT) * (m_buffersize + 1 + m_extra_buffersize));
+    charge("ptable", m_ptable->capacity() * sizeof(unsigned));
+    if (m_ltable)
+        charge("ltable", m_ltable->capacity());
+
     cerr << "Use "
         << sizeof(CharT) * (m_buffersize + 1 + m_extra_buffersize) / (1024 *
                 1024)
@@ -136,6 +187,15 @@ void NGramStat<CharT, Traits>::alloc_mem() {
     if (m_filename_base.empty())
         cerr << "Use " << char_count * sizeof(char) / (1024 * 1024)
             << " MB memory for ltable entry" << endl;
+    if (huge_page_bytes(EXPLICIT_HUGE_PAGES))
+        cerr << "Use explicit huge pages for "
+            << huge_page_bytes(EXPLICIT_HUGE_PAGES) / (1024 * 1024) << " MB" << endl;
+    if (huge_page_bytes(TRANSPARENT_HUGE_PAGES))
+        cerr << "Use transparent huge pages for "
+            << huge_page_bytes(TRANSPARENT_HUGE_PAGES) / (1024 * 1024) << " MB" << endl;
+    if (!huge_page_bytes(EXPLICIT_HUGE_PAGES) &&
+            !huge_page_bytes(TRANSPARENT_HUGE_PAGES))
+        cerr << "Use normal pages (tables too small or no huge pages)" << endl;
     if (m_is_use_mmap)
         cerr << "Use mmap() for faster operation if necessary" << endl;
 }
@@ -166,17 +226,66 @@ void NGramStat<CharT, Traits>::parse_begin(){
     m_buffer_offset = 0;
     m_last_word_end = 0;
     m_buf_remain.clear();
-    m_tempfiles.clear();
+    m_tempruns.clear();
 
     if (!m_filename_base.empty()) {
-        m_ngramfile.open((m_filename_base + ".ngram").c_str(),ios::binary);
-        if (!m_ngramfile){
-            cerr << "unable to open ngramfile:" << m_filename_base
-                << ".ngram to write!" << endl;
-            throw runtime_error("unable to open ngramfile to write");
-        }
+        //runs left by a build of the same index that did not finish
+        remove_orphan_runs();
+        open_ngram_file();
     }
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::open_ngram_file() {
+    m_ngramfile.open((m_filename_base + ".ngram").c_str(),ios::binary);
+    if (!m_ngramfile){
+        cerr << "unable to open ngramfile:" << m_filename_base
+            << ".ngram to write!" << endl;
+        throw runtime_error("unable to open ngramfile to write");
+    }
+}
+
+/**
+ * switch an in-memory NGramStat over to a temporary index when its text
+ * buffer is full, parsing then goes on as if a file name base was given
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::spill_to_disk() {
+    assert(m_filename_base.empty());
+
+    m_filename_base = next_temp_ptable_filename();
+    m_is_temp_index = true;
+    cerr << "Text buffer full, spill to temporary index: "
+        << m_filename_base << endl;
+
+    //the ltable will be written to file instead
+    delete m_ltable;
+    m_ltable = 0;
+    charge("ltable", 0);
+
+    open_ngram_file();
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::set_shard(const string& name) {
+    assert(m_filename_base.empty());
 
+    //tables are allocated again by parse_begin(), without the ltable
+    //and charged under the new name
+    clear();
+    m_budget_name   = name + ": ";
+    m_filename_base = next_temp_ptable_filename();
+    m_is_temp_index = true;
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::remove_temp_index() const {
+    const char* exts[] = { ".ngram", ".ptable", ".ltable" };
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); ++i) {
+        string name = m_filename_base + exts[i];
+        if (unlink(name.c_str()) != 0 && errno != ENOENT)
+            perror(name.c_str());
+    }
 }
 
 /**
@@ -186,8 +295,30 @@ void NGramStat<CharT, Traits>::parse_begin(){
  */
 template <typename CharT,typename Traits>
 void NGramStat<CharT, Traits>::parse_end() {
-    cmp_ptable cmp_obj(m_buffer);
+    finish_parse(0);
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::parse_end(unsigned N, unsigned M,
+        unsigned freq, OutputFunc& output) {
+    if (!m_is_temp_index) {
+        finish_parse(0);
+        extract_ngram(N,M,freq,output);
+        return;
+    }
+
+    Extractor extractor(N,M,freq,m_top,output);
+    finish_parse(&extractor); //finishes the extractor as well
+}
+
+/**
+ * write the ngram file and sort, merge and write ptable and ltable as
+ * needed. with stream given a disk merge feeds it instead of writing them
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::finish_parse(Extractor* stream) {
     if (m_filename_base.empty()) { //in memory operation
+        cmp_ptable cmp_obj(m_buffer);
         cerr << "Sorting ptable..." << endl;
         sort(m_ptable->begin(),m_ptable->end(),cmp_obj);
         cerr << "N-gram buffer size(in CharT):" <<(m_buffer_offset + 1)<<endl;
@@ -197,10 +328,13 @@ void NGramStat<CharT, Traits>::parse_end() {
     } else {
         if (m_buf_remain.size() > 0)
             save_temp_buffer();
+        wait_spill();
+        cmp_ptable cmp_obj(m_buffer);
 
         //no disk merme needed {{{
         //save ptable directly
-        if (m_tempfiles.empty()) {
+        if (m_tempruns.empty()) {
+            assert(!stream); //a spilled index has temporary runs
             if (m_buffer_offset > m_buffersize) {
                 //add ptable nodes in extra buffer
                 add_ptable_node(m_last_word_end,m_buffer_offset);
@@ -210,12 +344,16 @@ void NGramStat<CharT, Traits>::parse_end() {
             cerr << "N-gram buffer size(in CharT):" <<(m_buffer_offset + 1)<<endl;
             cerr << "ptable size:" << m_ptable->size() <<endl;
 
-            write_ptable(m_filename_base + ".ptable",0u);
+            m_ptable_bits = packed_bits(m_buffer_offset);
+            write_ptable(*m_ptable,m_filename_base + ".ptable",0u,m_ptable_bits);
             write_ltable();
             m_ngramfile.write((char*)m_buffer,
                     (m_buffer_offset + 1) * sizeof(CharT)); //includinm the last L'\0'
             m_ngramfile.close();
             clear();
+
+            if (m_compress_text)
+                compress_ngram_file();
             //}}}
         } else {
             //need disk merge {{{
@@ -225,10 +363,8 @@ void NGramStat<CharT, Traits>::parse_end() {
                 add_ptable_node(m_last_word_end,m_buffer_offset);
             }
             sort(m_ptable->begin(),m_ptable->end(),cmp_obj);
-
-            string filename = next_temp_ptable_filename();
-            m_tempfiles.push_back(filename);
-            write_ptable(filename,m_start_offset);
+            write_temp_ptable();
+            m_ptable_bits = packed_bits(m_start_offset + m_buffer_offset);
 
             m_ngramfile.write((char*)m_buffer,
                     (m_buffer_offset + 1) * sizeof(CharT)); //includinm the last L'\0'
@@ -238,7 +374,15 @@ void NGramStat<CharT, Traits>::parse_end() {
             //disk merge
             clear();
 
-            merge_ptables(); //also calculate ltable here
+            if (m_compress_text)
+                compress_ngram_file();
+
+            if (m_checkpoint) {
+                checkpoint(ParseState::PARSED);
+                commit_checkpoint();
+            }
+
+            merge_ptables(stream); //also calculate ltable here
         }//}}}
     }
 }
@@ -286,38 +430,70 @@ void NGramStat<CharT, Traits>::parse_buf(const string_type& buf) {
 /**
  * save current buffer to disk for disk merging later
  * then move un-processed text to the beginning of text buffer
+ *
+ * with background spilling the buffer is sorted and written on another
+ * thread, and the un-processed text moves to the beginning of the spare
+ * buffer, which parsing goes on with
  */
 template <typename CharT,typename Traits>
 void NGramStat<CharT, Traits>::save_temp_buffer() {
     assert(!m_ptable->empty());
 
-    if (m_filename_base.empty())
-        throw runtime_error("Text Buffer full with no external ngram file name given!");
-
-    cerr << "Sorting temporary ptable for disk merging later..." << endl;
-    cmp_ptable cmp_obj(m_buffer);
-    sort(m_ptable->begin(),m_ptable->end(),cmp_obj);
-
-    string filename = next_temp_ptable_filename();
-    m_tempfiles.push_back(filename);
-    //write temp ptable
-    write_ptable(filename,m_start_offset);
-    m_ptable->clear();
+    if (m_filename_base.empty()) {
+        if (!m_auto_spill)
+            throw runtime_error("Text Buffer full with no external ngram file name given!");
+        spill_to_disk();
+    }
 
+    //runs and text must reach the disk in order
+    wait_spill();
+    if (m_background_spill && !m_spare_buffer)
+        alloc_spare();
+
+    TempRun run;
+    run.m_name = temp_run_filename(m_tempruns.size());
+    // entries are offsets into the part of the ngram file written so far
+    run.m_bits = packed_bits(m_start_offset + m_buffer_offset);
+    run.m_size = m_ptable->size();
+    m_tempruns.push_back(run);
+    charge("temp runs", m_tempruns.capacity() * sizeof(TempRun));
+
+    m_spill_job.m_buffer       = m_buffer;
+    m_spill_job.m_ptable       = m_ptable;
+    m_spill_job.m_name         = run.m_name;
+    m_spill_job.m_start_offset = m_start_offset;
+    m_spill_job.m_bits         = run.m_bits;
     //not include the last L'\0' when writing
     //temp ngram buffer
-    m_ngramfile.write((char*)m_buffer,m_last_word_end * sizeof(CharT));
+    m_spill_job.m_text_size    = m_last_word_end;
+    m_spill_job.m_error.clear();
+    if (m_checkpoint)
+        checkpoint(ParseState::PARSING);
+
+    CharT* next = m_buffer;
+    if (m_spare_buffer) {
+        next = m_spare_buffer;
+        m_spare_buffer = m_buffer;
+        std::swap(m_ptable,m_spare_ptable);
+    } else {
+        write_run(m_spill_job);
+        commit_checkpoint();
+    }
 
     //copy the rest N-Gram to the beginning of the buffer
     //wcscpy(m_buffer,m_buffer + m_last_word_end);
     size_t n = Traits::length(m_buffer + m_last_word_end);
-    Traits::copy(m_buffer,m_buffer + m_last_word_end,n);
-    m_buffer[n] = s_terminal;
+    Traits::move(next,m_buffer + m_last_word_end,n);
+    next[n] = s_terminal;
     if (m_buf_remain.size() > 0) {
-        Traits::copy(m_buffer + n,m_buf_remain.data(),m_buf_remain.size());
-        m_buffer[n + m_buf_remain.size()] = s_terminal;
+        Traits::copy(next + n,m_buf_remain.data(),m_buf_remain.size());
+        next[n + m_buf_remain.size()] = s_terminal;
         m_buf_remain.clear();
     }
+    m_buffer = next;
+
+    if (m_spare_buffer)
+        m_spill_thread.start(RunSpillJob(this));
 
     m_start_offset += m_last_word_end;
     m_last_word_end = 0;
@@ -326,6 +502,165 @@ void NGramStat<CharT, Traits>::save_temp_buffer() {
     add_ptable_node(0,m_buffer_offset);
 }
 
+/**
+ * allocate the second text buffer and ptable for background spilling,
+ * or fall back to spilling on the parsing thread if the budget is short
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::alloc_spare() {
+    size_t buffer_bytes = sizeof(CharT) * (m_buffersize + 1 + m_extra_buffersize);
+    size_t ptable_bytes = m_ptable->capacity() * sizeof(unsigned);
+    if (mem_budget().available() < buffer_bytes + ptable_bytes) {
+        cerr << "No memory budget left for a second text buffer, "
+            << "spill on the parsing thread" << endl;
+        m_background_spill = false;
+        return;
+    }
+
+    cerr << "Use a second text buffer to spill in the background" << endl;
+    m_spare_buffer = static_cast<CharT*>(huge_alloc(buffer_bytes));
+    m_spare_buffer[m_buffersize + m_extra_buffersize] = s_terminal;
+    m_spare_ptable = new PTable;
+    m_spare_ptable->reserve(m_ptable->capacity());
+    charge("spare text buffer", buffer_bytes);
+    charge("spare ptable", ptable_bytes);
+}
+
+/**
+ * sort a full buffer's ptable, write it as a temporary run and append
+ * the buffer's text to the ngram file
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::write_run(SpillJob& job) {
+    cerr << "Sorting temporary ptable for disk merging later..." << endl;
+    cmp_ptable cmp_obj(job.m_buffer);
+    sort(job.m_ptable->begin(),job.m_ptable->end(),cmp_obj);
+
+    write_ptable(*job.m_ptable,job.m_name,job.m_start_offset,job.m_bits);
+    job.m_ptable->clear();
+
+    m_ngramfile.write((char*)job.m_buffer,job.m_text_size * sizeof(CharT));
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::RunSpillJob::operator()() {
+    try {
+        m_stat->write_run(m_stat->m_spill_job);
+    } catch (std::exception& e) {
+        m_stat->m_spill_job.m_error = e.what();
+    }
+}
+
+// wait for the background spill (if any) and pass on its error
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::wait_spill() {
+    if (!m_spill_thread.running())
+        return;
+    m_spill_thread.join();
+    if (!m_spill_job.m_error.empty())
+        throw runtime_error(m_spill_job.m_error);
+    commit_checkpoint();
+}
+
+/**
+ * take down the state of the build for the next checkpoint, which is
+ * passed on by commit_checkpoint() once the disk has caught up with it
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::checkpoint(typename ParseState::Phase phase) {
+    m_pending.m_phase       = phase;
+    m_pending.m_runs        = m_tempruns;
+    m_pending.m_input_file  = m_input_file;
+    m_pending.m_input_pos   = m_input_pos;
+    m_pending.m_ptable_bits = m_ptable_bits;
+    m_pending.m_ptable_size = 0;
+    m_pending.m_text_size   = m_start_offset;
+    m_pending.m_tail.clear();
+    if (phase == ParseState::PARSING) {
+        //the text after the run moves on to the next buffer
+        m_pending.m_text_size += m_last_word_end;
+        m_pending.m_tail.assign(m_buffer + m_last_word_end,
+                Traits::length(m_buffer + m_last_word_end));
+        m_pending.m_tail += m_buf_remain;
+    }
+    m_has_pending = true;
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::commit_checkpoint() {
+    if (!m_has_pending)
+        return;
+    m_has_pending = false;
+    if (m_ngramfile.is_open())
+        m_ngramfile.flush();
+    m_checkpoint(m_pending);
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::resume(const ParseState& state) {
+    assert(!m_filename_base.empty());
+
+    m_tempruns = state.m_runs;
+    charge("temp runs", m_tempruns.capacity() * sizeof(TempRun));
+    remove_orphan_runs();
+    m_input_file = state.m_input_file;
+    m_input_pos  = state.m_input_pos;
+
+    if (state.m_phase == ParseState::PARSING) {
+        if (!m_buffer)
+            alloc_mem();
+        if (state.m_tail.size() > m_buffersize)
+            throw runtime_error("text buffer too small to resume the build");
+
+        //drop whatever text got written after the checkpoint
+        string name = m_filename_base + ".ngram";
+        if (truncate(name.c_str(),off_t(state.m_text_size) * sizeof(CharT)) != 0) {
+            perror(name.c_str());
+            throw runtime_error("unable to truncate ngram file to resume from");
+        }
+        m_ngramfile.open(name.c_str(),ios::binary | ios::app);
+        if (!m_ngramfile)
+            throw runtime_error("unable to open ngramfile to write");
+
+        m_ptable->clear();
+        m_start_offset  = state.m_text_size;
+        m_last_word_end = 0;
+        m_buf_remain.clear();
+        Traits::copy(m_buffer,state.m_tail.data(),state.m_tail.size());
+        m_buffer_offset = state.m_tail.size();
+        m_buffer[m_buffer_offset] = s_terminal;
+        add_ptable_node(0,m_buffer_offset);
+        return;
+    }
+
+    //everything left to do works on the files
+    clear();
+    m_ptable_bits = state.m_ptable_bits;
+    if (state.m_phase == ParseState::PARSED) {
+        merge_ptables(0);
+    } else {
+        NGramText<CharT, Traits> text;
+        text.open(m_filename_base + ".ngram",m_compress_text);
+        write_ltable(text,m_filename_base + ".ptable",state.m_ptable_size);
+        remove_temp_runs();
+    }
+}
+
+/**
+ * write the sorted in-memory ptable as a new temporary run
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::write_temp_ptable() {
+    TempRun run;
+    run.m_name = temp_run_filename(m_tempruns.size());
+    // entries are offsets into the part of the ngram file written so far
+    run.m_bits = packed_bits(m_start_offset + m_buffer_offset);
+    run.m_size = m_ptable->size();
+    m_tempruns.push_back(run);
+    charge("temp runs", m_tempruns.capacity() * sizeof(TempRun));
+    write_ptable(*m_ptable,run.m_name,m_start_offset,run.m_bits);
+}
+
 /**
  * calculate in memory LTable
  */
@@ -339,14 +674,10 @@ void NGramStat<CharT, Traits>::calc_ltable(){
     //set first entry to zero
     m_ltable->push_back(0);
 
-    unsigned char count;
-    vector<unsigned>& ptable = *m_ptable;
-    for (unsigned i = 1;i < ptable.size(); ++i) {
-        assert(ptable[i - 1] < m_buffer_offset && ptable[i] < m_buffer_offset);
-
-        count = calc_common_words(&m_buffer[ptable[i- 1]],&m_buffer[ptable[i]]);
-        //m_ltable->push_back(calc_common_words(&m_buffer[ptable->at(i - 1)],&m_buffer[ptable->at(i]]));
-        m_ltable->push_back(count);
+    PTable& ptable = *m_ptable;
+    if (ptable.size() > 1) {
+        m_ltable->resize(ptable.size());
+        calc_lcps_parallel(0,&ptable[0],ptable.size() - 1,&(*m_ltable)[1]);
     }
 }
 
@@ -374,24 +705,45 @@ void NGramStat<CharT, Traits>::write_ltable() const {
     //set first entry to zero
     file.write((char*)&count,sizeof(unsigned char));
 
-    vector<unsigned>& ptable = *m_ptable;
-    for (unsigned i = 1;i < ptable.size(); ++i) {
-        assert(ptable[i - 1] < m_buffer_offset && ptable[i] < m_buffer_offset);
-
-        count = calc_common_words(&m_buffer[ptable[i - 1]],
-                &m_buffer[ptable[i]]);
-        file.write((char*)&count,sizeof(unsigned char));
+    //computed a block at a time so that writing stays sequential
+    const PTable& ptable = *m_ptable;
+    size_t block = s_ltable_block;
+    vector<unsigned char> lcps(min(block,ptable.size()));
+    charge("ltable block", lcps.size());
+    for (size_t i = 0;i + 1 < ptable.size(); i += block) {
+        size_t n = min(block,ptable.size() - 1 - i);
+        calc_lcps_parallel(0,&ptable[i],n,&lcps[0]);
+        file.write((char*)&lcps[0],n);
     }
+    charge("ltable block", 0);
     file.close();
 }
 
+/**
+ * replace the raw .ngram file with its compressed form
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::compress_ngram_file() const {
+    string name = m_filename_base + ".ngram";
+    string tmp  = name + ".z";
+
+    cerr << "Compressing ngram table: " << name << endl;
+    NGramText<CharT, Traits>::compress(name,tmp);
+    if (rename(tmp.c_str(),name.c_str()) != 0) {
+        perror("unable to replace ngram file");
+        throw runtime_error("unable to replace ngram file with its compressed form");
+    }
+}
+
 /**
  * calculate and write ltable into ltable file(*.ltable)
- * this ltable is calculated from the given ptable and ngram table
+ * this ltable is calculated from the given (packed) ptable and ngram table
  */
 template <typename CharT,typename Traits>
-void NGramStat<CharT, Traits>::write_ltable(const CharT* ngram_table,const string ptable_filename) const{
+void NGramStat<CharT, Traits>::write_ltable(const NGramText<CharT, Traits>& text,
+        const string ptable_filename, unsigned ptable_size) const{
     assert(!m_filename_base.empty());
+    assert(m_ptable_bits);
 
     string ltable_filename = m_filename_base + ".ltable";
     cerr << "Writing ltable:" << ltable_filename << endl;
@@ -407,99 +759,65 @@ void NGramStat<CharT, Traits>::write_ltable(const CharT* ngram_table,const strin
     //set first entry to zero
     file.write((char*)&count,sizeof(unsigned char));
 
+    MmapFile fm(ptable_filename.c_str());
+    const boost::uint64_t* ptable = 0;
+    FILE* fp = 0;
     if (m_is_use_mmap) {
-        unsigned* ptable     = 0;
-        unsigned  ptable_size = 0;
-
         //mmap ptable file for calculating ltable
-        MmapFile fm(ptable_filename.c_str());
         if (!fm.open())
             throw runtime_error("mmap call failed");
-
-        ptable = (unsigned*)fm.addr();
-        ptable_size = fm.size();
-
-        unsigned* ptable_end = ptable + ptable_size / sizeof(unsigned) - 1;
-
-        for (const unsigned* i = ptable;i < ptable_end;++i) {
-            count = calc_common_words(&ngram_table[*i],
-                    &ngram_table[*(i+1)]);
-            file.write((char*)&count,sizeof(unsigned char));
-        }
-        fm.close();
+        ptable = (const boost::uint64_t*)fm.addr();
     } else {
-        /*
-           int fd;
-           fd = open(ptable_filename.c_str(),O_RDONLY);
-           if (fd == -1) {
-           perror("unable to open ptable file");
-           exit(EXIT_FAILURE);
-           }
-           */
-
-        FILE* fp;
         fp = fopen(ptable_filename.c_str(),"rb");
         if (fp == NULL) {
             perror("unable to open ptable file");
             exit(EXIT_FAILURE);
         }
+    }
 
-        /*
-           ifstream fs;
-           fs.open(ptable_filename.c_str(),ios::binary);
-           if (!fs) {
-           perror("unable to open ptable file");
-           exit(EXIT_FAILURE);
-           }
-           */
-
-        struct stat st;
-        if (stat(ptable_filename.c_str(),&st) == -1) {
-            perror("unable to stat ptable file size");
-            exit(EXIT_FAILURE);
-        }
-
-        struct {
-            unsigned offset1;
-            unsigned offset2;
-        }offset;
-
-        unsigned end = st.st_size - sizeof(unsigned);
-
-        for (unsigned pos = 0;pos < end; pos += sizeof(unsigned) ) {
-            /*
-               if (lseek(fd,pos,SEEK_SET) == -1 ||
-               read(fd,&offset,sizeof(offset)) != sizeof(offset)) {
-               perror("error reading ptable file");
-               exit(EXIT_FAILURE);
-               }
-               */
-            if (fseek(fp,pos,SEEK_SET) == -1 ||
-                    fread(&offset,sizeof(offset),1,fp) != 1) {
+    //unpack a block of offsets, the last one is carried over to the
+    //next block, then compute the block's lcps and write them in one go
+    size_t block = s_ltable_block;
+    vector<unsigned> offsets(min(block,size_t(ptable_size)) + 1);
+    vector<unsigned char> lcps(offsets.size() - 1);
+    charge("ltable block",
+            offsets.size() * sizeof(unsigned) + lcps.size());
+    size_t have = 0;
+    for (unsigned i = 0;i < ptable_size; ++i) {
+        if (ptable) {
+            offsets[have++] = packed_get(ptable,m_ptable_bits,i);
+        } else {
+            boost::uint64_t cur;
+            if (!packed_get(fp,m_ptable_bits,i,cur)) {
                 perror("error reading ptable file");
                 exit(EXIT_FAILURE);
             }
-            /*
-               cerr << fs.seekg(pos,ios::beg);
-               cerr << "read:"<< fs.read(&offset,sizeof(offset));
-               */
-
-            count = calc_common_words(&ngram_table[offset.offset1],
-                    &ngram_table[offset.offset2]);
-            file.write((char*)&count,sizeof(unsigned char));
+            offsets[have++] = cur;
         }
 
-        file.close();
+        if (have == offsets.size() || i + 1 == ptable_size) {
+            calc_lcps_parallel(&text,&offsets[0],have - 1,&lcps[0]);
+            file.write((char*)&lcps[0],have - 1);
+            offsets[0] = offsets[have - 1];
+            have = 1;
+        }
     }
+    charge("ltable block", 0);
+
+    if (fp)
+        fclose(fp);
+    else
+        fm.close();
+    file.close();
 }
 
 /**
  * write in memory ptable into ptable file(*.ptable)
+ * entries are shifted by start_offset and packed into bits wide fields
  */
 template <typename CharT,typename Traits>
-void NGramStat<CharT, Traits>::write_ptable(const string& name,unsigned start_offset) const{
-    assert(m_ptable);
-
+void NGramStat<CharT, Traits>::write_ptable(const PTable& ptable,
+        const string& name, unsigned start_offset, unsigned bits) const{
     cerr << "Writing ptable: " << name << endl;
 
     ofstream file(name.c_str(),ios::binary);
@@ -508,18 +826,10 @@ void NGramStat<CharT, Traits>::write_ptable(const string& name,unsigned start_of
         return;
     }
 
-    unsigned offset;
-    vector<unsigned>& ptable = *m_ptable;
-    for (unsigned i = 0;i < ptable.size(); ++i) {
-        offset = ptable[i] + start_offset;
-        file.write((char*)&offset,sizeof(unsigned));
-        /* for debug
-        ustring ws(&g_buffer[offset],255);
-        string s;
-        g_iConvert->convert(ws,s);
-        cerr << offset << ":" << s << endl;
-        */
-    }
+    PackedWriter out(file,bits);
+    for (unsigned i = 0;i < ptable.size(); ++i)
+        out.push_back(ptable[i] + start_offset);
+    out.flush();
     file.close();
 }
 
@@ -535,21 +845,31 @@ void NGramStat<CharT, Traits>::add_ptable_node(unsigned start,unsigned end){
 }
 
 struct PTable_attr {
-    FILE* m_fp;
-    int          m_fd;
+    FILE*        m_fp;
 
     //mmap attr
-    unsigned*    mp_addr;    //mmap addr
-    unsigned*    mp_end;     //end of mmap addr
-    unsigned*    mp_pos;     //current pos
-
-    //file attr
-    off_t        m_pos;      //current pos in file
-    unsigned     m_offset;   //current ngram  offset in ngram file
-    off_t        m_end;      //end offset
-    unsigned     m_size;
+    const boost::uint64_t* mp_addr;    //mmap addr
+
+    unsigned     m_bits;     //width of packed entries
+    unsigned     m_pos;      //index of current entry
+    unsigned     m_size;     //number of entries
+    unsigned     m_offset;   //current entry: ngram offset in ngram file
 };
 
+// load the current entry of a temporary ptable into attr.m_offset
+inline void load_ptable_attr(PTable_attr& attr) {
+    if (attr.mp_addr) {
+        attr.m_offset = packed_get(attr.mp_addr,attr.m_bits,attr.m_pos);
+    } else {
+        boost::uint64_t v;
+        if (!packed_get(attr.m_fp,attr.m_bits,attr.m_pos,v)) {
+            perror("error reading temporary ptable file");
+            throw runtime_error("error reading temporary ptable file");
+        }
+        attr.m_offset = v;
+    }
+}
+
 /**
  * merge several temp ptable file into one
  * and save it to m_filename_base + ".ptable"
@@ -561,245 +881,610 @@ struct PTable_attr {
  * Use Linux instead.
  */
 template <typename CharT,typename Traits>
-void NGramStat<CharT, Traits>::merge_ptables() {
-    string ptable_filename = m_filename_base + ".ptable";
-    vector<PTable_attr > ptables(m_tempfiles.size());
+void NGramStat<CharT, Traits>::merge_ptables(Extractor* stream) {
+    if (m_budget_name.empty()) //a shard is merged while others still parse
+        mem_budget().phase("merging");
 
-    for (unsigned i = 0;i < ptables.size(); ++i) {
-        ptables[i].m_fd     = -1;
+    string ptable_filename = m_filename_base + ".ptable";
+    vector<PTable_attr > ptables(m_tempruns.size());
+    vector<MmapFile*> fm_objs;
+    unsigned files_to_merge = 0;
+    unsigned ptable_size = 0;
 
+    for (unsigned i = 0;i < m_tempruns.size(); ++i) {
+        ptables[i].m_fp     = 0;
         ptables[i].mp_addr  = 0;
-        ptables[i].mp_end   = 0;
-        ptables[i].mp_pos   = 0;
-
+        ptables[i].m_bits   = m_tempruns[i].m_bits;
         ptables[i].m_pos    = 0;
+        ptables[i].m_size   = m_tempruns[i].m_size;
         ptables[i].m_offset = 0;
-        ptables[i].m_end    = 0;
-        ptables[i].m_size   = 0;
-    }
+        ptable_size += ptables[i].m_size;
+        if (ptables[i].m_size == 0)
+            continue;
 
-    unsigned files_to_merge = 0;
-
-    vector<MmapFile*> fm_objs;
-
-    for (unsigned i = 0;i < m_tempfiles.size(); ++i, ++files_to_merge) {
         if (m_is_use_mmap) {
-            //open m_tempfiles using mmap()
-            MmapFile* fm = new MmapFile(m_tempfiles[i].c_str());
-            if (fm_objs[i]->open()) {
-                ptables[i].mp_addr = (unsigned*)fm_objs[i]->addr();
-                ptables[i].m_size = fm_objs[i]->size();
-                ptables[i].mp_pos = ptables[i].mp_addr;
-                ptables[i].mp_end = ptables[i].mp_addr + ptables[i].m_size /
-                    sizeof(unsigned);
-                fm_objs.push_back(fm);
-            } else {
-                cerr << "unable to mmap() file:" << m_tempfiles[i] << endl;
+            //open temp ptables using mmap()
+            MmapFile* fm = new MmapFile(m_tempruns[i].m_name.c_str());
+            if (!fm->open()) {
+                cerr << "unable to mmap() file:" << m_tempruns[i].m_name << endl;
                 delete fm;
                 throw runtime_error("unable to mmap() temp ptable file");
             }
+            fm_objs.push_back(fm);
+            ptables[i].mp_addr = (const boost::uint64_t*)fm->addr();
         } else {
-            //ptables[i].m_fd = open(m_tempfiles[i].c_str(),O_RDONLY);
-            ptables[i].m_fp = fopen(m_tempfiles[i].c_str(),"rb");
+            ptables[i].m_fp = fopen(m_tempruns[i].m_name.c_str(),"rb");
             if (ptables[i].m_fp == NULL) {
                 perror("unable to open temporary ptable file");
                 throw runtime_error("unable to open temporary ptable file");
             }
-            ptables[i].m_fd = fileno(ptables[i].m_fp);
-
-            if (ptables[i].m_fd == -1) {
-                perror("unable to open temporary ptable file");
-                throw runtime_error("unable to open temporary ptable file");
-            }
-
-            struct stat st;
-            if (fstat(ptables[i].m_fd,&st) == -1) {
-                perror("unable to stat temporary ptable file size");
-                throw runtime_error("unable to stat temporary ptable file size");
-            }
-
-            ptables[i].m_size = st.st_size;
-            ptables[i].m_end  = st.st_size;
         }
+
+        load_ptable_attr(ptables[i]);
+        ++files_to_merge;
     }
 
     //mmap ngram table
 #if !defined (HAVE_SYSTEM_MMAP)
 #error the ptable merging code needs mmap(2) support, which is missing on this system
 #endif
-    CharT* ngram_table = 0;
-    unsigned ngram_table_size = 0;
-    MmapFile fm_ngram(string(m_filename_base + ".ngram").c_str());
-    if (!fm_ngram.open()) {
-        cerr << "unable to mmap:" << m_filename_base + ".ngram" << endl;
-        throw runtime_error("unable to mmap() ngram file");
-    }
-    ngram_table = (CharT*)fm_ngram.addr();
-    ngram_table_size = fm_ngram.size();
-
-    ngram_table_size /= sizeof(CharT);
-
-    ofstream ptable_file(ptable_filename.c_str(),ios::binary);
-    if (!ptable_file) {
-        cerr << "unable to write to ptable file:" << ptable_filename << endl;
-        throw runtime_error("unable to open ptable file to write");
+    NGramText<CharT, Traits> text;
+    text.open(m_filename_base + ".ngram",m_compress_text);
+
+    ofstream ptable_file;
+    if (!stream) {
+        ptable_file.open(ptable_filename.c_str(),ios::binary);
+        if (!ptable_file) {
+            cerr << "unable to write to ptable file:" << ptable_filename << endl;
+            throw runtime_error("unable to open ptable file to write");
+        }
     }
 
     //now merging
     cerr << "Merging " << files_to_merge << " temporary ptables..." << endl;
 
-    assert (files_to_merge == ptables.size());
+    PackedWriter out(ptable_file,m_ptable_bits);
+    unsigned prev = 0;
+    bool first = true;
     int rc;
-
-    if (m_is_use_mmap) { //{{{
-        PTable_attr* min;
-        while (files_to_merge > 0) {
-            min = 0;
-            //set min to first ptable needed to merge
-            for (unsigned i = 0;i < ptables.size(); ++i ) {
-                if (ptables[i].mp_pos < ptables[i].mp_end) {
-                    min = &ptables[i];
-                    break;
-                }
+    PTable_attr* min;
+    while (files_to_merge > 0) {
+        min = 0;
+        for (unsigned i = 0;i < ptables.size(); ++i ) {
+            PTable_attr& attr = ptables[i];
+            if (attr.m_pos >= attr.m_size)
+                continue;
+
+            if (!min) {
+                min = &attr;
+                continue;
             }
 
-            assert(min);
-
-            for (unsigned i = 0;i < ptables.size(); ++i ) {
-                PTable_attr& attr = ptables[i];
-                if (attr.mp_pos < attr.mp_end && min != &ptables[i]) {
-//                    rc = wcsncmp((const wchar_t*)&ngram_table[*attr.mp_pos],
-//                            (const wchar_t*)&ngram_table[*(min->mp_pos)],255);
-                    rc = Traits::compare((const CharT*)&ngram_table[*attr.mp_pos],
-                            (const CharT*)&ngram_table[*(min->mp_pos)],255);
-                    if (rc < 0 || (rc == 0 && *attr.mp_pos < *(min->mp_pos)))
-                        min = &ptables[i];
-                }
-            }
+            rc = text.compare(attr.m_offset,min->m_offset,255);
+            if (rc < 0 || (rc == 0 && attr.m_offset < min->m_offset))
+                min = &attr;
+        }
 
-            assert(min);
+        assert(min);
 
-            ptable_file.write((char*)min->mp_pos,sizeof(unsigned));
+        if (stream) {
+            //count the suffix right away instead of writing it
+            unsigned lcp = first ? 0 : text.common_prefix(prev,min->m_offset);
+            if (stream->push(lcp))
+                stream->start(text,min->m_offset);
+            prev  = min->m_offset;
+            first = false;
+        } else {
+            out.push_back(min->m_offset);
+        }
 
-            if (++(min->mp_pos) >= min->mp_end) {
-//                mmap files will be closed on clean up
-//                if (min->m_size > 0)
-//                    munmap_file(min->mp_addr,min->m_size);
-                --files_to_merge;
-            }
-        }//}}}
-    } else { //do not use mmap() {{{
-        PTable_attr* min;
-        while (files_to_merge > 0) {
-            min = 0;
-            //set min to first ptable needed to merge
-            for (unsigned i = 0;i < ptables.size(); ++i ) {
-                if (ptables[i].m_pos < ptables[i].m_end) {
-                    min = &ptables[i];
-                    break;
-                }
-            }
+        if (++min->m_pos < min->m_size)
+            load_ptable_attr(*min);
+        else
+            --files_to_merge;
+    }
 
-            assert(min);
+    if (stream) {
+        //the text of the last n-grams is fetched from text
+        stream->finish();
+    } else {
+        out.flush();
+        ptable_file.close();
 
-            if (fseek(min->m_fp,min->m_pos,SEEK_SET) == -1 ||
-                    fread(&min->m_offset,sizeof(unsigned),1,min->m_fp) != 1 ) {
-                perror("error reading temporary ptable file");
-                exit(EXIT_FAILURE);
-            }
-            /*
-            if (lseek(min->m_fd,min->m_pos,SEEK_SET) == -1 ) {
-                perror("error reading temporary ptable file");
-                exit(EXIT_FAILURE);
-            }
-            */
-            //int size;
-            //size = read(min->m_fd,&min->m_offset,sizeof(unsigned));
-            /*
-            size = fread(&min->m_offset,sizeof(unsigned),1,min->m_fp);
-            if (size != 1)
-                cerr << "read return:"<<size<< endl;
-                */
-            /*
-            if (lseek(min->m_fd,min->m_pos,SEEK_SET) == -1 ||
-                    read(min->m_fd,&min->m_offset,sizeof(unsigned)) != sizeof(unsigned)) {
-                perror("error reading temporary ptable file");
-                exit(EXIT_FAILURE);
-            }
-            */
-
-            for (unsigned i = 0;i < ptables.size(); ++i ) {
-                PTable_attr& attr = ptables[i];
-                if (attr.m_pos < attr.m_end && min != &ptables[i]) {
-                    if (fseek(attr.m_fp,attr.m_pos,SEEK_SET) == -1 ||
-                            fread(&attr.m_offset,sizeof(unsigned),1,attr.m_fp) != 1) {
-                        perror("error reading temporary ptable file");
-                        exit(EXIT_FAILURE);
-                    }
-                    //size = read(attr.m_fd,&attr.m_offset,sizeof(unsigned));
-                    /*
-                    size = fread(&attr.m_offset,sizeof(unsigned),1,attr.m_fp);
-
-                    if (size != 1)
-                        cerr << "read2 return:"<<size<< endl;
-                        */
-                    /*
-                       if (lseek(attr.m_fd,attr.m_pos,SEEK_SET) == -1 ||
-                       read(attr.m_fd,&attr.m_offset,sizeof(unsigned)) != sizeof(unsigned)) {
-                       perror("error reading temporary ptable file");
-                       exit(EXIT_FAILURE);
-                       }
-                       */
-
-//                    rc = wcsncmp((const wchar_t*)&ngram_table[attr.m_offset],
-//                            (const wchar_t*)&ngram_table[min->m_offset],255);
-                    rc = Traits::compare((const CharT*)&ngram_table[attr.m_offset],
-                            (const CharT*)&ngram_table[min->m_offset],255);
-                    if (rc < 0 || (rc == 0 && attr.m_offset < min->m_offset)) {
-                        min = &ptables[i];
-                    }
-                }
-            }
+        if (m_checkpoint) {
+            checkpoint(ParseState::MERGED);
+            m_pending.m_ptable_size = ptable_size;
+            commit_checkpoint();
+        }
 
-            assert(min);
+        write_ltable(text,ptable_filename,ptable_size);
+    }
 
-            ptable_file.write((char*)&min->m_offset,sizeof(unsigned));
+    //clean up
+    for (size_t i = 0;i < fm_objs.size(); ++i)
+        delete fm_objs[i];
 
-            min->m_pos += sizeof(unsigned);
+    for (unsigned i = 0;i < ptables.size(); ++i)
+        if (ptables[i].m_fp && fclose(ptables[i].m_fp) == EOF)
+            perror("unable to close temporary ptable file");
 
-            if (min->m_pos >= min->m_end) {
-                if (min->m_size > 0)
-                    if (fclose(min->m_fp) == EOF)
-                    //if (close(min->m_fd) == -1)
-                        perror("unable to close temporary ptable file");
-                --files_to_merge;
-            }
+    remove_temp_runs();
+}
+
+// the ptable and ltable of a shard being merged by merge_shards()
+struct ShardCursor {
+    const boost::uint64_t* m_ptable;
+    const unsigned char*   m_ltable;
+    const unsigned*        m_seams;  //instead of the above: sorted offsets
+    unsigned               m_bits;   //width of packed entries
+    unsigned               m_base;   //where the shard starts in the text
+    unsigned               m_limit;  //its suffixes from here on are seams
+    size_t                 m_pos;    //index of current entry
+    size_t                 m_size;   //number of entries
+    unsigned               m_offset; //current entry: offset in the text
+};
+
+// move to the first entry from m_pos on which is not a seam, false if none
+inline bool load_shard_cursor(ShardCursor& c) {
+    for (;c.m_pos < c.m_size; ++c.m_pos) {
+        if (c.m_seams) {
+            c.m_offset = c.m_seams[c.m_pos];
+            return true;
         }
-    } //}}}
+        unsigned offset = packed_get(c.m_ptable,c.m_bits,c.m_pos);
+        if (offset < c.m_limit) {
+            c.m_offset = c.m_base + offset;
+            return true;
+        }
+    }
+    return false;
+}
 
-    ptable_file.close();
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::merge_shards(const vector<NGramStat*>& shards) {
+    assert(!m_filename_base.empty());
+    assert(!m_buffer);
+    mem_budget().phase("merging");
+    cerr << "Merging " << shards.size() << " shards into "
+        << m_filename_base << endl;
+
+    //the text of the index is the shard texts one after another
+    vector<unsigned> bases;
+    vector<unsigned> sizes;
+    boost::uint64_t text_size = 0;
+    open_ngram_file();
+    vector<char> buf(1 << 20);
+    charge("copy buffer", buf.size());
+    for (size_t k = 0;k < shards.size(); ++k) {
+        string name = shards[k]->m_filename_base + ".ngram";
+        ifstream f(name.c_str(),ios::binary);
+        if (!f)
+            throw runtime_error("unable to open ngram file of shard");
+        f.seekg(0,ios::end);
+        boost::uint64_t size = boost::uint64_t(f.tellg()) / sizeof(CharT) - 1;
+        f.seekg(0);
+        bases.push_back(unsigned(text_size));
+        sizes.push_back(unsigned(size));
+        text_size += size;
+        if (text_size > ~0u)
+            throw runtime_error("text too large for one index");
+
+        for (boost::uint64_t left = size * sizeof(CharT); left > 0;) {
+            size_t n = size_t(min(left,boost::uint64_t(buf.size())));
+            f.read(&buf[0],n);
+            m_ngramfile.write(&buf[0],n);
+            left -= n;
+        }
+        if (!f)
+            throw runtime_error("fail to read ngram file of shard");
+    }
+    m_ngramfile.write((const char*)&s_terminal,sizeof(CharT));
+    m_ngramfile.close();
+    charge("copy buffer", 0);
+    if (!m_ngramfile)
+        throw runtime_error("fail to write ngram file");
+
+    NGramText<CharT, Traits> text;
+    text.open(m_filename_base + ".ngram",false);
+
+    //a shard's suffixes in its last 255 symbols now run on into the
+    //next shard, they are sorted again on their own
+    vector<unsigned> seams;
+    vector<ShardCursor> cursors(shards.size() + 1);
+    vector<MmapFile*> fm_objs;
+    size_t active = 0;
+    for (size_t k = 0;k < cursors.size(); ++k) {
+        ShardCursor& c = cursors[k];
+        c.m_ptable = 0;
+        c.m_ltable = 0;
+        c.m_seams  = 0;
+        c.m_bits   = 0;
+        c.m_base   = 0;
+        c.m_limit  = 0;
+        c.m_pos    = 0;
+        c.m_size   = 0;
+        c.m_offset = 0;
+        if (k == shards.size()) {
+            sort(seams.begin(),seams.end(),cmp_text(text));
+            charge("seams", seams.capacity() * sizeof(unsigned));
+            c.m_seams = seams.empty() ? 0 : &seams[0];
+            c.m_size  = seams.size();
+        } else {
+            unsigned tail = k + 1 < shards.size() ? min(sizes[k],255u) : 0;
+            for (unsigned i = sizes[k] - tail;i < sizes[k]; ++i)
+                seams.push_back(bases[k] + i);
+            if (sizes[k] == 0)
+                continue;
+
+            const string& base = shards[k]->m_filename_base;
+            MmapFile* ptable = new MmapFile((base + ".ptable").c_str());
+            fm_objs.push_back(ptable);
+            MmapFile* ltable = new MmapFile((base + ".ltable").c_str());
+            fm_objs.push_back(ltable);
+            if (!ptable->open() || !ltable->open())
+                throw runtime_error("unable to mmap() ptable and ltable of shard");
+            c.m_ptable = (const boost::uint64_t*)ptable->addr();
+            c.m_ltable = (const unsigned char*)ltable->addr();
+            c.m_bits   = shards[k]->ptable_bits();
+            c.m_base   = bases[k];
+            c.m_limit  = sizes[k] - tail;
+            c.m_size   = ltable->size();
+        }
+        if (load_shard_cursor(c))
+            ++active;
+    }
 
-    write_ltable(ngram_table,ptable_filename);
+    string ptable_filename = m_filename_base + ".ptable";
+    string ltable_filename = m_filename_base + ".ltable";
+    ofstream ptable_file(ptable_filename.c_str(),ios::binary);
+    ofstream ltable_file(ltable_filename.c_str(),ios::binary);
+    if (!ptable_file || !ltable_file)
+        throw runtime_error("unable to open ptable and ltable files to write");
+    m_ptable_bits = packed_bits(unsigned(text_size));
+    PackedWriter out(ptable_file,m_ptable_bits);
+    vector<unsigned char> lcps;
+    lcps.reserve(s_ltable_block);
+    charge("ltable block", lcps.capacity());
+
+    //a shard's lcp is kept if its entry follows the same one as there
+    cmp_text cmp_obj(text);
+    const ShardCursor* prev = 0;
+    size_t prev_pos = 0;
+    unsigned prev_offset = 0;
+    while (active > 0) {
+        ShardCursor* min = 0;
+        for (size_t k = 0;k < cursors.size(); ++k) {
+            ShardCursor& c = cursors[k];
+            if (c.m_pos < c.m_size && (!min || cmp_obj(c.m_offset,min->m_offset)))
+                min = &c;
+        }
+        assert(min);
+
+        unsigned char lcp = 0;
+        if (prev == min && prev_pos + 1 == min->m_pos && min->m_ltable)
+            lcp = min->m_ltable[min->m_pos];
+        else if (prev)
+            lcp = text.common_prefix(prev_offset,min->m_offset);
+        out.push_back(min->m_offset);
+        lcps.push_back(lcp);
+        if (lcps.size() == lcps.capacity()) {
+            ltable_file.write((char*)&lcps[0],lcps.size());
+            lcps.clear();
+        }
+        prev        = min;
+        prev_pos    = min->m_pos;
+        prev_offset = min->m_offset;
 
-    //clean up
-    // munmap_file(ngram_table,ngram_table_size);
+        ++min->m_pos;
+        if (!load_shard_cursor(*min))
+            --active;
+    }
+    out.flush();
+    if (!lcps.empty())
+        ltable_file.write((char*)&lcps[0],lcps.size());
+    charge("ltable block", 0);
+    charge("seams", 0);
+    if (!ptable_file || !ltable_file)
+        throw runtime_error("fail to write ptable and ltable files");
+    ptable_file.close();
+    ltable_file.close();
 
     for (size_t i = 0;i < fm_objs.size(); ++i)
         delete fm_objs[i];
+    text.close();
+    if (m_compress_text)
+        compress_ngram_file();
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::append_begin(unsigned bits) {
+    assert(!m_filename_base.empty());
+    assert(!m_is_temp_index);
+
+    string name = m_filename_base + ".ngram";
+    ifstream f(name.c_str(),ios::binary);
+    if (!f)
+        throw runtime_error("unable to open ngram file to append to");
+    f.seekg(0,ios::end);
+    boost::uint64_t size = boost::uint64_t(f.tellg()) / sizeof(CharT);
+    if (size == 0 || size - 1 > ~0u)
+        throw runtime_error("ngram file of wrong size to append to");
+
+    //suffixes this close to the end compare differently now
+    unsigned text_size = unsigned(size - 1);
+    unsigned tail = min(text_size,255u);
+    string_type buf(tail + 1,s_terminal);
+    f.seekg(boost::uint64_t(text_size - tail) * sizeof(CharT));
+    f.read((char*)&buf[0],(tail + 1) * sizeof(CharT));
+    if (!f || buf[tail] != s_terminal)
+        throw runtime_error("ngram file does not end with a terminal");
+    buf.resize(tail);
+
+    m_append_base     = m_filename_base;
+    m_append_bits     = bits;
+    m_append_size     = text_size;
+    m_append_offset   = text_size - tail;
+    m_append_compress = m_compress_text;
+
+    //the new text goes into a temporary index of raw text first
+    m_compress_text = false;
+    m_filename_base = next_temp_ptable_filename();
+    m_is_temp_index = true;
+    parse_begin();
+    if (!buf.empty())
+        parse_buf(buf);
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::append_end() {
+    assert(!m_append_base.empty());
+
+    finish_parse(0);
+    merge_append();
+
+    remove_temp_index();
+    m_is_temp_index = false;
+    m_filename_base = m_append_base;
+    m_append_base.clear();
+    m_compress_text = m_append_compress;
+    if (m_compress_text)
+        compress_ngram_file();
+}
+
+/**
+ * merge the temporary index of the appended text into the old index.
+ * The old ptable is copied in order, except for the suffixes in the last
+ * 255 symbols of the old text, which the temporary index holds again.
+ * Each new suffix is inserted where a galloping search over the old
+ * ptable puts it, so the text is only read around new suffixes. An
+ * ltable entry is copied whenever its suffix follows the same one as
+ * before, and computed otherwise
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::merge_append() {
+    mem_budget().phase("merging");
+    cerr << "Merging appended text into " << m_append_base << endl;
+
+    unsigned new_bits = m_ptable_bits;
+    string ptable_tmp = m_append_base + ".ptable.tmp";
+    string ltable_tmp = m_append_base + ".ltable.tmp";
+    size_t text_size;
+    {
+        MmapFile old_text((m_append_base + ".ngram").c_str());
+        MmapFile old_ptable((m_append_base + ".ptable").c_str());
+        MmapFile old_ltable((m_append_base + ".ltable").c_str());
+        MmapFile new_text((m_filename_base + ".ngram").c_str());
+        MmapFile new_ptable((m_filename_base + ".ptable").c_str());
+        MmapFile new_ltable((m_filename_base + ".ltable").c_str());
+        if (!old_text.open() || !old_ptable.open() || !old_ltable.open() ||
+                !new_text.open() || !new_ptable.open() || !new_ltable.open())
+            throw runtime_error("unable to mmap() index files to merge");
+
+        const CharT* otext = (const CharT*)old_text.addr();
+        const CharT* ntext = (const CharT*)new_text.addr();
+        const boost::uint64_t* optable = (const boost::uint64_t*)old_ptable.addr();
+        const boost::uint64_t* nptable = (const boost::uint64_t*)new_ptable.addr();
+        const unsigned char* oltable = (const unsigned char*)old_ltable.addr();
+        const unsigned char* nltable = (const unsigned char*)new_ltable.addr();
+        size_t osize = old_ltable.size();
+        size_t nsize = new_ltable.size();
+        text_size = new_text.size() / sizeof(CharT);
+        if (m_append_offset + boost::uint64_t(text_size) - 1 > ~0u)
+            throw runtime_error("text too large to append to the index");
+        m_ptable_bits = packed_bits(m_append_offset + text_size - 1);
+
+        ofstream ptable_file(ptable_tmp.c_str(),ios::binary);
+        ofstream ltable_file(ltable_tmp.c_str(),ios::binary);
+        if (!ptable_file || !ltable_file)
+            throw runtime_error("unable to open ptable and ltable files to write");
+        PackedWriter out(ptable_file,m_ptable_bits);
+        vector<unsigned char> lcps;
+        lcps.reserve(s_ltable_block);
+        charge("ltable block", lcps.capacity());
+
+        //where the last entry written came from
+        const unsigned char* prev_ltable = 0;
+        size_t               prev_index  = 0;
+        const CharT*         prev_text   = 0;
+
+        size_t i = 0; //next old entry
+        for (size_t j = 0;j <= nsize; ++j) {
+            const CharT* key = 0;
+            size_t end = osize;
+            if (j < nsize) {
+                //first old entry after new suffix j: gallop, then bisect
+                key = ntext + packed_get(nptable,new_bits,j);
+                size_t lo = i;
+                size_t hi = i;
+                size_t step = 1;
+                while (hi < osize && compare_suffix(otext +
+                            packed_get(optable,m_append_bits,hi),key) <= 0) {
+                    lo = hi + 1;
+                    hi += step;
+                    step *= 2;
+                }
+                hi = min(hi,osize);
+                while (lo < hi) {
+                    size_t mid = lo + (hi - lo) / 2;
+                    if (compare_suffix(otext +
+                                packed_get(optable,m_append_bits,mid),key) <= 0)
+                        lo = mid + 1;
+                    else
+                        hi = mid;
+                }
+                end = lo;
+            }
+
+            for (;i <= end; ++i) {
+                const unsigned char* ltable;
+                const CharT* text;
+                size_t index;
+                unsigned offset;
+                if (i < end) {
+                    offset = packed_get(optable,m_append_bits,i);
+                    if (offset >= m_append_offset)
+                        continue; //indexed again with the new text
+                    ltable = oltable;
+                    text   = otext + offset;
+                    index  = i;
+                } else if (key) {
+                    ltable = nltable;
+                    text   = key;
+                    index  = j;
+                    offset = m_append_offset + unsigned(key - ntext);
+                } else {
+                    break;
+                }
+
+                unsigned char lcp = 0;
+                if (prev_ltable == ltable && prev_index + 1 == index)
+                    lcp = ltable[index];
+                else if (prev_text)
+                    lcp = calc_common_words(prev_text,text);
+                out.push_back(offset);
+                lcps.push_back(lcp);
+                if (lcps.size() == lcps.capacity()) {
+                    ltable_file.write((char*)&lcps[0],lcps.size());
+                    lcps.clear();
+                }
+                prev_ltable = ltable;
+                prev_index  = index;
+                prev_text   = text;
+
+                if (i == end)
+                    break;
+            }
+        }
+        out.flush();
+        if (!lcps.empty())
+            ltable_file.write((char*)&lcps[0],lcps.size());
+        charge("ltable block", 0);
+        if (!ptable_file || !ltable_file)
+            throw runtime_error("fail to write ptable and ltable files");
+    }
+
+    //truncating the old text drops its terminal, then the temporary text
+    //is appended without the old tail it starts with, so the new text runs
+    //on directly and its terminal ends the file
+    string name = m_append_base + ".ngram";
+    if (truncate(name.c_str(),off_t(m_append_size) * sizeof(CharT)) != 0) {
+        perror(name.c_str());
+        throw runtime_error("unable to truncate ngram file to append to");
+    }
+    {
+        MmapFile new_text((m_filename_base + ".ngram").c_str());
+        if (!new_text.open())
+            throw runtime_error("unable to mmap() ngram file to append");
+        ofstream f(name.c_str(),ios::binary | ios::app);
+        unsigned tail = m_append_size - m_append_offset;
+        f.write((const char*)new_text.addr() + tail * sizeof(CharT),
+                (text_size - tail) * sizeof(CharT));
+        if (!f)
+            throw runtime_error("fail to append to ngram file");
+    }
+
+    if (rename(ptable_tmp.c_str(),(m_append_base + ".ptable").c_str()) != 0 ||
+            rename(ltable_tmp.c_str(),(m_append_base + ".ltable").c_str()) != 0) {
+        perror(m_append_base.c_str());
+        throw runtime_error("unable to replace ptable and ltable files");
+    }
+}
+
+/**
+ * Traits::compare() of the (max 255) symbols of two suffixes, the
+ * comparison ends at the terminal of either
+ */
+template <typename CharT,typename Traits>
+int NGramStat<CharT, Traits>::compare_suffix(const CharT* s1,const CharT* s2) const {
+    for (unsigned i = 0;i < 255; ++i) {
+        if (!Traits::eq(s1[i],s2[i]))
+            return Traits::lt(s1[i],s2[i]) ? -1 : 1;
+        if (s1[i] == s_terminal)
+            break;
+    }
+    return 0;
+}
 
-    for (unsigned i = 0;i < m_tempfiles.size();++i)
-        if (remove(m_tempfiles[i].c_str())) {
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::remove_temp_runs() const {
+    for (unsigned i = 0;i < m_tempruns.size();++i)
+        if (remove(m_tempruns[i].m_name.c_str())) {
             string s = "unable to remove file:";
-            s += m_tempfiles[i];
+            s += m_tempruns[i].m_name;
             perror(s.c_str());
         }
 }
 
-//return next temp ptable filename
 template <typename CharT,typename Traits>
-string NGramStat<CharT, Traits>::next_temp_ptable_filename() const {
-    return next_temp_filename("NGramStat");
+void NGramStat<CharT, Traits>::set_temp_dir(const string& dirs) {
+    split(dirs, m_temp_dirs, ",");
+    m_next_temp_dir = 0;
+}
+
+//return next temp ptable filename, taking the temp dirs in turn
+template <typename CharT,typename Traits>
+string NGramStat<CharT, Traits>::next_temp_ptable_filename() {
+    string name = next_temp_filename("NGramStat");
+    if (m_temp_dirs.empty())
+        return name;
+
+    const string& dir = m_temp_dirs[m_next_temp_dir];
+    m_next_temp_dir = (m_next_temp_dir + 1) % m_temp_dirs.size();
+    return dir + "/" + name;
 }
+/**
+ * name of run k (counting from 0) of the index, taking the temp dirs in
+ * turn. It only depends on the file name base and k, so that resume()
+ * finds the runs of the process it goes on from
+ */
+template <typename CharT,typename Traits>
+string NGramStat<CharT, Traits>::temp_run_filename(size_t k) const {
+    char suffix[32];
+    sprintf(suffix, ".run%u.tmp", unsigned(k));
+    if (m_temp_dirs.empty())
+        return m_filename_base + suffix;
+
+    string base = m_filename_base.substr(m_filename_base.rfind('/') + 1);
+    return m_temp_dirs[k % m_temp_dirs.size()] + "/" + base + suffix;
+}
+
+/**
+ * remove the runs following m_tempruns, which were (being) written after
+ * the checkpoint resumed from and are not part of the build any more
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::remove_orphan_runs() const {
+    for (size_t k = m_tempruns.size(); ; ++k) {
+        string name = temp_run_filename(k);
+        if (unlink(name.c_str()) != 0) {
+            if (errno != ENOENT)
+                perror(name.c_str());
+            break;
+        }
+        cerr << "Remove run " << name << " written after the checkpoint" << endl;
+    }
+}
+
 /**
  * calculate common words(max 255) from the beginning of s1 and s2
  */
@@ -815,6 +1500,61 @@ unsigned char NGramStat<CharT, Traits>::calc_common_words(const CharT* s1,const
     return count;
 }
 
+/**
+ * out[i] = common words of the suffixes at offsets[i] and offsets[i + 1],
+ * for i < count. text is the ngram table to read, 0 for the text buffer
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::calc_lcps(const NGramText<CharT, Traits>* text,
+        const unsigned* offsets, size_t count, unsigned char* out) const {
+    if (text) {
+        for (size_t i = 0;i < count; ++i)
+            out[i] = text->common_prefix(offsets[i],offsets[i + 1]);
+    } else {
+        for (size_t i = 0;i < count; ++i)
+            out[i] = calc_common_words(&m_buffer[offsets[i]],
+                    &m_buffer[offsets[i + 1]]);
+    }
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::LcpJob::operator()() const {
+    m_stat->calc_lcps(m_text,m_offsets,m_count,m_out);
+}
+
+/**
+ * calc_lcps() with the pairs cut into one chunk per thread. Neighbouring
+ * chunks share an offset but write disjoint parts of out
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::calc_lcps_parallel(
+        const NGramText<CharT, Traits>* text,
+        const unsigned* offsets, size_t count, unsigned char* out) const {
+    // not worth starting threads for small tables
+    size_t threads = m_threads;
+    if (threads > count / 65536)
+        threads = count / 65536;
+    if (threads <= 1) {
+        calc_lcps(text,offsets,count,out);
+        return;
+    }
+
+    boost::shared_array<Thread> workers(new Thread[threads]);
+    size_t step = (count + threads - 1) / threads;
+    for (size_t t = 0;t < threads; ++t) {
+        size_t begin = min(count,t * step);
+        LcpJob job;
+        job.m_stat    = this;
+        job.m_text    = text;
+        job.m_offsets = offsets + begin;
+        job.m_count   = min(count,(t + 1) * step) - begin;
+        job.m_out     = out + begin;
+        workers[t].start(job);
+    }
+    for (size_t t = 0;t < threads; ++t)
+        workers[t].join();
+}
+
 /**
  * parse a string in given encoding
  */
@@ -873,60 +1613,156 @@ unsigned char NGramStat<CharT, Traits>::calc_common_words(const CharT* s1,const
 //    parse_end();
 //}
 //
+template <typename CharT,typename Traits>
+NGramStat<CharT, Traits>::Extractor::Extractor(unsigned N, unsigned M,
+        unsigned freq, unsigned top, OutputFunc& output,
+        CountTableWriter* table)
+:
+m_N(N),
+m_M(M),
+m_freq(freq),
+m_top(top),
+m_from(N),
+m_output(output),
+m_table(table),
+m_text(0),
+m_offset(0),
+m_fetched(false),
+m_counts(M + 1, 0),
+m_best(top ? M + 1 : 0)
+{
+    assert(N >= 1 && N <= M);
+}
+
+template <typename CharT,typename Traits>
+bool NGramStat<CharT, Traits>::Extractor::push(unsigned lcp) {
+    if (lcp >= m_M) {
+        //increasing N-gram count in [N,M]
+        for (unsigned j = m_N;j <= m_M;++j)
+            ++m_counts[j];
+        return false;
+    }
+
+    //increasing N-gram count in [N,lcp], the longer ones end here
+    m_from = lcp < m_N ? m_N : lcp + 1;
+    for (unsigned j = m_N;j < m_from;++j)
+        ++m_counts[j];
+    flush(m_from);
+    return true;
+}
+
 /**
- * fetch a N gram from the beginning of s
- * if no N-gram found at s,set ngram to L""
+ * start m_from to M-grams at the suffix at offset
+ * the n-grams shorter than m_from go on, they are prefixes of it as well
  */
 template <typename CharT,typename Traits>
-void NGramStat<CharT, Traits>::fetch_ngram(unsigned N,CharT* s,string_type& ngram) const{
-    ngram.clear();
+void NGramStat<CharT, Traits>::Extractor::start(
+        const NGramText<CharT, Traits>& text, unsigned offset) {
+    m_text = &text;
+    m_offset = offset;
+    m_fetched = false;
+
+    for (unsigned n = m_from;n <= m_M; ++n)
+        m_counts[n] = 1;
+}
 
-    //Simply counting every char including punctuations and blanks
-    while (N > 0 && *s) {
-        ngram += *s++;
-        --N;
+/**
+ * whether the last suffix started is n symbols long or more, fetching up
+ * to M of them into m_prefix
+ */
+template <typename CharT,typename Traits>
+bool NGramStat<CharT, Traits>::Extractor::has_prefix(unsigned n) {
+    if (!m_fetched) {
+        //Simply counting every char including punctuations and blanks
+        const CharT* s = m_text->fetch(m_offset,m_M,m_fetch_buf);
+        m_prefix.clear();
+        while (m_prefix.size() < m_M && *s)
+            m_prefix += *s++;
+        m_fetched = true;
     }
-
-    if (N != 0)
-        ngram.clear();
+    return n <= m_prefix.size();
 }
 
 /**
- * this function behaves essentially like the above function
- * except it fetches N to M-gram(N<=M) from the beginning of s
- * and store them in a vector of ustring
- * if N-gram is not found in s,store a L""
+ * put out the m_from to M-grams ending now, their text is fetched only
+ * when they are frequent enough. An n-gram's offset is that of the last
+ * suffix started, which begins with it. Only an n-gram counted once can
+ * run past the end of the text, the count table needs no text else
  */
 template <typename CharT,typename Traits>
-void NGramStat<CharT, Traits>::fetch_ngrams(unsigned N,unsigned M,CharT* s,vector<NGram>& ngrams) const{
-    assert(N <= M);
-    assert(ngrams.size() >= M + 1);
-
-    string_type  ngram;
-    unsigned n;
-
-    for (n = N;n <= M; ++n)
-        ngrams[n].m_text.clear();
-
-    //Simply counting every char including punctuations and blanks
-    for (n = 1; n <= M && *s;++n) {
-        ngram += *s++;
-        if (n >= N) {
-            ngrams[n].m_text = ngram;
-            ngrams[n].m_count = 1;
+void NGramStat<CharT, Traits>::Extractor::flush(unsigned from) {
+    for (unsigned j = from;j <= m_M;++j) {
+        if (m_counts[j] < m_freq)
+            continue;
+        if ((m_counts[j] == 1 || !m_table) && !has_prefix(j))
+            break;
+        if (m_table) {
+            m_table->add(j,m_offset,m_counts[j]);
+        } else if (m_top) {
+            keep(j);
+        } else {
+            m_ngram.assign(m_prefix, 0, j);
+            m_output(m_ngram,m_counts[j]);
         }
     }
 }
 
+/**
+ * offer the n-gram of length n to the heap of the top n-grams. N-grams
+ * come in symbol order, so one only replaces the worst if it is more
+ * frequent
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::Extractor::keep(unsigned n) {
+    vector<NGram>& best = m_best[n];
+    MoreFrequent more;
+
+    if (best.size() < m_top) {
+        best.push_back(NGram());
+    } else if (m_counts[n] > best.front().m_count) {
+        pop_heap(best.begin(), best.end(), more);
+    } else {
+        return;
+    }
+
+    best.back().m_text.assign(m_prefix, 0, n);
+    best.back().m_count = m_counts[n];
+    push_heap(best.begin(), best.end(), more);
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::Extractor::finish() {
+    flush(m_N);
+    if (!m_top)
+        return;
+
+    for (unsigned n = m_N;n <= m_M;++n) {
+        vector<NGram>& best = m_best[n];
+        sort_heap(best.begin(), best.end(), MoreFrequent());
+        for (size_t i = 0;i < best.size();++i)
+            m_output(best[i].m_text,best[i].m_count);
+        vector<NGram>().swap(best);
+    }
+}
+
 /**
  * fetch a entry of ptable from m_ptable, mmaped ptable or ptable file
  * depending on access method used
  */
 template <typename CharT,typename Traits>
-unsigned NGramStat<CharT, Traits>::ptable_entry(unsigned* ptable,FILE* fp,unsigned pos) const {
+unsigned NGramStat<CharT, Traits>::ptable_entry(const void* ptable,FILE* fp,unsigned pos) const {
     if (ptable) {
         assert(m_is_use_mmap);
-        return ptable[pos];
+        if (m_ptable_bits)
+            return packed_get((const boost::uint64_t*)ptable,m_ptable_bits,pos);
+        return ((const unsigned*)ptable)[pos];
+    } else if (fp && m_ptable_bits) {
+        boost::uint64_t entry;
+        if (!packed_get(fp,m_ptable_bits,pos,entry)) {
+            perror("error reading ptable file");
+            throw runtime_error("error when reading ptable file");
+        }
+        return entry;
     } else if (fp) {
         unsigned entry;
         if (fseek(fp,pos * sizeof(unsigned),SEEK_SET) == -1 ||
@@ -995,10 +1831,124 @@ unsigned char NGramStat<CharT, Traits>::ltable_entry(unsigned char* ltable,FILE*
 template <typename CharT,typename Traits>
 void NGramStat<CharT, Traits>::extract_ngram(unsigned N, unsigned M, unsigned freq,
         OutputFunc& output) {
-    CharT*         ngramtable      = m_buffer;
-    unsigned       ngramtable_size = m_buffer_offset;
-    unsigned*      ptable          = 0;
-    unsigned       ptable_size     = m_ptable->size();
+    scan_index(N,M,freq,output,0);
+}
+
+/**
+ * Count every distinct N to M-gram of the index into the count table
+ * file, the scan is that of extract_ngram()
+ */
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::save_counts(unsigned N, unsigned M) {
+    assert(!m_filename_base.empty());
+    OutputFunc none;
+    CountTableWriter table(m_filename_base + ".counts",N,M,
+            index_stamp(m_filename_base));
+    scan_index(N,M,1,none,&table);
+    cerr << "Writing count tables..." << endl;
+    table.finish();
+}
+
+/**
+ * The n-grams with count >= freq are the first entries of each length.
+ * With set_top() the first of them are put out as they are, else they are
+ * put back into the order of the scan by their ranks. Unless by_length,
+ * the lengths are then merged by rank, which needs them all in memory
+ */
+template <typename CharT,typename Traits>
+bool NGramStat<CharT, Traits>::extract_counts(unsigned N, unsigned M,
+        unsigned freq, bool by_length, OutputFunc& output) {
+    if (m_filename_base.empty())
+        return false;
+
+    //the tables are only a cache, any trouble with them means scanning
+    string counts_filename = m_filename_base + ".counts";
+    CountTable table;
+    try {
+        if (!table.open(counts_filename))
+            return false;
+    } catch (runtime_error& e) {
+        cerr << "ignore " << counts_filename << ": " << e.what() << endl;
+        return false;
+    }
+    if (!(table.stamp() == index_stamp(m_filename_base))) {
+        cerr << "ignore " << counts_filename << ", it was built from another index" << endl;
+        return false;
+    }
+    if (N < table.min_n() || M > table.max_n())
+        return false;
+
+    if (!by_length && !m_top) {
+        boost::uint64_t total = 0;
+        for (unsigned n = N;n <= M;++n)
+            total += table.frequent(n,freq);
+        if (total * sizeof(CountTable::Entry) > mem_budget().available()) {
+            cerr << "ignore " << counts_filename
+                << ", its n-grams do not fit into the memory budget" << endl;
+            return false;
+        }
+    }
+
+    clear();
+    NGramText<CharT, Traits> ngramtable;
+    ngramtable.open(m_filename_base + ".ngram",m_compress_text);
+    CharT fetch_buf[256];
+    string_type ngram;
+    vector<vector<typename CountTable::Entry> > lengths(M - N + 1);
+    size_t held = 0;
+
+    cerr << "Extracting n-grams from " << counts_filename << endl;
+    for (unsigned n = N;n <= M;++n) {
+        vector<typename CountTable::Entry>& entries = lengths[n - N];
+        boost::uint64_t size = table.frequent(n,freq);
+        if (m_top && size > m_top)
+            size = m_top;
+        table.read(n,0,size_t(size),entries);
+        if (!m_top)
+            sort(entries.begin(),entries.end(),RankLess());
+        if (!by_length && !m_top) {
+            held += entries.capacity() * sizeof(typename CountTable::Entry);
+            charge("count table entries", held);
+            continue;
+        }
+
+        for (size_t i = 0;i < entries.size();++i) {
+            ngram.assign(ngramtable.fetch(entries[i].m_offset,n,fetch_buf),n);
+            output(ngram,entries[i].m_count);
+        }
+        vector<typename CountTable::Entry>().swap(entries);
+    }
+    if (by_length || m_top)
+        return true;
+
+    //merge the lengths by rank, taking the earliest of their next entries
+    vector<size_t> next(lengths.size(), 0);
+    for (;;) {
+        size_t best = lengths.size();
+        for (size_t k = 0;k < lengths.size();++k) {
+            if (next[k] < lengths[k].size() && (best == lengths.size() ||
+                        RankLess()(lengths[k][next[k]],
+                            lengths[best][next[best]])))
+                best = k;
+        }
+        if (best == lengths.size())
+            break;
+
+        const typename CountTable::Entry& e = lengths[best][next[best]++];
+        unsigned n = unsigned(N + best);
+        ngram.assign(ngramtable.fetch(e.m_offset,n,fetch_buf),n);
+        output(ngram,e.m_count);
+    }
+    charge("count table entries", 0);
+    return true;
+}
+
+template <typename CharT,typename Traits>
+void NGramStat<CharT, Traits>::scan_index(unsigned N, unsigned M,
+        unsigned freq, OutputFunc& output, CountTableWriter* table) {
+    NGramText<CharT, Traits> ngramtable;
+    const void*    ptable          = 0;
+    unsigned       ptable_size     = m_ptable ? m_ptable->size():0;
     unsigned char* ltable          = 0;
     unsigned       ltable_size     = m_ltable ? m_ltable->size():0;
     FILE*          ptable_fp       = 0;
@@ -1017,16 +1967,7 @@ void NGramStat<CharT, Traits>::extract_ngram(unsigned N, unsigned M, unsigned fr
         //free memory(if any)
         clear();
 
-        MmapFile* fm = new MmapFile(ngram_filename.c_str());
-        if (!fm->open()) {
-            cerr << "could not mmap file:" << ngram_filename << endl;
-            throw runtime_error("unable to mmap ngram table file when extracting NGram");
-        }
-        fm_objs.push_back(fm);
-        ngramtable = (CharT*)fm->addr();
-        ngramtable_size = fm->size();
-        assert(ngramtable);
-        ngramtable_size /= sizeof(CharT);
+        ngramtable.open(ngram_filename,m_compress_text);
 
         if (m_is_use_mmap) {
             MmapFile* fm = new MmapFile(ptable_filename.c_str());
@@ -1035,10 +1976,9 @@ void NGramStat<CharT, Traits>::extract_ngram(unsigned N, unsigned M, unsigned fr
                 throw runtime_error("unable to mmap ptable file when extracting NGram");
             }
             fm_objs.push_back(fm);
-            ptable = (unsigned*)fm->addr();
+            ptable = fm->addr();
             ptable_size = fm->size();
             assert(ptable);
-            ptable_size /= sizeof(unsigned);
 
             MmapFile* fm2 = new MmapFile(ltable_filename.c_str());
             if (!fm2->open()) {
@@ -1061,7 +2001,7 @@ void NGramStat<CharT, Traits>::extract_ngram(unsigned N, unsigned M, unsigned fr
                 perror("unable to stat ptable file size");
                 throw runtime_error("unable to stat ptable file size when extracting NGram");
             }
-            ptable_size = st.st_size / sizeof(unsigned);
+            ptable_size = st.st_size;
 
             ltable_fp = fopen(ltable_filename.c_str(),"rb");
             if (ltable_fp == NULL) {
@@ -1105,7 +2045,18 @@ void NGramStat<CharT, Traits>::extract_ngram(unsigned N, unsigned M, unsigned fr
                 }}}*/
         }
 
+        //bytes of the ptable file --> number of entries
+        if (m_ptable_bits) {
+            if (ptable_size < packed_bytes(ltable_size,m_ptable_bits))
+                throw runtime_error("ptable file too short for the ltable");
+            ptable_size = ltable_size;
+        } else {
+            ptable_size /= sizeof(unsigned);
+        }
+
         assert(ptable_size == ltable_size);
+    } else {
+        ngramtable.attach(m_buffer,m_buffer_offset + 1);
     }//}}}
 
     if (false) { //dump ngram table and ltable {{{
@@ -1138,94 +2089,60 @@ void NGramStat<CharT, Traits>::extract_ngram(unsigned N, unsigned M, unsigned fr
         */
         //}}}
 
-    } else if (N == M) { //extract N-gram with a fixed N extraction algorithm {{{
-        //which is a little faster than N-M extract algorithm below
-        string_type  ngram;
+    } else { //extract N-gram in range[N,M] {{{
+        Extractor extractor(N,M,freq,m_top,output,table);
         unsigned i;
-        unsigned count = 1;
-        unsigned size  = ltable_size;
+        unsigned size = ltable_size;
         progress_display* progress = 0;
         if (true)
             progress = new progress_display(size,cerr);
 
-        //set first ngram
-        fetch_ngram(N,&ngramtable[ptable_entry(ptable,ptable_fp,0)],ngram);
-        for (i = 1;i < size; ++i) {
-            if (progress)
-                ++(*progress);
-
-            if (ltable_entry(ltable,ltable_fp,i) >= N) {
-                ++count;
-            } else {
-                //this node is a n-gram which n < N
-                //so we print out current ngram (n >=N )and its count
-                if (count >= freq && !ngram.empty())
-                    output(ngram,count);
-
-                //fetch new ngram
-                fetch_ngram(N,&ngramtable[ptable_entry(ptable,ptable_fp,i)],ngram);
-                count = 1;
-            }
-        }//for
+        //the ltable is scanned where it is mapped or in memory, else it is
+        //read in blocks
+        const unsigned char* lbytes = ltable;
+        if (!lbytes && !ltable_fp && size > 0)
+            lbytes = &(*m_ltable)[0];
+        vector<unsigned char> block;
+        if (!lbytes) {
+            block.resize(min(size,1u << 20));
+            rewind(ltable_fp);
+        }
 
-        //output last entry
-        if (count >= freq && !ngram.empty())
-            output(ngram,count);
+        //ltable[i]:the co-occurence count of the ngrams at i - 1 and i
+        for (i = 0;i < size;) {
+            //l[k - base] is ltable[k] for k in [base, end)
+            unsigned base = i;
+            unsigned end = size;
+            const unsigned char* l = lbytes + i;
+            if (!lbytes) {
+                end = min(size,i + unsigned(block.size()));
+                if (fread(&block[0],1,end - i,ltable_fp) != end - i) {
+                    perror("error reading ltable file");
+                    throw runtime_error("error when reading ltable file");
+                }
+                l = &block[0];
+            }
 
-        if (progress) {
-            delete progress;
-            cerr << endl;
-        }
-        //}}}
+            while (i < end) {
+                //most entries only extend the M-grams being counted
+                if (i > 0 && l[i - base] >= M) {
+                    size_t run = lcp_run(l + (i - base),end - i,M);
+                    extractor.repeat(run);
+                    i += run;
+                    if (progress)
+                        (*progress) += run;
+                    continue;
+                }
 
-    } else { //extract N-gram in range[N,M] {{{
-        vector<NGram> ngrams(M + 1); //so we can access the Nth-gram with ngrams[N]
-        unsigned i;
-        unsigned j;
-        unsigned l;  //store ltable[l]:the co-occurence count of the two adjancent ngrams
-        unsigned size = ltable_size;
-        progress_display* progress = 0;
-        if (true)
-            progress = new progress_display(size,cerr);
+                if (progress && i > 0)
+                    ++(*progress);
 
-        //get first N-Mngrams
-        fetch_ngrams(N,M,&ngramtable[ptable_entry(ptable,ptable_fp,0)],ngrams);
-        for (i = 1;i < size; ++i) {
-            if (progress)
-                ++(*progress);
-
-            l = ltable_entry(ltable,ltable_fp,i);
-            if (l < N) {
-                //this ltable node is a n-gram which n < N
-                //so we print out current ngrams (n in [N,M]) and their counts
-                for (j = N;j <= M;++j)
-                    if (ngrams[j].m_count >= freq && !ngrams[j].m_text.empty())
-                        output(ngrams[j].m_text,ngrams[j].m_count);
-
-                //and fetch new ngrams
-                fetch_ngrams(N,M,&ngramtable[ptable_entry(ptable,ptable_fp,i)],ngrams);
-            } else if (l >= M){
-                //increasing N-gram count in [N,M]
-                for (j = N;j <= M;++j)
-                    ++ngrams[j].m_count;
-            } else {
-                // N <= l < M
-                //increasing N-gram count in [N,l]
-                for (j = N;j <= l;++j)
-                    ++ngrams[j].m_count;
-
-                //need to output ngrams[l + 1,M]
-                for (j = l + 1;j <= M;++j)
-                    if (ngrams[j].m_count >= freq && !ngrams[j].m_text.empty())
-                        output(ngrams[j].m_text,ngrams[j].m_count);
-                fetch_ngrams(l + 1,M,&ngramtable[ptable_entry(ptable,ptable_fp,i)],ngrams);
+                if (extractor.push(i > 0 ? l[i - base] : 0))
+                    extractor.start(ngramtable,ptable_entry(ptable,ptable_fp,i));
+                ++i;
             }
-        }//for
-
-        //output last entry
-        for (j = N;j <= M;++j)
-            if (ngrams[j].m_count >= freq && !ngrams[j].m_text.empty())
-                output(ngrams[j].m_text,ngrams[j].m_count);
+        }
+        extractor.finish();
 
         if (progress) {
             delete progress;
@@ -0,0 +1,113 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramtext.hpp  -  random access to the text table (.ngram) of an index
+ *
+ * The text table is either raw CharT symbols or compressed: every symbol is
+ * replaced by its frequency rank (the terminal always being rank 0) written
+ * as a variable byte number, 7 bits per byte, so the most frequent 128
+ * symbols take one byte each. The byte offset of every 64th symbol is
+ * sampled, reading the symbols at any offset means skipping less than 64
+ * codes from the nearest sample.
+ *
+ * NGramText hides the difference: fetch() returns the first n symbols at an
+ * offset (pointing straight into raw text, or decoding into a buffer),
+ * compare() and common_prefix() only decode as far as needed.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef NGRAMTEXT_H
+#define NGRAMTEXT_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+
+class MmapFile;
+
+template <typename CharT, typename Traits = std::char_traits<CharT> >
+class NGramText : boost::noncopyable {
+    public:
+        NGramText();
+        ~NGramText();
+
+        // use raw text already in memory, which must end with a terminal
+        void attach(const CharT* text, size_t size);
+
+        /**
+         * map a text table file, raw or written by compress()
+         * throws runtime_error if the file can not be mapped or is corrupt
+         */
+        void open(const std::string& file, bool compressed);
+
+        void close();
+
+        // number of symbols, including the final terminal
+        size_t size() const { return m_size; }
+
+        bool compressed() const { return m_blocks != 0; }
+
+        /**
+         * return the n symbols starting at offset, or as many as there are
+         * up to and including the terminal. buf must have room for n + 1
+         * symbols and is only written to for compressed text.
+         */
+        const CharT* fetch(size_t offset, unsigned n, CharT* buf) const;
+
+        // Traits::compare() of the n symbols at offsets a and b
+        int compare(size_t a, size_t b, unsigned n) const;
+
+        // number of equal symbols (max 255) at a and b before a terminal
+        unsigned char common_prefix(size_t a, size_t b) const;
+
+        /**
+         * write the compressed form of the raw text table in raw_file to
+         * file. throws runtime_error on io errors
+         */
+        static void compress(const std::string& raw_file,
+                const std::string& file);
+
+    private:
+        struct FileHeader;
+        static const unsigned s_block = 64;  // symbols per sampled offset
+
+        const unsigned char* skip_to(size_t offset) const;
+        CharT decode(const unsigned char*& p) const;
+
+        MmapFile*               m_map;
+        const CharT*            m_text;    // raw text
+        const boost::uint32_t*  m_symbols; // compressed: rank --> symbol
+        const boost::uint64_t*  m_blocks;  // compressed: sampled byte offsets
+        const unsigned char*    m_data;    // compressed: the codes
+        size_t                  m_size;
+};
+
+#include "ngramtext.tcc"
+#endif /* ifndef NGRAMTEXT_H */
@@ -0,0 +1,324 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramtext.tcc  -  random access to the text table (.ngram) of an index
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cassert>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include "mmapfile.hpp"
+
+/**
+ * layout of a compressed text table, sections 8 byte aligned:
+ *   FileHeader
+ *   uint32_t symbols[codes]       symbol of each rank
+ *   unsigned char data[data_bytes] the codes
+ *   uint64_t blocks[(size + block - 1) / block]
+ */
+template <typename CharT, typename Traits>
+struct NGramText<CharT, Traits>::FileHeader {
+    char            magic[8];
+    boost::uint32_t width;      // sizeof(CharT)
+    boost::uint32_t block;      // symbols per sampled offset
+    boost::uint64_t size;       // symbols, including the terminal
+    boost::uint64_t codes;      // number of distinct symbols
+    boost::uint64_t data_bytes;
+};
+
+static const char s_ngramtext_magic[8] = { 'N', 'G', 'T', 'E', 'X', 'T', 'Z', '\1' };
+
+inline boost::uint64_t ngramtext_align8(boost::uint64_t n) {
+    return (n + 7) & ~boost::uint64_t(7);
+}
+
+template <typename CharT, typename Traits>
+NGramText<CharT, Traits>::NGramText()
+:
+m_map(0),
+m_text(0),
+m_symbols(0),
+m_blocks(0),
+m_data(0),
+m_size(0)
+{
+}
+
+template <typename CharT, typename Traits>
+NGramText<CharT, Traits>::~NGramText() {
+    close();
+}
+
+template <typename CharT, typename Traits>
+void NGramText<CharT, Traits>::close() {
+    delete m_map;
+    m_map     = 0;
+    m_text    = 0;
+    m_symbols = 0;
+    m_blocks  = 0;
+    m_data    = 0;
+    m_size    = 0;
+}
+
+template <typename CharT, typename Traits>
+void NGramText<CharT, Traits>::attach(const CharT* text, size_t size) {
+    close();
+    m_text = text;
+    m_size = size;
+}
+
+template <typename CharT, typename Traits>
+void NGramText<CharT, Traits>::open(const std::string& file, bool compressed) {
+    close();
+
+    m_map = new MmapFile(file.c_str());
+    if (!m_map->open()) {
+        delete m_map;
+        m_map = 0;
+        throw std::runtime_error("unable to mmap() ngram file");
+    }
+
+    const char* base = (const char*)m_map->addr();
+    if (!compressed) {
+        m_text = (const CharT*)base;
+        m_size = m_map->size() / sizeof(CharT);
+        return;
+    }
+
+    const FileHeader* h = (const FileHeader*)base;
+    if (m_map->size() < sizeof(FileHeader) ||
+            memcmp(h->magic, s_ngramtext_magic, sizeof(h->magic)) != 0 ||
+            h->width != sizeof(CharT) || h->block != s_block) {
+        close();
+        throw std::runtime_error("not a compressed ngram file of this symbol width");
+    }
+
+    boost::uint64_t symbols_pos = sizeof(FileHeader);
+    boost::uint64_t data_pos    = symbols_pos +
+        ngramtext_align8(h->codes * sizeof(boost::uint32_t));
+    boost::uint64_t blocks_pos  = data_pos + ngramtext_align8(h->data_bytes);
+    boost::uint64_t end         = blocks_pos +
+        (h->size + s_block - 1) / s_block * sizeof(boost::uint64_t);
+    if (m_map->size() < end) {
+        close();
+        throw std::runtime_error("truncated compressed ngram file");
+    }
+
+    m_symbols = (const boost::uint32_t*)(base + symbols_pos);
+    m_data    = (const unsigned char*)(base + data_pos);
+    m_blocks  = (const boost::uint64_t*)(base + blocks_pos);
+    m_size    = size_t(h->size);
+}
+
+/**
+ * return the code of the symbol at offset
+ */
+template <typename CharT, typename Traits>
+const unsigned char* NGramText<CharT, Traits>::skip_to(size_t offset) const {
+    assert(offset < m_size);
+
+    const unsigned char* p = m_data + m_blocks[offset / s_block];
+    for (unsigned n = offset % s_block; n > 0; --n) {
+        while (*p++ & 0x80)
+            ;
+    }
+    return p;
+}
+
+template <typename CharT, typename Traits>
+inline CharT NGramText<CharT, Traits>::decode(const unsigned char*& p) const {
+    boost::uint32_t rank = 0;
+    unsigned shift = 0;
+    unsigned char b;
+    do {
+        b = *p++;
+        rank |= boost::uint32_t(b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return CharT(m_symbols[rank]);
+}
+
+template <typename CharT, typename Traits>
+const CharT* NGramText<CharT, Traits>::fetch(size_t offset, unsigned n,
+        CharT* buf) const {
+    if (!compressed())
+        return m_text + offset;
+
+    const unsigned char* p = skip_to(offset);
+    unsigned i = 0;
+    while (i < n) {
+        CharT c = decode(p);
+        buf[i++] = c;
+        if (Traits::eq(c, CharT()))
+            break;
+    }
+    buf[i] = CharT();
+    return buf;
+}
+
+template <typename CharT, typename Traits>
+int NGramText<CharT, Traits>::compare(size_t a, size_t b, unsigned n) const {
+    if (!compressed())
+        return Traits::compare(m_text + a, m_text + b, n);
+
+    const unsigned char* pa = skip_to(a);
+    const unsigned char* pb = skip_to(b);
+    for (unsigned i = 0; i < n; ++i) {
+        CharT ca = decode(pa);
+        CharT cb = decode(pb);
+        if (!Traits::eq(ca, cb))
+            return Traits::lt(ca, cb) ? -1 : 1;
+        // the terminal only ends the text, nothing to compare beyond it
+        if (Traits::eq(ca, CharT()))
+            break;
+    }
+    return 0;
+}
+
+template <typename CharT, typename Traits>
+unsigned char NGramText<CharT, Traits>::common_prefix(size_t a, size_t b) const {
+    unsigned char count = 0;
+
+    if (!compressed()) {
+        const CharT* s1 = m_text + a;
+        const CharT* s2 = m_text + b;
+        while (count < 255 && *s1 != CharT() && *s2 != CharT() &&
+                *s1++ == *s2++)
+            ++count;
+        return count;
+    }
+
+    const unsigned char* pa = skip_to(a);
+    const unsigned char* pb = skip_to(b);
+    while (count < 255) {
+        CharT ca = decode(pa);
+        CharT cb = decode(pb);
+        if (ca == CharT() || cb == CharT() || ca != cb)
+            break;
+        ++count;
+    }
+    return count;
+}
+
+// order symbols by descending frequency, then by value
+struct ngramtext_cmp_freq {
+    ngramtext_cmp_freq(const std::vector<boost::uint64_t>& counts)
+        :m_counts(counts) {}
+    bool operator()(boost::uint32_t a, boost::uint32_t b) const {
+        return m_counts[a] > m_counts[b] || (m_counts[a] == m_counts[b] && a < b);
+    }
+    const std::vector<boost::uint64_t>& m_counts;
+};
+
+template <typename CharT, typename Traits>
+void NGramText<CharT, Traits>::compress(const std::string& raw_file,
+        const std::string& file) {
+    using boost::uint32_t;
+    using boost::uint64_t;
+
+    MmapFile raw(raw_file.c_str());
+    if (!raw.open())
+        throw std::runtime_error("unable to mmap() ngram file");
+    const CharT* text = (const CharT*)raw.addr();
+    size_t size = raw.size() / sizeof(CharT);
+    if (size == 0 || text[size - 1] != CharT())
+        throw std::runtime_error("ngram file does not end with a terminal");
+
+    // rank symbols by frequency, the terminal is always rank 0
+    std::vector<uint64_t> counts;
+    for (size_t i = 0; i < size; ++i) {
+        uint64_t c = uint64_t(text[i]);
+        if (c > 0xffffffffULL)
+            throw std::runtime_error("symbol too large to compress");
+        if (c >= counts.size())
+            counts.resize(size_t(c) + 1);
+        ++counts[size_t(c)];
+    }
+
+    std::vector<uint32_t> symbols;
+    for (size_t c = 1; c < counts.size(); ++c) {
+        if (counts[c])
+            symbols.push_back(uint32_t(c));
+    }
+    std::sort(symbols.begin(), symbols.end(), ngramtext_cmp_freq(counts));
+    symbols.insert(symbols.begin(), 0);
+
+    std::vector<uint32_t> rank(counts.size());
+    for (size_t r = 0; r < symbols.size(); ++r)
+        rank[symbols[r]] = uint32_t(r);
+
+    std::ofstream out(file.c_str(), std::ios::binary);
+    if (!out)
+        throw std::runtime_error("unable to open compressed ngram file to write");
+
+    FileHeader h;
+    memcpy(h.magic, s_ngramtext_magic, sizeof(h.magic));
+    h.width      = sizeof(CharT);
+    h.block      = s_block;
+    h.size       = size;
+    h.codes      = symbols.size();
+    h.data_bytes = 0;
+
+    static const char pad[8] = { 0 };
+    out.write((const char*)&h, sizeof(h));
+    out.write((const char*)&symbols[0], symbols.size() * sizeof(uint32_t));
+    out.write(pad, ngramtext_align8(h.codes * 4) - h.codes * 4);
+
+    std::vector<uint64_t> blocks;
+    blocks.reserve((size + s_block - 1) / s_block);
+    std::vector<char> buf;
+    buf.reserve(1 << 16);
+    for (size_t i = 0; i < size; ++i) {
+        if (i % s_block == 0)
+            blocks.push_back(h.data_bytes + buf.size());
+
+        uint32_t r = rank[size_t(text[i])];
+        while (r >= 0x80) {
+            buf.push_back(char((r & 0x7f) | 0x80));
+            r >>= 7;
+        }
+        buf.push_back(char(r));
+
+        if (buf.size() >= (1 << 16) - 8) {
+            out.write(&buf[0], buf.size());
+            h.data_bytes += buf.size();
+            buf.clear();
+        }
+    }
+    if (!buf.empty())
+        out.write(&buf[0], buf.size());
+    h.data_bytes += buf.size();
+    out.write(pad, ngramtext_align8(h.data_bytes) - h.data_bytes);
+    out.write((const char*)&blocks[0], blocks.size() * sizeof(uint64_t));
+
+    out.seekp(0);
+    out.write((const char*)&h, sizeof(h));
+    out.close();
+    if (!out)
+        throw std::runtime_error("fail to write compressed ngram file");
+}
@@ -0,0 +1,134 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramtopk.hpp  -  the most frequent n-grams in a single pass
+ *
+ * NGramTopK runs the Space-Saving algorithm (Metwally et al. 2005) for
+ * each n-gram length: K counters, and an n-gram without one takes over the
+ * counter of the smallest count, inheriting that count as its possible
+ * error. Every n-gram occurring more than total / K times holds a counter
+ * at the end, and no count is more than total / K too high. Counters sit
+ * in a min-heap by count and are found by the 64 bit hash of their n-gram,
+ * so memory is fixed by K and M alone.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef NGRAMTOPK_H
+#define NGRAMTOPK_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
+
+#include "ngramwindow.hpp"
+
+using std::basic_string;
+using std::string;
+using std::vector;
+
+template <typename CharT, typename Traits = std::char_traits<CharT> >
+class NGramTopK : boost::noncopyable {
+    public:
+        typedef basic_string<CharT, Traits> string_type;
+        typedef boost::function<void(const string_type& ngram,
+                unsigned count)> OutputFunc;
+
+        // keep K counters for each length of N to M
+        NGramTopK(unsigned N, unsigned M, unsigned K);
+        ~NGramTopK();
+
+        // what parse_files() expects of NGramStat
+        const string& budget_name() const { return m_budget_name; }
+        void set_input_position(unsigned, boost::uint64_t) {}
+
+        void parse_begin();
+
+        // count the n-grams ending in buf, buf goes on the text before
+        void parse_buf(const string_type& buf);
+
+        /**
+         * output the counted n-grams with count >= freq, by length and
+         * each length by decreasing count, and report the error bounds on
+         * stderr
+         */
+        void parse_end(unsigned freq, OutputFunc& output);
+
+    private:
+        struct Counter {
+            boost::uint64_t m_hash;
+            unsigned        m_count;
+            unsigned        m_error;  // count it took over
+            unsigned        m_heap;   // its position in the heap
+        };
+
+        // the counters of one length
+        struct Summary {
+            Summary():m_total(0) {}
+
+            vector<Counter>  m_counters;
+            vector<unsigned> m_heap;     // counter indexes, min count first
+            vector<unsigned> m_slots;    // counter index + 1, 0: empty
+            string_type      m_texts;    // n symbols per counter
+            boost::uint64_t  m_total;
+        };
+
+        // counters of a length by decreasing count, then symbol order
+        struct CountGreater {
+            CountGreater(const Summary& s, unsigned n):m_s(&s), m_n(n) {}
+            bool operator()(unsigned a, unsigned b) const {
+                const Counter& x = m_s->m_counters[a];
+                const Counter& y = m_s->m_counters[b];
+                if (x.m_count != y.m_count)
+                    return x.m_count > y.m_count;
+                return Traits::compare(m_s->m_texts.data() + a * m_n,
+                        m_s->m_texts.data() + b * m_n, m_n) < 0;
+            }
+            const Summary* m_s;
+            unsigned       m_n;
+        };
+
+        void add(unsigned n, boost::uint64_t h);
+        size_t find_slot(const Summary& s, boost::uint64_t h) const;
+        void erase_slot(Summary& s, size_t i);
+        void sift_down(Summary& s, unsigned pos);
+        void sift_up(Summary& s, unsigned pos);
+        void set_text(Summary& s, unsigned n, unsigned c);
+
+        unsigned        m_N;
+        unsigned        m_M;
+        unsigned        m_K;
+        vector<Summary> m_summaries;  // per length n - N
+        NGramWindow<CharT> m_window;  // the n-grams ending here
+        string          m_budget_name;
+};
+
+#include "ngramtopk.tcc"
+#endif /* ifndef NGRAMTOPK_H */
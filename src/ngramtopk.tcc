@@ -0,0 +1,233 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramtopk.tcc  -  the most frequent n-grams in a single pass
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cassert>
+#include <algorithm>
+#include <iostream>
+
+#include "membudget.hpp"
+
+using namespace std;
+
+template <typename CharT, typename Traits>
+NGramTopK<CharT, Traits>::NGramTopK(unsigned N, unsigned M, unsigned K)
+:
+m_N(N),
+m_M(M),
+m_K(K),
+m_window(M)
+{
+    assert(N >= 1 && N <= M && K >= 1);
+}
+
+template <typename CharT, typename Traits>
+NGramTopK<CharT, Traits>::~NGramTopK() {
+    mem_budget().set("top-k counters", 0);
+}
+
+template <typename CharT, typename Traits>
+void NGramTopK<CharT, Traits>::parse_begin() {
+    size_t slots = 1;
+    while (slots < size_t(m_K) * 2)
+        slots *= 2;
+
+    size_t bytes = 0;
+    m_summaries.assign(m_M - m_N + 1, Summary());
+    for (unsigned n = m_N; n <= m_M; ++n) {
+        Summary& s = m_summaries[n - m_N];
+        s.m_counters.reserve(m_K);
+        s.m_heap.reserve(m_K);
+        s.m_slots.assign(slots, 0);
+        s.m_texts.reserve(size_t(m_K) * n);
+        bytes += m_K * (sizeof(Counter) + sizeof(unsigned) + n * sizeof(CharT)) +
+            slots * sizeof(unsigned);
+    }
+    mem_budget().set("top-k counters", bytes);
+    m_window.clear();
+}
+
+// Parse text in buf: every symbol ends one n-gram of each length
+template <typename CharT, typename Traits>
+void NGramTopK<CharT, Traits>::parse_buf(const string_type& buf) {
+    for (size_t i = 0; i < buf.size(); ++i) {
+        m_window.push(buf[i]);
+        for (unsigned n = m_N; n <= m_window.size(); ++n)
+            add(n, m_window.hash(n));
+    }
+}
+
+// slot of the counter of hash h, or the empty slot to put it in
+template <typename CharT, typename Traits>
+size_t NGramTopK<CharT, Traits>::find_slot(const Summary& s,
+        boost::uint64_t h) const {
+    size_t mask = s.m_slots.size() - 1;
+    size_t i = h & mask;
+    while (s.m_slots[i] != 0 && s.m_counters[s.m_slots[i] - 1].m_hash != h)
+        i = (i + 1) & mask;
+    return i;
+}
+
+// empty slot i, moving back the entries after it which probed past it
+template <typename CharT, typename Traits>
+void NGramTopK<CharT, Traits>::erase_slot(Summary& s, size_t i) {
+    size_t mask = s.m_slots.size() - 1;
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (s.m_slots[j] == 0)
+            break;
+        size_t home = s.m_counters[s.m_slots[j] - 1].m_hash & mask;
+        // move j back to i unless its home lies cyclically in (i, j]
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            s.m_slots[i] = s.m_slots[j];
+            i = j;
+        }
+    }
+    s.m_slots[i] = 0;
+}
+
+// move the counter at pos down the heap after its count went up
+template <typename CharT, typename Traits>
+void NGramTopK<CharT, Traits>::sift_down(Summary& s, unsigned pos) {
+    vector<unsigned>& heap = s.m_heap;
+    unsigned c = heap[pos];
+    unsigned count = s.m_counters[c].m_count;
+    for (;;) {
+        unsigned child = 2 * pos + 1;
+        if (child >= heap.size())
+            break;
+        if (child + 1 < heap.size() && s.m_counters[heap[child + 1]].m_count <
+                s.m_counters[heap[child]].m_count)
+            ++child;
+        if (s.m_counters[heap[child]].m_count >= count)
+            break;
+        heap[pos] = heap[child];
+        s.m_counters[heap[pos]].m_heap = pos;
+        pos = child;
+    }
+    heap[pos] = c;
+    s.m_counters[c].m_heap = pos;
+}
+
+// move the new counter at pos up the heap, above larger counts
+template <typename CharT, typename Traits>
+void NGramTopK<CharT, Traits>::sift_up(Summary& s, unsigned pos) {
+    vector<unsigned>& heap = s.m_heap;
+    unsigned c = heap[pos];
+    unsigned count = s.m_counters[c].m_count;
+    while (pos > 0) {
+        unsigned parent = (pos - 1) / 2;
+        if (s.m_counters[heap[parent]].m_count <= count)
+            break;
+        heap[pos] = heap[parent];
+        s.m_counters[heap[pos]].m_heap = pos;
+        pos = parent;
+    }
+    heap[pos] = c;
+    s.m_counters[c].m_heap = pos;
+}
+
+// the text of counter c becomes the n-gram of length n ending here
+template <typename CharT, typename Traits>
+void NGramTopK<CharT, Traits>::set_text(Summary& s, unsigned n, unsigned c) {
+    m_window.copy(n, &s.m_texts[size_t(c) * n]);
+}
+
+template <typename CharT, typename Traits>
+void NGramTopK<CharT, Traits>::add(unsigned n, boost::uint64_t h) {
+    Summary& s = m_summaries[n - m_N];
+    ++s.m_total;
+
+    size_t i = find_slot(s, h);
+    if (s.m_slots[i] != 0) {
+        unsigned c = s.m_slots[i] - 1;
+        ++s.m_counters[c].m_count;
+        sift_down(s, s.m_counters[c].m_heap);
+        return;
+    }
+
+    if (s.m_counters.size() < m_K) {
+        unsigned c = unsigned(s.m_counters.size());
+        Counter counter;
+        counter.m_hash  = h;
+        counter.m_count = 1;
+        counter.m_error = 0;
+        counter.m_heap  = unsigned(s.m_heap.size());
+        s.m_counters.push_back(counter);
+        s.m_heap.push_back(c);
+        s.m_texts.resize(s.m_texts.size() + n);
+        s.m_slots[i] = c + 1;
+        set_text(s, n, c);
+        sift_up(s, counter.m_heap);
+        return;
+    }
+
+    // take over the counter of the smallest count
+    unsigned c = s.m_heap[0];
+    Counter& counter = s.m_counters[c];
+    erase_slot(s, find_slot(s, counter.m_hash));
+    counter.m_hash  = h;
+    counter.m_error = counter.m_count;
+    ++counter.m_count;
+    s.m_slots[find_slot(s, h)] = c + 1;
+    set_text(s, n, c);
+    sift_down(s, 0);
+}
+
+template <typename CharT, typename Traits>
+void NGramTopK<CharT, Traits>::parse_end(unsigned freq, OutputFunc& output) {
+    string_type ngram;
+    vector<unsigned> order;
+    for (unsigned n = m_N; n <= m_M; ++n) {
+        Summary& s = m_summaries[n - m_N];
+        // the smallest count bounds the error of every counter
+        unsigned bound = s.m_heap.size() == m_K ?
+            s.m_counters[s.m_heap[0]].m_count : 0;
+        cerr << n << "-grams: " << s.m_total << ", counts at most " << bound
+            << " too high, all n-grams occurring more often are kept" << endl;
+
+        order.clear();
+        size_t sure = 0;
+        for (unsigned c = 0; c < s.m_counters.size(); ++c) {
+            const Counter& counter = s.m_counters[c];
+            if (counter.m_count >= freq) {
+                order.push_back(c);
+                if (counter.m_count - counter.m_error >= freq)
+                    ++sure;
+            }
+        }
+        cerr << n << "-grams: " << order.size() << " put out, " << sure
+            << " of them certainly with freq >= " << freq << endl;
+        sort(order.begin(), order.end(), CountGreater(s, n));
+        for (size_t j = 0; j < order.size(); ++j) {
+            ngram.assign(s.m_texts, size_t(order[j]) * n, n);
+            output(ngram, s.m_counters[order[j]].m_count);
+        }
+    }
+}
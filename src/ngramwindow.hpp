@@ -0,0 +1,103 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * ngramwindow.hpp  -  hashes of the n-grams ending at each symbol
+ *
+ * The streaming counters see the text one symbol at a time, and each
+ * symbol ends one n-gram of every length up to M. NGramWindow keeps the
+ * last M symbols and hashes these n-grams, each hash made from that of the
+ * n-gram one shorter, so they cost a multiplication and a mix each.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef NGRAMWINDOW_H
+#define NGRAMWINDOW_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <vector>
+#include <boost/cstdint.hpp>
+
+template <typename CharT>
+class NGramWindow {
+    public:
+        // hash n-grams of up to M symbols
+        explicit NGramWindow(unsigned M)
+            :m_symbols(M), m_hashes(M), m_last(0), m_size(0) {}
+
+        // forget the symbols so far
+        void clear() { m_size = 0; }
+
+        // append symbol c, hashing the n-grams it ends
+        void push(CharT c) {
+            unsigned M = unsigned(m_symbols.size());
+            m_last = m_last + 1 == M ? 0 : m_last + 1;
+            m_symbols[m_last] = c;
+            if (m_size < M)
+                ++m_size;
+
+            boost::uint64_t h = 0;
+            for (unsigned n = 1; n <= m_size; ++n) {
+                h = mix(h * 0x9e3779b97f4a7c15ULL + boost::uint64_t(symbol(n - 1)) + 1);
+                m_hashes[n - 1] = h;
+            }
+        }
+
+        // lengths of the n-grams ending at the last symbol, at most M
+        unsigned size() const { return m_size; }
+
+        // hash of the n-gram of length n ending at the last symbol
+        boost::uint64_t hash(unsigned n) const { return m_hashes[n - 1]; }
+
+        // the i-th symbol before the last one, 0: the last one
+        CharT symbol(unsigned i) const {
+            unsigned M = unsigned(m_symbols.size());
+            return m_symbols[m_last >= i ? m_last - i : m_last + M - i];
+        }
+
+        // copy the n-gram of length n ending at the last symbol to out
+        void copy(unsigned n, CharT* out) const {
+            for (unsigned j = 0; j < n; ++j)
+                out[j] = symbol(n - 1 - j);
+        }
+
+        static boost::uint64_t mix(boost::uint64_t h) {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            return h ^ (h >> 33);
+        }
+
+    private:
+        std::vector<CharT>           m_symbols; // ring of the last M symbols
+        std::vector<boost::uint64_t> m_hashes;  // n - 1 --> hash
+        unsigned                     m_last;    // where the last symbol is
+        unsigned                     m_size;
+};
+
+#endif /* ifndef NGRAMWINDOW_H */
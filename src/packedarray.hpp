@@ -0,0 +1,141 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * packedarray.hpp  -  arrays of fixed width bit fields packed into 64 bit
+ * words
+ *
+ * Entry i of a packed array of `bits' wide entries occupies bits
+ * [i * bits, (i + 1) * bits) of a sequence of 64 bit words, low bits first,
+ * so any entry can be read with at most two (aligned) word loads. This is
+ * how ptables are stored on disk: an index of n symbols needs only
+ * ceil(log2(n)) bits per entry instead of a whole unsigned.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PACKEDARRAY_H
+#define PACKEDARRAY_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdio>
+#include <ostream>
+#include <boost/cstdint.hpp>
+
+// number of bits needed to store any value in [0, max], at least 1
+inline unsigned packed_bits(boost::uint64_t max) {
+    unsigned bits = 1;
+    while (bits < 64 && (max >> bits) != 0)
+        ++bits;
+    return bits;
+}
+
+// bytes taken by n entries of given width, a whole number of 64 bit words
+inline boost::uint64_t packed_bytes(boost::uint64_t n, unsigned bits) {
+    return (n * bits + 63) / 64 * 8;
+}
+
+// read entry i of a packed array in memory
+inline boost::uint64_t packed_get(const boost::uint64_t* words, unsigned bits,
+        boost::uint64_t i) {
+    boost::uint64_t bit = i * bits;
+    const boost::uint64_t* w = words + (bit >> 6);
+    unsigned shift = unsigned(bit & 63);
+
+    boost::uint64_t v = w[0] >> shift;
+    if (shift + bits > 64)
+        v |= w[1] << (64 - shift);
+    return bits == 64 ? v : v & ((boost::uint64_t(1) << bits) - 1);
+}
+
+/**
+ * read entry i of a packed array from a file
+ * return false on io error
+ */
+inline bool packed_get(FILE* fp, unsigned bits, boost::uint64_t i,
+        boost::uint64_t& value) {
+    boost::uint64_t bit = i * bits;
+    unsigned shift = unsigned(bit & 63);
+    size_t need = shift + bits > 64 ? 2 : 1;
+    boost::uint64_t w[2];
+
+    if (fseek(fp, long((bit >> 6) * 8), SEEK_SET) == -1 ||
+            fread(w, sizeof(w[0]), need, fp) != need)
+        return false;
+
+    value = w[0] >> shift;
+    if (need == 2)
+        value |= w[1] << (64 - shift);
+    if (bits < 64)
+        value &= (boost::uint64_t(1) << bits) - 1;
+    return true;
+}
+
+/**
+ * append entries of a fixed width to a stream, call flush() after the last
+ * one to write out the final partial word
+ */
+class PackedWriter {
+    public:
+        PackedWriter(std::ostream& os, unsigned bits)
+            :m_os(&os), m_bits(bits), m_word(0), m_used(0), m_size(0) {}
+
+        void push_back(boost::uint64_t v) {
+            m_word |= v << m_used;
+            m_used += m_bits;
+            if (m_used >= 64) {
+                write_word();
+                m_used -= 64;
+                // the high part of v that did not fit in the last word
+                m_word = m_used ? v >> (m_bits - m_used) : 0;
+            }
+            ++m_size;
+        }
+
+        void flush() {
+            if (m_used) {
+                write_word();
+                m_word = 0;
+                m_used = 0;
+            }
+            m_os->flush();
+        }
+
+        boost::uint64_t size() const { return m_size; }
+
+    private:
+        void write_word() {
+            m_os->write((const char*)&m_word, sizeof(m_word));
+        }
+
+        std::ostream*   m_os;
+        unsigned        m_bits;
+        boost::uint64_t m_word;
+        unsigned        m_used;  // bits of m_word in use
+        boost::uint64_t m_size;
+};
+
+#endif /* ifndef PACKEDARRAY_H */
@@ -41,7 +41,6 @@
 #include <algorithm>
 #include <functional>
 
-#include <boost/tokenizer.hpp>
 #include <boost/progress.hpp>
 #include <boost/scoped_ptr.hpp>
 
@@ -49,7 +48,6 @@
 #include "iconvert.hpp"
 #include "strreduction.hpp"
 #include "strreduction_cmdline.h"
-#include "itemmap.hpp"
 
 using namespace std;
 using namespace boost;
@@ -68,22 +66,21 @@ struct lexicographical_cmp_string {
     }
 };
 
-//specialize version to compare according a wordmap
-struct cmp_wordid {
-    bool operator()(const word_id id1,const word_id id2) const {
-        // TODO: optimize with a macro
-        return strcmp(g_vocab[id1].c_str(), g_vocab[id2].c_str()) < 0;
-    }
-};
+//renumber words in string order before sorting, then
+//lexicographical_cmp_string compares word ids instead of words
+//characters already compare in string order
+void renumber_words(vector<pair<ustring,int> >&) {
+}
 
-template<>
-struct lexicographical_cmp_string<WordString> {
-    bool operator()(const pair<WordString,int>& w1,const pair<WordString,int>& w2) const {
-        return lexicographical_compare(w1.first.begin(),w1.first.end(),
-                w2.first.begin(),w2.first.end(),cmp_wordid());
-                //bind(wcscmp, var(g_vocab)[_1],var(g_vocab)[_2]));
+void renumber_words(vector<pair<WordString,int> >& v) {
+    vector<word_id> remap;
+    g_vocab.renumber(0, remap);
+    for (size_t i = 0; i < v.size(); ++i) {
+        WordString& ws = v[i].first;
+        for (size_t j = 0; j < ws.size(); ++j)
+            ws[j] = remap[ws[j]];
     }
-};
+}
 
 scoped_ptr<IConvert> g_iconv_from;
 scoped_ptr<IConvert> g_iconv_to;
@@ -122,10 +119,6 @@ void load_word_from_stream(vector<pair<WordString,int> >& v,istream& in) {
 
     string s;
 
-    typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
-    boost::char_separator<char> sep(" \t\f\v\r\n");
-    tokenizer tokens(s, sep);
-
     while (getline(in,s)) {
         assert(!in.eof());
 
@@ -141,12 +134,8 @@ void load_word_from_stream(vector<pair<WordString,int> >& v,istream& in) {
         t.second = atoi(s.substr(pos + 1).c_str());
 
         words.clear();
-        s = s.substr(0, pos);
-        tokens.assign(s);
-        for (tokenizer::iterator it = tokens.begin(); it != tokens.end();
-                ++it) {
-            words.push_back(g_vocab.add(it->c_str()));
-        }
+        s.erase(pos);
+        add_words(s, g_vocab, words);
 
         v.push_back(t);
     }
@@ -185,10 +174,6 @@ void load_word_from_stream(StringHashTable(WordString) & h,istream& in) {
     WordString words;
     int   freq;
 
-    typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
-    boost::char_separator<char> sep(" \t\f\v\r\n");
-    tokenizer tokens(s, sep);
-
     while (getline(in,s)) {
         assert(!in.eof());
 
@@ -203,10 +188,8 @@ void load_word_from_stream(StringHashTable(WordString) & h,istream& in) {
 
         freq = atoi(s.substr(pos + 1).c_str());
         words.clear();
-        s = s.substr(0, pos);
-        tokens.assign(s);
-        for (tokenizer::iterator it = tokens.begin(); it != tokens.end(); ++it)
-            words.push_back(g_vocab.add(it->c_str()));
+        s.erase(pos);
+        add_words(s, g_vocab, words);
         h[words] = make_pair(freq,false); //freq and merged flag
     }
 }
@@ -290,8 +273,10 @@ int do_reduction(const gengetopt_args_info& args_info,istream& in,ostream& out,
             }
         }
 
-        if (sort_result)
+        if (sort_result) {
+            renumber_words(v);
             sort(v.begin(),end,lexicographical_cmp_string<StringT>());
+        }
         //for_each(v.begin(),end,bind(output1<StringT>(),_1,var(out)));
         for (_iterator it = v.begin();it != end; ++it)
             output(it->first,it->second,out);
@@ -318,6 +303,7 @@ int do_reduction(const gengetopt_args_info& args_info,istream& in,ostream& out,
                     v.push_back(make_pair(it->first,it->second.first));
                 }
             }
+            renumber_words(v);
             sort(v.begin(),v.end(),lexicographical_cmp_string<StringT>());
             for (_iterator it = v.begin();it != v.end(); ++it)
                 output(it->first,it->second,out);
@@ -38,15 +38,22 @@
 #include <cwchar>
 #include <wctype.h>
 #include <boost/ref.hpp>
-#include <boost/tokenizer.hpp>
 #include <boost/shared_array.hpp>
 
 #include "tools.hpp"
 #include "iconvert.hpp"
-#include "itemmap.hpp"
 #include "text2ngram_cmdline.h"
 #include "ngramstat.hpp"
+#include "ngramhash.hpp"
+#include "ngramsketch.hpp"
+#include "ngramtopk.hpp"
+#include "ngramtext.hpp"
+#include "countstream.hpp"
 #include "vocab.hpp"
+#include "ngramheader.hpp"
+#include "membudget.hpp"
+#include "buildmanifest.hpp"
+#include "thread.hpp"
 
 using namespace std;
 
@@ -54,6 +61,10 @@ Vocab g_vocab;
 
 boost::shared_array<bool> g_filtering_table;
 
+// progress of an index build (-o), kept in <base>.manifest
+BuildManifest g_manifest;
+string        g_manifest_file;
+
 // important: all word ids in the map must start from 1 to avoid the confusion
 // with g_id_terminal (0)
 static word_id g_id_terminal = word_id();
@@ -308,25 +319,141 @@ void preprocess_word(const NGramStat<word_id>::string_type& buf,
 #endif
 }
 
+// bytes held by a batch of lines and their word ids
+size_t batch_bytes(const vector<string>& lines, const vector<word_id>& ids) {
+    size_t n = lines.capacity() * sizeof(string) +
+        ids.capacity() * sizeof(word_id);
+    for (size_t i = 0; i < lines.size(); ++i)
+        n += lines[i].capacity();
+    return n;
+}
+
 /**
- * parse several files in given encoding
+ * read up to max non-empty lines, return false once f is exhausted
+ * starts receives the byte offset of each line in f if given
  */
-void parse_files(NGramStat<uchar_t, uchar_traits>& ngram,
-        const vector<string>& files, const string& encoding){
+bool read_lines(istream& f, vector<string>& lines, size_t max,
+        vector<boost::uint64_t>* starts = 0) {
+    string s;
+    lines.clear();
+    if (starts)
+        starts->clear();
+    boost::uint64_t pos = starts && f ? boost::uint64_t(f.tellg()) : 0;
+    while (lines.size() < max && getline(f,s)) {
+        if (!s.empty()) {
+            lines.push_back(s);
+            if (starts)
+                starts->push_back(pos);
+        }
+        pos += s.size() + 1;
+    }
+    return !lines.empty();
+}
+
+/**
+ * open input file i for parsing, at pos if parsing goes on from there
+ * (see BuildManifest)
+ */
+void open_input(ifstream& f, const vector<string>& files, unsigned i,
+        boost::uint64_t pos) {
+    f.open(files[i].c_str());
+    if (!f)
+        throw runtime_error("unable to open file for parsing");
+
+    if (pos > 0) {
+        cerr << "Resume parsing file: " << files[i] << " at byte " << pos << endl;
+        f.seekg(pos);
+    } else {
+        cerr << "Parsing file: " << files[i] << endl;
+    }
+}
+
+/**
+ * first pass over a char corpus: collect the (sorted) set of characters
+ * left by preprocess_char(), which decides the symbol width
+ */
+void scan_alphabet(const vector<string>& files, const string& encoding,
+        vector<uchar_t>& alphabet) {
     IConvert iconv(encoding);
     string  s;
     ustring buf;
     ustring buf2;
-
-    ngram.parse_begin();
+    vector<bool> seen(0x10000, false);
 
     for (unsigned i = 0;i < files.size(); ++i) {
         ifstream f(files[i].c_str());
         if (!f)
             throw runtime_error("unable to open file for parsing");
 
-        cerr << "Parsing file: " << files[i] << endl;
+        cerr << "Scanning file: " << files[i] << endl;
         while (getline(f,s)) {
+            // lines failing to convert are reported by parse_files()
+            if (s.empty() || iconv.convert(s,buf) == false)
+                continue;
+
+            preprocess_char(buf,buf2);
+            for (size_t j = 0; j < buf2.size(); ++j)
+                seen[buf2[j]] = true;
+        }
+    }
+
+    alphabet.clear();
+    for (size_t c = 1; c < seen.size(); ++c) {
+        if (seen[c])
+            alphabet.push_back(uchar_t(c));
+    }
+}
+
+/**
+ * first pass over a word corpus: put every word into g_vocab, which decides
+ * the symbol width
+ */
+void scan_vocab(const vector<string>& files, unsigned threads) {
+    vector<string>  lines;
+    vector<word_id> ids;
+    vector<size_t>  line_ends;
+    size_t          max_batch = 0;
+
+    for (unsigned i = 0;i < files.size(); ++i) {
+        ifstream f(files[i].c_str());
+        if (!f)
+            throw runtime_error("unable to open file for parsing");
+
+        cerr << "Scanning file: " << files[i] << endl;
+        while (read_lines(f, lines, 65536)) {
+            add_words_parallel(lines, g_vocab, ids, line_ends, threads);
+            mem_budget().set("vocab", g_vocab.memory_usage());
+            max_batch = max(max_batch, batch_bytes(lines, ids));
+            mem_budget().set("line batch", max_batch);
+        }
+    }
+    // released before the ngram tables are sized from what is left, the
+    // batches of parse_files() are charged while parsing
+    mem_budget().set("line batch", 0);
+}
+
+/**
+ * parse several files in given encoding, from byte first_pos of
+ * files[first_file] on
+ * symbols maps each character to its (narrow) symbol in the ngram table
+ */
+template <typename NGram, typename SymT>
+void parse_files(NGram& ngram,
+        const vector<string>& files, const string& encoding,
+        const vector<SymT>& symbols, unsigned first_file,
+        boost::uint64_t first_pos){
+    IConvert iconv(encoding);
+    string  s;
+    ustring buf;
+    ustring buf2;
+    typename NGram::string_type syms;
+
+    for (unsigned i = first_file;i < files.size(); ++i) {
+        ifstream f;
+        boost::uint64_t pos = i == first_file ? first_pos : 0;
+        open_input(f, files, i, pos);
+
+        for (; getline(f,s); pos += s.size() + 1) {
             if (s.empty())
                 continue;
 
@@ -336,53 +463,613 @@ void parse_files(NGramStat<uchar_t, uchar_traits>& ngram,
             }
 
             preprocess_char(buf,buf2);
-            ngram.parse_buf(buf2);
+            if (buf2.empty())
+                continue;
+
+            syms.resize(buf2.size());
+            for (size_t j = 0; j < buf2.size(); ++j)
+                syms[j] = symbols[buf2[j]];
+            ngram.set_input_position(i, pos);
+            ngram.parse_buf(syms);
         }
     }
-
-    ngram.parse_end();
 }
 
 /**
- * parse several files in given encoding
+ * parse several files, from byte first_pos of files[first_file] on
  * treat the input file as a sequence of words and map words into word_ids
+ * lines are read in batches and tokenized on `threads' threads
  */
-void parse_files(NGramStat<word_id>& ngram,const vector<string>& files, const
-        string& encoding){
-    IConvert iconv(encoding);
-    string  s;
-    string buf;
+template <typename NGram>
+void parse_files(NGram& ngram, const vector<string>& files,
+        unsigned threads, unsigned first_file, boost::uint64_t first_pos){
+    vector<string>  lines;
+    vector<boost::uint64_t> starts;
+    vector<word_id> ids;
+    vector<size_t>  line_ends;
     NGramStat<word_id>::string_type words;
     NGramStat<word_id>::string_type buf2;
+    typename NGram::string_type syms;
+
+    for (unsigned i = first_file;i < files.size(); ++i) {
+        ifstream f;
+        open_input(f, files, i, i == first_file ? first_pos : 0);
+        while (read_lines(f, lines, 65536, &starts)) {
+            add_words_parallel(lines, g_vocab, ids, line_ends, threads);
+            mem_budget().set(ngram.budget_name() + "line batch",
+                    batch_bytes(lines, ids));
+
+            size_t begin = 0;
+            for (size_t j = 0; j < line_ends.size(); begin = line_ends[j++]) {
+                if (begin == line_ends[j])
+                    continue;
+
+                words.assign(&ids[0] + begin, &ids[0] + line_ends[j]);
+                preprocess_word(words,buf2);
+                syms.assign(buf2.begin(), buf2.end());
+                ngram.set_input_position(i, starts[j]);
+                ngram.parse_buf(syms);
+            }
+        }
+    }
+    mem_budget().set(ngram.budget_name() + "line batch", 0);
+}
 
-    typedef boost::tokenizer<boost::char_separator<char> > tokenizer;
-    boost::char_separator<char> sep(" \t\f\v\r\n");
-    tokenizer tokens(buf, sep);
+// parse_files() of the char files of a shard
+template <typename SymT>
+struct ParseChars {
+    ParseChars(const string& encoding, const vector<SymT>& symbols)
+        :m_encoding(encoding), m_symbols(&symbols) {}
 
+    template <typename NGram>
+    void operator()(NGram& ngram, const vector<string>& files) const {
+        parse_files(ngram, files, m_encoding, *m_symbols, 0, 0);
+    }
+
+    string              m_encoding;
+    const vector<SymT>* m_symbols;
+};
+
+// parse_files() of the word files of a shard, g_vocab holds all words
+// already so that shards only look words up in it
+struct ParseWords {
+    template <typename NGram>
+    void operator()(NGram& ngram, const vector<string>& files) const {
+        parse_files(ngram, files, 1, 0, 0);
+    }
+};
+
+// whether to spill runs on a background thread while parsing goes on,
+// shards keep the cores busy instead
+bool background_spill(const gengetopt_args_info& args) {
+    return !args.foreground_spill_flag && args.shards_arg <= 1 &&
+        cpu_count() > 1;
+}
+
+/**
+ * memory (in KB) left in the budget for the text buffer and ptable, these
+ * are allocated last so that their size decides when to spill a run.
+ * If the vocab and the like leave less than half of the budget, the tables
+ * take half of it anyway, as a small -M would otherwise spill a run every
+ * few KB. When building an index with background spilling, half of it is
+ * left for the second buffer.
+ */
+unsigned table_memory(const gengetopt_args_info& args) {
+    size_t kb = mem_budget().available() / 1024;
+    // huge_alloc() rounds each table up to whole 2 MB pages
+    if (kb > 64 * 1024)
+        kb -= 8 * 1024;
+    size_t half = mem_budget().limit() / 2048;
+    if (kb < half) {
+        cerr << "warning: memory budget mostly taken, use " << half
+            << " KB for ngram tables" << endl;
+        kb = half;
+    }
+    kb = max(kb, size_t(256));
+    if (args.output_arg && background_spill(args))
+        kb = kb / 2 - kb / 32; //some room for what grows while parsing
+    return unsigned(min(kb, size_t(~0u)));
+}
+
+/**
+ * whether to count N to M-grams of bits wide symbols in hash tables (see
+ * NGramHash) instead of sorting suffixes, only done when extracting right
+ * away. NGramHash puts them out by length, so --engine=auto only picks it
+ * for --by-length or --top, and if the n-grams fit into its keys
+ */
+bool hash_engine(const gengetopt_args_info& args, unsigned N, unsigned M,
+        unsigned bits) {
+    string engine = args.engine_arg;
+    if (!N || args.output_arg || engine == "suffix")
+        return false;
+    if (engine == "auto" && !args.by_length_flag && !args.top_given)
+        return false;
+    if (hash_key_fits(M, bits))
+        return true;
+    if (engine == "hash")
+        cerr << "warning: " << M << "-grams of " << bits
+            << " bit symbols do not fit into hash keys, sort suffixes instead"
+            << endl;
+    return false;
+}
+
+/**
+ * count and output N to M-grams without a suffix array: approximately
+ * with NGramSketch (--approx) or NGramTopK (--stream-top), or else with
+ * NGramHash. parse is the parse_files() of the corpus
+ */
+template <typename SymT, typename Parse>
+void count_streamed(const gengetopt_args_info& args,
+        const vector<string>& files, unsigned N, unsigned M, unsigned freq,
+        unsigned bits, const Parse& parse, typename NGramStat<SymT,
+        typename symbol_traits<SymT>::type>::OutputFunc& output) {
+    typedef typename symbol_traits<SymT>::type Traits;
+
+    if (args.approx_flag) {
+        NGramSketch<SymT, Traits> ngram(N, M, freq, args.epsilon_arg,
+                args.delta_arg, args.candidates_arg, args.hll_bits_arg);
+        cerr << "Count " << N << " to " << M << "-grams approximately" << endl;
+        ngram.parse_begin();
+        parse(ngram, files);
+        mem_budget().phase("extracting");
+        ngram.parse_end(output);
+        return;
+    }
+
+    if (args.stream_top_given) {
+        NGramTopK<SymT, Traits> ngram(N, M, args.stream_top_arg);
+        cerr << "Keep the " << args.stream_top_arg << " most frequent n-grams of each length" << endl;
+        ngram.parse_begin();
+        parse(ngram, files);
+        mem_budget().phase("extracting");
+        ngram.parse_end(freq, output);
+        return;
+    }
+
+    NGramHash<SymT, Traits> ngram(N, M, bits, table_memory(args));
+    if (args.temp_dir_given)
+        ngram.set_temp_dir(args.temp_dir_arg);
+    ngram.set_top(args.top_given ? args.top_arg : 0);
+
+    cerr << "Count " << N << " to " << M << "-grams in hash tables" << endl;
     ngram.parse_begin();
+    parse(ngram, files);
+    mem_budget().phase("extracting");
+    ngram.parse_end(freq, output);
+}
 
-    for (unsigned i = 0;i < files.size(); ++i) {
-        ifstream f(files[i].c_str());
+/**
+ * NGramStat checkpoint of an index build: record state in the manifest
+ * (NGramStat and BuildManifest list their phases in the same order)
+ */
+template <typename ParseState>
+void save_checkpoint(const ParseState& state) {
+    g_manifest.m_phase = BuildManifest::Phase(BuildManifest::PARSING + state.m_phase);
+    g_manifest.m_input_file = state.m_input_file;
+    g_manifest.m_input_pos  = state.m_input_pos;
+    g_manifest.m_text_size  = state.m_text_size;
+    g_manifest.m_tail.assign(state.m_tail.begin(), state.m_tail.end());
+    g_manifest.m_header.m_ptable_bits = state.m_ptable_bits;
+    g_manifest.m_ptable_size = state.m_ptable_size;
+    g_manifest.m_runs.resize(state.m_runs.size());
+    for (size_t i = 0; i < state.m_runs.size(); ++i) {
+        g_manifest.m_runs[i].m_name = state.m_runs[i].m_name;
+        g_manifest.m_runs[i].m_bits = state.m_runs[i].m_bits;
+        g_manifest.m_runs[i].m_size = state.m_runs[i].m_size;
+    }
+    g_manifest.save(g_manifest_file);
+}
+
+/**
+ * start parsing with ngram, or go on with the build recorded in resume.
+ * Return false if that build is past parsing already, else parsing goes
+ * on from byte pos of input file
+ */
+template <typename NGram>
+bool begin_parse(NGram& ngram, const BuildManifest* resume,
+        unsigned& file, boost::uint64_t& pos) {
+    file = 0;
+    pos  = 0;
+    if (!resume || resume->m_phase == BuildManifest::SCANNED) {
+        ngram.parse_begin();
+        return true;
+    }
+
+    typedef typename NGram::ParseState ParseState;
+    ParseState state;
+    state.m_phase = typename ParseState::Phase(resume->m_phase - BuildManifest::PARSING);
+    state.m_input_file  = resume->m_input_file;
+    state.m_input_pos   = resume->m_input_pos;
+    state.m_text_size   = resume->m_text_size;
+    state.m_tail.assign(resume->m_tail.begin(), resume->m_tail.end());
+    state.m_ptable_bits = resume->m_header.m_ptable_bits;
+    state.m_ptable_size = resume->m_ptable_size;
+    state.m_runs.resize(resume->m_runs.size());
+    for (size_t i = 0; i < resume->m_runs.size(); ++i) {
+        state.m_runs[i].m_name = resume->m_runs[i].m_name;
+        state.m_runs[i].m_bits = resume->m_runs[i].m_bits;
+        state.m_runs[i].m_size = resume->m_runs[i].m_size;
+    }
+
+    ngram.resume(state);
+    file = state.m_input_file;
+    pos  = state.m_input_pos;
+    return state.m_phase == ParseState::PARSING;
+}
+
+/**
+ * write the vocab of the index through a temporary file, g_vocab may be
+ * a mapping of the file written before when a build is resumed
+ */
+void save_index_vocab(const gengetopt_args_info& args, bool text) {
+    string name = string(args.output_arg) + ".vocab";
+    string tmp  = name + ".tmp";
+    if (text)
+        save_vocab_text(tmp, g_vocab);
+    else
+        save_vocab(tmp, g_vocab);
+    if (rename(tmp.c_str(), name.c_str()) != 0) {
+        perror(name.c_str());
+        throw runtime_error("unable to replace vocab file");
+    }
+}
+
+/**
+ * check that the build to resume (if any) is this one, else record in the
+ * manifest that a new build has got past scanning
+ */
+void begin_manifest(const BuildManifest* resume) {
+    if (resume) {
+        if (!g_manifest.same_build(*resume))
+            throw runtime_error("the build manifest is of another build or input, unable to resume");
+        static const char* phases[] = { "scanning", "part of the parsing", "parsing", "merging" };
+        cerr << "Resume the build after " << phases[resume->m_phase] << endl;
+        return;
+    }
+
+    g_manifest.m_phase = BuildManifest::SCANNED;
+    g_manifest.save(g_manifest_file);
+}
+
+/**
+ * cut the input files into at most n shards of consecutive files, with
+ * about the same number of bytes each
+ */
+void split_shards(const vector<string>& files, unsigned n,
+        vector<vector<string> >& shards) {
+    vector<boost::uint64_t> sizes;
+    boost::uint64_t total = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        struct stat st;
+        sizes.push_back(stat(files[i].c_str(), &st) == 0 ? st.st_size : 0);
+        total += sizes.back();
+    }
+
+    shards.clear();
+    boost::uint64_t done = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (shards.empty() ||
+                (shards.size() < n && done >= total * shards.size() / n))
+            shards.push_back(vector<string>());
+        shards.back().push_back(files[i]);
+        done += sizes[i];
+    }
+}
+
+// one shard of a sharded build, parsed on a thread of its own
+template <typename NGram, typename Parse>
+struct ShardJob {
+    ShardJob(NGram* ngram, const vector<string>& files, const Parse& parse)
+        :m_ngram(ngram), m_files(files), m_parse(parse) {}
+
+    void operator()() {
+        try {
+            m_ngram->parse_begin();
+            m_parse(*m_ngram, m_files);
+            m_ngram->parse_end();
+        } catch (std::exception& e) {
+            m_error = e.what();
+        }
+    }
+
+    NGram*         m_ngram;
+    vector<string> m_files;
+    Parse          m_parse;
+    string         m_error;  // what went wrong on its thread
+};
+
+// boost::function copies its target, so hand threads a pointer
+template <typename Job>
+struct RunShardJob {
+    RunShardJob(Job* job):m_job(job) {}
+    void operator()() { (*m_job)(); }
+    Job* m_job;
+};
+
+// the shards of a build, deleting them removes their temporary indexes
+template <typename NGram>
+struct ShardList : boost::noncopyable {
+    ~ShardList() {
+        for (size_t i = 0; i < m_shards.size(); ++i)
+            delete m_shards[i];
+    }
+
+    vector<NGram*> m_shards;
+};
+
+/**
+ * build the index of ngram from args.shards_arg shards of the files. The
+ * memory budget is shared out among the shards, and each stripes its
+ * temporary files over the temporary directories starting from another
+ * one, so that shards parse on all cores and write to all disks at once
+ */
+template <typename NGram, typename Parse>
+void build_shards(const gengetopt_args_info& args, NGram& ngram,
+        const vector<string>& files, const Parse& parse) {
+    typedef ShardJob<NGram, Parse> Job;
+
+    vector<vector<string> > parts;
+    split_shards(files, args.shards_arg, parts);
+    cerr << "Build the index from " << parts.size() << " shards" << endl;
+
+    ShardList<NGram> shards;
+    vector<Job> jobs;
+    jobs.reserve(parts.size());
+    unsigned kb = table_memory(args) / parts.size();
+    const vector<string>& dirs = ngram.temp_dirs();
+    for (size_t k = 0; k < parts.size(); ++k) {
+        NGram* shard = new NGram(max(kb, 256u), "", args.mmap_flag);
+        shards.m_shards.push_back(shard);
+        if (!dirs.empty()) {
+            string rotated;
+            for (size_t i = 0; i < dirs.size(); ++i)
+                rotated += (i ? "," : "") + dirs[(k + i) % dirs.size()];
+            shard->set_temp_dir(rotated);
+        }
+        char name[32];
+        sprintf(name, "shard %u", unsigned(k + 1));
+        shard->set_shard(name);
+        jobs.push_back(Job(shard, parts[k], parse));
+    }
+
+    {
+        boost::shared_array<Thread> threads(new Thread[jobs.size()]);
+        for (size_t k = 0; k < jobs.size(); ++k)
+            threads[k].start(RunShardJob<Job>(&jobs[k]));
+    }
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        if (!jobs[k].m_error.empty())
+            throw runtime_error(jobs[k].m_error);
+    }
+
+    ngram.merge_shards(shards.m_shards);
+}
+
+/**
+ * rewrite the text table of an index as raw text of NewT symbols, with
+ * each symbol s replaced by remap[s]
+ */
+template <typename OldT, typename NewT>
+void rewrite_text(const string& file, bool compressed,
+        const vector<word_id>& remap) {
+    typedef typename symbol_traits<OldT>::type Traits;
+
+    string tmp = file + ".tmp";
+    {
+        NGramText<OldT, Traits> text;
+        text.open(file, compressed);
+        ofstream f(tmp.c_str(), ios::binary);
         if (!f)
-            throw runtime_error("unable to open file for parsing");
+            throw runtime_error("unable to open ngram file to write");
+
+        OldT buf[256];
+        vector<NewT> out;
+        out.reserve(65536);
+        for (size_t i = 0; i < text.size(); i += 255) {
+            unsigned n = unsigned(min(text.size() - i, size_t(255)));
+            const OldT* s = text.fetch(i, n, buf);
+            for (unsigned j = 0; j < n; ++j)
+                out.push_back(NewT(remap[s[j]]));
+            if (out.size() + 255 > out.capacity() || i + n == text.size()) {
+                f.write((const char*)&out[0], out.size() * sizeof(NewT));
+                out.clear();
+            }
+        }
+        if (!f)
+            throw runtime_error("fail to write ngram file");
+    }
+    if (rename(tmp.c_str(), file.c_str()) != 0) {
+        perror(file.c_str());
+        throw runtime_error("unable to replace ngram file");
+    }
+}
 
-        cerr << "Parsing file: " << files[i] << endl;
-        while (getline(f,s)) {
-            if (s.empty())
-                continue;
+template <typename OldT>
+void rewrite_text(const string& file, bool compressed,
+        const vector<word_id>& remap, unsigned width) {
+    if (width == 1)
+        rewrite_text<OldT, unsigned char>(file, compressed, remap);
+    else if (width == 2)
+        rewrite_text<OldT, uchar_t>(file, compressed, remap);
+    else
+        rewrite_text<OldT, unsigned>(file, compressed, remap);
+}
+
+/**
+ * make the text table of the index to append to what
+ * NGramStat::append_begin() expects: raw text of width bytes per symbol,
+ * with symbol s of the old text renumbered to remap[s]. It is only
+ * rewritten if any of these changes
+ */
+void prepare_append(const gengetopt_args_info& args, const NGramHeader& old,
+        const vector<word_id>& remap, unsigned width) {
+    bool same = width == old.m_width && !old.m_compressed_text;
+    for (size_t i = 0; same && i < remap.size(); ++i)
+        same = remap[i] == i;
+    if (same)
+        return;
+
+    string file = string(args.output_arg) + ".ngram";
+    cerr << "Rewriting " << file << " for the new symbols" << endl;
+    if (old.m_width == 1)
+        rewrite_text<unsigned char>(file, old.m_compressed_text, remap, width);
+    else if (old.m_width == 2)
+        rewrite_text<uchar_t>(file, old.m_compressed_text, remap, width);
+    else
+        rewrite_text<unsigned>(file, old.m_compressed_text, remap, width);
+}
+
+/**
+ * count char ngrams with SymT wide symbols,
+ * alphabet lists the characters of symbols 1, 2, ...
+ * With append given the files are added to that index
+ */
+template <typename SymT>
+void count_chars(const gengetopt_args_info& args, const vector<string>& files,
+        const vector<uchar_t>& alphabet, unsigned N, unsigned M,
+        unsigned freq, const BuildManifest* resume,
+        const NGramHeader* append) {
+    typedef NGramStat<SymT, typename symbol_traits<SymT>::type> NGram;
+
+    vector<SymT> symbols(0x10000, SymT());
+    vector<uchar_t> chars(1, uchar_t());
+    for (size_t i = 0; i < alphabet.size(); ++i) {
+        symbols[alphabet[i]] = SymT(i + 1);
+        chars.push_back(alphabet[i]);
+    }
+    mem_budget().set("symbol map", symbols.size() * sizeof(SymT));
+
+    unsigned bits = symbol_bits(alphabet.size() + 1);
+    if ((N && (args.approx_flag || args.stream_top_given)) ||
+            hash_engine(args, N, M, bits)) {
+        CharOutputHelper out(cout,true,args.nopunct_flag, args.to_arg);
+        typename NGram::OutputFunc f =
+            WidenOutput<SymT, uchar_t, uchar_traits>(boost::ref(out), &chars[0]);
+        count_streamed<SymT>(args, files, N, M, freq, bits,
+                ParseChars<SymT>(args.from_arg, symbols), f);
+        return;
+    }
+
+    //the shards of a sharded build hold the tables instead
+    NGram ngram(args.shards_arg > 1 ? 0 : table_memory(args),
+            args.output_arg?args.output_arg:"", args.mmap_flag);
+    ngram.set_compress_text(args.compress_flag);
+    ngram.set_auto_spill(true);
+    ngram.set_threads(args.threads_arg);
+    ngram.set_top(args.top_given ? args.top_arg : 0);
+    ngram.set_background_spill(background_spill(args));
+    if (args.temp_dir_given)
+        ngram.set_temp_dir(args.temp_dir_arg);
+    if (args.output_arg && !append)
+        ngram.set_checkpoint(&save_checkpoint<typename NGram::ParseState>);
+
+    unsigned file;
+    boost::uint64_t pos;
+    if (append) {
+        ngram.set_compress_text(args.compress_flag || append->m_compressed_text);
+        ngram.append_begin(append->m_ptable_bits);
+        parse_files(ngram, files, args.from_arg, symbols, 0, 0);
+        ngram.append_end();
+    } else if (args.shards_arg > 1) {
+        build_shards(args, ngram, files, ParseChars<SymT>(args.from_arg, symbols));
+    } else if (begin_parse(ngram, resume, file, pos)) {
+        parse_files(ngram, files, args.from_arg, symbols, file, pos);
+
+        if (N) {
+            CharOutputHelper out(cout,true,args.nopunct_flag, args.to_arg);
+            typename NGram::OutputFunc f =
+                WidenOutput<SymT, uchar_t, uchar_traits>(boost::ref(out), &chars[0]);
+            ByLengthOutput<SymT, typename symbol_traits<SymT>::type> by_length(f, N, M);
+            if (args.by_length_flag)
+                f = boost::ref(by_length);
+
+            mem_budget().phase("extracting");
+            ngram.parse_end(N,M,freq,f);
+            by_length.finish();
+        } else {
+            ngram.parse_end();
+        }
+    }
+
+    if (args.output_arg) {
+        NGramHeader header(NGramHeader::CHAR_MODE, sizeof(SymT));
+        header.m_alphabet = alphabet;
+        header.m_ptable_bits = ngram.ptable_bits();
+        header.m_compressed_text = ngram.compress_text();
+        header.save(string(args.output_arg) + ".header");
+        remove(g_manifest_file.c_str());
+    }
+}
 
-            words.clear();
-            tokens.assign(s);
-            for (tokenizer::iterator it = tokens.begin(); it != tokens.end();
-                    ++it)
-                words.push_back(g_vocab.add(it->c_str()));
+/**
+ * count word ngrams with SymT wide symbols, g_vocab must hold all words
+ * With append given the files are added to that index
+ */
+template <typename SymT>
+void count_words(const gengetopt_args_info& args, const vector<string>& files,
+        unsigned N, unsigned M, unsigned freq, const BuildManifest* resume,
+        const NGramHeader* append) {
+    typedef NGramStat<SymT, typename symbol_traits<SymT>::type> NGram;
+
+    unsigned bits = symbol_bits(g_vocab.size());
+    if ((N && (args.approx_flag || args.stream_top_given)) ||
+            hash_engine(args, N, M, bits)) {
+        WordOutputHelper out(cout,true,args.nopunct_flag, args.to_arg);
+        typename NGram::OutputFunc f =
+            WidenOutput<SymT, word_id>(boost::ref(out));
+        count_streamed<SymT>(args, files, N, M, freq, bits, ParseWords(), f);
+        return;
+    }
 
-            preprocess_word(words,buf2);
-            ngram.parse_buf(buf2);
+    //the shards of a sharded build hold the tables instead
+    NGram ngram(args.shards_arg > 1 ? 0 : table_memory(args),
+            args.output_arg?args.output_arg:"", args.mmap_flag);
+    ngram.set_compress_text(args.compress_flag);
+    ngram.set_auto_spill(true);
+    ngram.set_threads(args.threads_arg);
+    ngram.set_top(args.top_given ? args.top_arg : 0);
+    ngram.set_background_spill(background_spill(args));
+    if (args.temp_dir_given)
+        ngram.set_temp_dir(args.temp_dir_arg);
+    if (args.output_arg && !append)
+        ngram.set_checkpoint(&save_checkpoint<typename NGram::ParseState>);
+
+    unsigned file;
+    boost::uint64_t pos;
+    if (append) {
+        ngram.set_compress_text(args.compress_flag || append->m_compressed_text);
+        ngram.append_begin(append->m_ptable_bits);
+        parse_files(ngram, files, args.threads_arg, 0, 0);
+        ngram.append_end();
+    } else if (args.shards_arg > 1) {
+        build_shards(args, ngram, files, ParseWords());
+    } else if (begin_parse(ngram, resume, file, pos)) {
+        parse_files(ngram, files, args.threads_arg, file, pos);
+
+        if (N) {
+            WordOutputHelper out(cout,true,args.nopunct_flag, args.to_arg);
+            typename NGram::OutputFunc f =
+                WidenOutput<SymT, word_id>(boost::ref(out));
+            ByLengthOutput<SymT, typename symbol_traits<SymT>::type> by_length(f, N, M);
+            if (args.by_length_flag)
+                f = boost::ref(by_length);
+
+            mem_budget().phase("extracting");
+            ngram.parse_end(N,M,freq,f);
+            by_length.finish();
+        } else {
+            ngram.parse_end();
         }
     }
 
-    ngram.parse_end();
+    if (args.output_arg) {
+        NGramHeader header(NGramHeader::WORD_MODE, sizeof(SymT));
+        header.m_ptable_bits = ngram.ptable_bits();
+        header.m_compressed_text = ngram.compress_text();
+        header.save(string(args.output_arg) + ".header");
+        save_index_vocab(args, args.text_vocab_flag);
+        remove(g_manifest_file.c_str());
+    }
 }
 
 void check_args(const gengetopt_args_info& args,unsigned N,unsigned M,unsigned freq) {
@@ -409,6 +1096,87 @@ void check_args(const gengetopt_args_info& args,unsigned N,unsigned M,unsigned f
             cerr << "punctuation filtering is only supported in character n-gram mode" << endl;
             exit(EXIT_FAILURE);
     }
+
+    if (args.mem_arg < 0) {
+            cerr << "memory budget must be >= 0" << endl;
+            exit(EXIT_FAILURE);
+    }
+
+    if (args.threads_arg < 1) {
+            cerr << "number of threads must be >= 1" << endl;
+            exit(EXIT_FAILURE);
+    }
+
+    if (args.resume_flag && !args.output_given) {
+            cerr << "only an index build (-o) can be resumed" << endl;
+            exit(EXIT_FAILURE);
+    }
+
+    if (args.append_flag && (!args.output_given || args.resume_flag)) {
+            cerr << "--append needs the index (-o) to add to and can not be resumed" << endl;
+            exit(EXIT_FAILURE);
+    }
+
+    if (args.approx_flag) {
+        if (args.output_given) {
+            cerr << "--approx only extracts right away, it builds no index (-o)" << endl;
+            exit(EXIT_FAILURE);
+        }
+        if (!(args.epsilon_arg > 0 && args.epsilon_arg < 1 &&
+                    args.delta_arg > 0 && args.delta_arg < 1)) {
+            cerr << "epsilon and delta must be between 0 and 1" << endl;
+            exit(EXIT_FAILURE);
+        }
+        if (args.candidates_arg < 1 || args.hll_bits_arg < 4 || args.hll_bits_arg > 20) {
+            cerr << "candidates must be >= 1 and hll-bits in [4, 20]" << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (args.stream_top_given && (args.output_given || args.approx_flag ||
+                args.stream_top_arg < 1)) {
+            cerr << "--stream-top needs a count >= 1, it builds no index (-o) and is not --approx" << endl;
+            exit(EXIT_FAILURE);
+    }
+
+    if (args.top_given && (args.top_arg < 1 || args.by_length_flag ||
+                args.approx_flag || args.stream_top_given)) {
+            cerr << "--top needs a count >= 1 and puts out n-grams by count, not --by-length, --approx or --stream-top" << endl;
+            exit(EXIT_FAILURE);
+    }
+
+    string engine = args.engine_arg;
+    if (engine != "auto" && engine != "hash" && engine != "suffix") {
+            cerr << "--engine must be auto, hash or suffix" << endl;
+            exit(EXIT_FAILURE);
+    }
+
+    if (args.shards_arg < 1) {
+            cerr << "number of shards must be >= 1" << endl;
+            exit(EXIT_FAILURE);
+    }
+
+    if (args.shards_arg > 1 &&
+            (!args.output_given || args.append_flag || args.resume_flag)) {
+            cerr << "only a new index build (-o) can be sharded, it can not be resumed" << endl;
+            exit(EXIT_FAILURE);
+    }
+
+    if (args.temp_dir_given) {
+        vector<string> dirs;
+        split(args.temp_dir_arg, dirs, ",");
+        if (dirs.empty()) {
+            cerr << "no temporary directory given" << endl;
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < dirs.size(); ++i) {
+            struct stat st;
+            if (stat(dirs[i].c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                cerr << "temporary directory does not exist: " << dirs[i] << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
 }
 
 
@@ -451,46 +1219,117 @@ int main(int argc,char* argv[]) {
             throw runtime_error("read from stdin not support yet");
         }
 
-        string encoding = args_info.from_arg;
+        init_mem_budget(args_info.mem_arg);
+        mem_budget().phase("scanning");
+
+        //the count tables of extractngram --save-counts describe the index
+        //being replaced
+        if (args_info.output_arg)
+            remove((string(args_info.output_arg) + ".counts").c_str());
+
+        BuildManifest resume;   //the build to go on with
+        bool resuming = false;
+        NGramHeader old;        //the index to append to
+        vector<word_id> remap;  //its symbols --> new symbols
+        if (args_info.append_flag) {
+            if (!old.load(string(args_info.output_arg) + ".header"))
+                throw runtime_error("no index to append to");
+            if ((old.m_mode == NGramHeader::CHAR_MODE) != bool(args_info.char_flag))
+                throw runtime_error("the index to append to is of the other n-gram type");
+            if (old.m_ptable_bits == 0)
+                throw runtime_error("the index to append to has an unpacked ptable, rebuild it");
+        } else if (args_info.output_arg) {
+            g_manifest_file = string(args_info.output_arg) + ".manifest";
+            g_manifest.set_inputs(files);
+            g_manifest.m_header.m_compressed_text = args_info.compress_flag;
+            if (args_info.resume_flag) {
+                resuming = resume.load(g_manifest_file);
+                if (!resuming)
+                    cerr << "No build manifest " << g_manifest_file
+                        << " found, start from the beginning" << endl;
+            }
+        }
 
         if (args_info.char_flag) { // character ngrams
             g_filtering_table.reset(create_filtering_table(true,
                         args_info.nopunct_flag, args_info.nopunct_flag));
-
-            NGramStat<uchar_t, uchar_traits> ngram(args_info.mem_arg * 1024,
-                    args_info.output_arg?args_info.output_arg:"",
-                    args_info.mmap_flag);
-
-            parse_files(ngram, files, encoding);
-
-            if (N) {
-                CharOutputHelper out(cout,true,args_info.nopunct_flag,
-                        args_info.to_arg);
-                NGramStat<uchar_t, uchar_traits>::OutputFunc f =
-                    boost::ref(out);
-
-                ngram.extract_ngram(N,M,freq,f);
+            mem_budget().set("filtering table", 65536 * sizeof(bool));
+
+            vector<uchar_t> alphabet;
+            if (resuming) {
+                alphabet = resume.m_header.m_alphabet;
+            } else if (args_info.append_flag) {
+                vector<uchar_t> added;
+                scan_alphabet(files, args_info.from_arg, added);
+                set_union(old.m_alphabet.begin(), old.m_alphabet.end(),
+                        added.begin(), added.end(), back_inserter(alphabet));
+                remap.push_back(0);
+                for (size_t i = 0, j = 0; i < old.m_alphabet.size(); ++i) {
+                    while (alphabet[j] != old.m_alphabet[i])
+                        ++j;
+                    remap.push_back(j + 1);
+                }
+            } else {
+                scan_alphabet(files, args_info.from_arg, alphabet);
             }
-        } else {
-            init_special_id(g_vocab);
-
-            NGramStat<word_id> ngram(args_info.mem_arg * 1024,
-                    args_info.output_arg?args_info.output_arg:"",
-                    args_info.mmap_flag);
-
-            parse_files(ngram, files, encoding);
-
-            if (N) {
-                WordOutputHelper out(cout,true,args_info.nopunct_flag,
-                        args_info.to_arg);
-                NGramStat<word_id>::OutputFunc f = boost::ref(out);
-
-                ngram.extract_ngram(N,M,freq,f);
+            mem_budget().phase("counting");
+
+            unsigned width = symbol_width(alphabet.size() + 1);
+            cerr << alphabet.size() << " distinct characters, "
+                << width << " byte(s) per symbol" << endl;
+            if (args_info.append_flag) {
+                prepare_append(args_info, old, remap, width);
+            } else if (args_info.output_arg) {
+                g_manifest.m_header.m_mode     = NGramHeader::CHAR_MODE;
+                g_manifest.m_header.m_width    = width;
+                g_manifest.m_header.m_alphabet = alphabet;
+                begin_manifest(resuming ? &resume : 0);
             }
 
-            if (args_info.output_arg) {
-                save_vocab(string(args_info.output_arg) + ".vocab", g_vocab);
+            const BuildManifest* r = resuming ? &resume : 0;
+            const NGramHeader* a = args_info.append_flag ? &old : 0;
+            if (width == 1)
+                count_chars<unsigned char>(args_info, files, alphabet, N, M, freq, r, a);
+            else
+                count_chars<uchar_t>(args_info, files, alphabet, N, M, freq, r, a);
+        } else {
+            if (resuming) {
+                load_vocab(string(args_info.output_arg) + ".vocab", g_vocab);
+                mem_budget().set("vocab", g_vocab.memory_usage());
+            } else if (args_info.append_flag) {
+                load_vocab(string(args_info.output_arg) + ".vocab", g_vocab);
+                size_t old_size = g_vocab.size();
+                scan_vocab(files, args_info.threads_arg);
+                sort_vocab(g_vocab, remap); // new words among the old ones
+                remap.resize(old_size);
+            } else {
+                init_special_id(g_vocab);
+                scan_vocab(files, args_info.threads_arg);
+                sort_vocab(g_vocab); // word ids in string order before counting
+            }
+            mem_budget().phase("counting");
+
+            unsigned width = symbol_width(g_vocab.size());
+            cerr << g_vocab.size() << " distinct words, "
+                << width << " byte(s) per symbol" << endl;
+            if (args_info.append_flag) {
+                prepare_append(args_info, old, remap, width);
+            } else if (args_info.output_arg) {
+                g_manifest.m_header.m_mode  = NGramHeader::WORD_MODE;
+                g_manifest.m_header.m_width = width;
+                if (!resuming)
+                    save_index_vocab(args_info, false); //needed to resume
+                begin_manifest(resuming ? &resume : 0);
             }
+
+            const BuildManifest* r = resuming ? &resume : 0;
+            const NGramHeader* a = args_info.append_flag ? &old : 0;
+            if (width == 1)
+                count_words<unsigned char>(args_info, files, N, M, freq, r, a);
+            else if (width == 2)
+                count_words<uchar_t>(args_info, files, N, M, freq, r, a);
+            else
+                count_words<unsigned>(args_info, files, N, M, freq, r, a);
         }
     } catch (bad_alloc& e) {
         cerr << "std::bad_alloc caught: out of memory" << endl;
@@ -503,6 +1342,7 @@ int main(int argc,char* argv[]) {
         return EXIT_FAILURE;
     }
 
+    mem_budget().phase("");
     cerr << "Done!" << endl;
     cerr << "end at: " << current_time();
 
@@ -51,29 +51,64 @@ cmdline_parser_print_help (void)
   "  text file encoded in GBK and output ngrams in GBK encoding. All\n"
   "  ngrams with (CJK) punctuations are discarded (--nopunct)\n"
   "  \n"
-  "  This program can also extract N-gram directly from in-memory ptable\n"
-  "  and ltable provided that all the corpus can be fit in memory and no\n"
-  "  ngram file name given (-o).  For the extraction of N-gram from large\n"
-  "  corpus, considering extractngram utility.  By default, all\n"
-  "  input/output encoding assume to be UTF-8.\n"
+  "  This program can also extract N-gram directly from in-memory ptable and\n"
+  "  ltable when no ngram file name is given (-o). If the corpus does not fit in\n"
+  "  memory it is spilled to a temporary index in --temp-dir, which is removed\n"
+  "  after the extraction. The n-grams come out in symbol order, as sort -m,\n"
+  "  join and ngrammerge expect. With --by-length or --top, short n-grams (whose\n"
+  "  symbols fit into 64 bits together, such as -n1 -m3 of most vocabularies)\n"
+  "  are counted in hash tables instead of sorting all suffixes, see --engine;\n"
+  "  --engine=hash does so always, which puts the n-grams out by length. With\n"
+  "  --approx nothing is kept but a count-min sketch and a HyperLogLog estimator\n"
+  "  per length: n-grams the sketch counts at >= freq are put out with counts\n"
+  "  which may be a little too high (see --epsilon), and the number of distinct\n"
+  "  n-grams of each length is estimated on stderr. With --stream-top K only K\n"
+  "  counters per length are kept, which end up holding the most frequent\n"
+  "  n-grams; they come out by decreasing count. To extract N-gram from a large\n"
+  "  corpus more than once, build an index with -o and use extractngram utility.\n"
+  "  By default, all input/output encoding assume to be UTF-8.\n"
+  "  \n"
+  "  An index build records its progress in <base>.manifest. If it is interrupted,\n"
+  "  run the same command again with --resume to go on from where it stopped.\n"
+  "  With --append the input files are added to an existing index instead: only\n"
+  "  they are parsed, and their ptable is merged into the existing one.\n"
+  "  With --shards K an index build cuts the input files into K shards which are\n"
+  "  parsed and sorted side by side, each on a thread of its own, and then merged.\n"
   "  \n"
   "  Note: Use mmap() for disk merging is fast but may exceed 2G memory\n"
   "  limitation on some OS (Win32) when processing large corpus (>1G). \n"
   "\n"
   "Usage: %s [OPTIONS]... [FILES]...\n", CMDLINE_PARSER_PACKAGE);
-  printf("   -h         --help           Print help and exit\n");
-  printf("   -V         --version        Print version and exit\n");
-  printf("   -FSTRING   --from=STRING    input stream encoding (for character ngram only) (default='UTF-8')\n");
-  printf("   -TSTRING   --to=STRING      output stream encoding (for character ngram only) (default='UTF-8')\n");
-  printf("   -oSTRING   --output=STRING  ngram file name\n");
-  printf("   -MINT      --mem=INT        size of memory(MB) to use (default='50')\n");
-  printf("   -c         --char           counting char ngram (default=off)\n");
-  printf("              --mmap           use mmap() for disk merging (default=off)\n");
-  printf("   -nINT      --min-n=INT      extract N gram (where N >= n)\n");
-  printf("   -mINT      --max-n=INT      extract N gram (N <= m) (max M=255,M=N if omitted)\n");
-  printf("   -fINT      --freq=INT       extract N gram whose freq >= f (default='1')\n");
-  printf("              --nopunct        exclude N gram with punctuations and special symbols (non-word) (default=off)\n");
-  printf("   -wINT      --wordlen=INT    average word length when count word ngrams.this option is a hint for pre-allocate memory (default='3')\n");
+  printf("   -h         --help              Print help and exit\n");
+  printf("   -V         --version           Print version and exit\n");
+  printf("   -FSTRING   --from=STRING       input stream encoding (for character ngram only) (default='UTF-8')\n");
+  printf("   -TSTRING   --to=STRING         output stream encoding (for character ngram only) (default='UTF-8')\n");
+  printf("   -oSTRING   --output=STRING     ngram file name\n");
+  printf("   -MINT      --mem=INT           memory budget in MB, 0 to size it from the cgroup limit and available memory (three quarters of it) (default='50')\n");
+  printf("   -c         --char              counting char ngram (default=off)\n");
+  printf("              --mmap              use mmap() for disk merging (default=off)\n");
+  printf("              --foreground-spill  sort and write temporary ptables on the parsing thread, with a single text buffer (default=off)\n");
+  printf("              --resume            go on with an interrupted index build (-o) from its <base>.manifest (default=off)\n");
+  printf("              --append            add the input files to the existing index (-o) instead of building a new one (default=off)\n");
+  printf("              --temp-dir=STRING   directory for temporary files, a comma separated list stripes them over several disks (default: current directory)\n");
+  printf("   -nINT      --min-n=INT         extract N gram (where N >= n)\n");
+  printf("   -mINT      --max-n=INT         extract N gram (N <= m) (max M=255,M=N if omitted)\n");
+  printf("   -fINT      --freq=INT          extract N gram whose freq >= f (default='1')\n");
+  printf("              --top=INT           extract only the given number of most frequent N grams of each length (exact counts), put out by length and decreasing count\n");
+  printf("              --by-length         put out the n-grams by length, each length in symbol order, so that outputs of several shards can be merged by ngramcluster (default=off)\n");
+  printf("              --engine=STRING     how to count n-grams when extracting without -o: hash (in hash tables, only for n-grams fitting into 64 bits), suffix (by sorting all suffixes) or auto (hash when they fit and are put out by length anyway, with --by-length or --top). hash puts the n-grams out by length instead of in symbol order (default='auto')\n");
+  printf("              --approx            count approximately in fixed memory (count-min sketches and HyperLogLog), for corpora too large to count exactly (default=off)\n");
+  printf("              --epsilon=DOUBLE    with --approx: counts are at most epsilon times the number of n-grams too high (default='0.00001')\n");
+  printf("              --delta=DOUBLE      with --approx: probability that a count exceeds that bound (default='0.01')\n");
+  printf("              --candidates=INT    with --approx: most n-grams reported, their text is kept once the sketch puts them at freq (default='1000000')\n");
+  printf("              --hll-bits=INT      with --approx: precision of the distinct n-gram estimates, 2^hll-bits registers per length (error about 1.04/sqrt(2^hll-bits)) (default='14')\n");
+  printf("              --stream-top=INT    keep only the given number of most frequent n-grams of each length, counted in a single pass in fixed memory (Space-Saving), counts may be too high by the smallest count kept\n");
+  printf("              --nopunct           exclude N gram with punctuations and special symbols (non-word) (default=off)\n");
+  printf("   -wINT      --wordlen=INT       average word length when count word ngrams.this option is a hint for pre-allocate memory (default='3')\n");
+  printf("              --shards=INT        build the index (-o) from this many shards of the input files, each parsed and sorted on a thread of its own (default='1')\n");
+  printf("   -jINT      --threads=INT       number of threads used to tokenize word corpora and to compute the ltable (default='1')\n");
+  printf("   -z         --compress          compress the .ngram table (variable byte codes of frequency ranked symbols) (default=off)\n");
+  printf("              --text-vocab        write .vocab as plain text (one word per line) instead of the binary format (default=off)\n");
 }
 
 
@@ -105,11 +140,28 @@ cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_i
   args_info->mem_given = 0 ;
   args_info->char_given = 0 ;
   args_info->mmap_given = 0 ;
+  args_info->foreground_spill_given = 0 ;
+  args_info->resume_given = 0 ;
+  args_info->append_given = 0 ;
+  args_info->temp_dir_given = 0 ;
   args_info->min_n_given = 0 ;
   args_info->max_n_given = 0 ;
   args_info->freq_given = 0 ;
+  args_info->top_given = 0 ;
+  args_info->by_length_given = 0 ;
+  args_info->engine_given = 0 ;
+  args_info->approx_given = 0 ;
+  args_info->epsilon_given = 0 ;
+  args_info->delta_given = 0 ;
+  args_info->candidates_given = 0 ;
+  args_info->hll_bits_given = 0 ;
+  args_info->stream_top_given = 0 ;
   args_info->nopunct_given = 0 ;
   args_info->wordlen_given = 0 ;
+  args_info->shards_given = 0 ;
+  args_info->threads_given = 0 ;
+  args_info->compress_given = 0 ;
+  args_info->text_vocab_given = 0 ;
 #define clear_args() { \
   args_info->from_arg = gengetopt_strdup("UTF-8") ;\
   args_info->to_arg = gengetopt_strdup("UTF-8") ;\
@@ -117,9 +169,24 @@ cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_i
   args_info->mem_arg = 50 ;\
   args_info->char_flag = 0;\
   args_info->mmap_flag = 0;\
+  args_info->foreground_spill_flag = 0;\
+  args_info->resume_flag = 0;\
+  args_info->append_flag = 0;\
+  args_info->temp_dir_arg = NULL; \
   args_info->freq_arg = 1 ;\
+  args_info->by_length_flag = 0;\
+  args_info->engine_arg = gengetopt_strdup("auto") ;\
+  args_info->approx_flag = 0;\
+  args_info->epsilon_arg = 0.00001 ;\
+  args_info->delta_arg = 0.01 ;\
+  args_info->candidates_arg = 1000000 ;\
+  args_info->hll_bits_arg = 14 ;\
   args_info->nopunct_flag = 0;\
   args_info->wordlen_arg = 3 ;\
+  args_info->shards_arg = 1 ;\
+  args_info->threads_arg = 1 ;\
+  args_info->compress_flag = 0;\
+  args_info->text_vocab_flag = 0;\
 }
 
   clear_args();
@@ -146,16 +213,33 @@ cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_i
         { "mem",	1, NULL, 'M' },
         { "char",	0, NULL, 'c' },
         { "mmap",	0, NULL, 0 },
+        { "foreground-spill",	0, NULL, 0 },
+        { "resume",	0, NULL, 0 },
+        { "append",	0, NULL, 0 },
+        { "temp-dir",	1, NULL, 0 },
         { "min-n",	1, NULL, 'n' },
         { "max-n",	1, NULL, 'm' },
         { "freq",	1, NULL, 'f' },
+        { "top",	1, NULL, 0 },
+        { "by-length",	0, NULL, 0 },
+        { "engine",	1, NULL, 0 },
+        { "approx",	0, NULL, 0 },
+        { "epsilon",	1, NULL, 0 },
+        { "delta",	1, NULL, 0 },
+        { "candidates",	1, NULL, 0 },
+        { "hll-bits",	1, NULL, 0 },
+        { "stream-top",	1, NULL, 0 },
         { "nopunct",	0, NULL, 0 },
         { "wordlen",	1, NULL, 'w' },
+        { "shards",	1, NULL, 0 },
+        { "threads",	1, NULL, 'j' },
+        { "compress",	0, NULL, 'z' },
+        { "text-vocab",	0, NULL, 0 },
         { NULL,	0, NULL, 0 }
       };
 
       stop_char = 0;
-      c = getopt_long (argc, argv, "hVF:T:o:M:cn:m:f:w:", long_options, &option_index);
+      c = getopt_long (argc, argv, "hVF:T:o:M:cn:m:f:w:j:z", long_options, &option_index);
 
       if (c == -1) break;	/* Exit from `while (1)' loop.  */
 
@@ -204,7 +288,7 @@ cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_i
           args_info->output_arg = gengetopt_strdup (optarg);
           break;
 
-        case 'M':	/* size of memory(MB) to use.  */
+        case 'M':	/* memory budget in MB, 0 to size it from the cgroup limit and available memory (three quarters of it).  */
           if (args_info->mem_given)
             {
               fprintf (stderr, "%s: `--mem' (`-M') option given more than once\n", CMDLINE_PARSER_PACKAGE);
@@ -270,6 +354,28 @@ cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_i
           args_info->wordlen_arg = strtol (optarg,&stop_char,0);
           break;
 
+        case 'j':	/* number of threads used to tokenize word corpora and to compute the ltable.  */
+          if (args_info->threads_given)
+            {
+              fprintf (stderr, "%s: `--threads' (`-j') option given more than once\n", CMDLINE_PARSER_PACKAGE);
+              clear_args ();
+              exit (EXIT_FAILURE);
+            }
+          args_info->threads_given = 1;
+          args_info->threads_arg = strtol (optarg,&stop_char,0);
+          break;
+
+        case 'z':	/* compress the .ngram table (variable byte codes of frequency ranked symbols).  */
+          if (args_info->compress_given)
+            {
+              fprintf (stderr, "%s: `--compress' (`-z') option given more than once\n", CMDLINE_PARSER_PACKAGE);
+              clear_args ();
+              exit (EXIT_FAILURE);
+            }
+          args_info->compress_given = 1;
+          args_info->compress_flag = !(args_info->compress_flag);
+          break;
+
 
         case 0:	/* Long option with no short option */
           /* use mmap() for disk merging.  */
@@ -286,6 +392,188 @@ cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_i
             break;
           }
           
+          /* sort and write temporary ptables on the parsing thread, with a single text buffer.  */
+          else if (strcmp (long_options[option_index].name, "foreground-spill") == 0)
+          {
+            if (args_info->foreground_spill_given)
+              {
+                fprintf (stderr, "%s: `--foreground-spill' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->foreground_spill_given = 1;
+            args_info->foreground_spill_flag = !(args_info->foreground_spill_flag);
+            break;
+          }
+          
+          /* go on with an interrupted index build (-o) from its <base>.manifest.  */
+          else if (strcmp (long_options[option_index].name, "resume") == 0)
+          {
+            if (args_info->resume_given)
+              {
+                fprintf (stderr, "%s: `--resume' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->resume_given = 1;
+            args_info->resume_flag = !(args_info->resume_flag);
+            break;
+          }
+          
+          /* add the input files to the existing index (-o) instead of building a new one.  */
+          else if (strcmp (long_options[option_index].name, "append") == 0)
+          {
+            if (args_info->append_given)
+              {
+                fprintf (stderr, "%s: `--append' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->append_given = 1;
+            args_info->append_flag = !(args_info->append_flag);
+            break;
+          }
+          
+          /* directory for temporary files, a comma separated list stripes them over several disks (default: current directory).  */
+          else if (strcmp (long_options[option_index].name, "temp-dir") == 0)
+          {
+            if (args_info->temp_dir_given)
+              {
+                fprintf (stderr, "%s: `--temp-dir' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->temp_dir_given = 1;
+            args_info->temp_dir_arg = gengetopt_strdup (optarg);
+            break;
+          }
+          
+          /* extract only the given number of most frequent N grams of each length (exact counts), put out by length and decreasing count.  */
+          else if (strcmp (long_options[option_index].name, "top") == 0)
+          {
+            if (args_info->top_given)
+              {
+                fprintf (stderr, "%s: `--top' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->top_given = 1;
+            args_info->top_arg = strtol (optarg,&stop_char,0);
+            break;
+          }
+          
+          /* put out the n-grams by length, each length in symbol order, so that outputs of several shards can be merged by ngramcluster.  */
+          else if (strcmp (long_options[option_index].name, "by-length") == 0)
+          {
+            if (args_info->by_length_given)
+              {
+                fprintf (stderr, "%s: `--by-length' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->by_length_given = 1;
+            args_info->by_length_flag = !(args_info->by_length_flag);
+            break;
+          }
+          
+          /* how to count n-grams when extracting without -o: hash (in hash tables, only for n-grams fitting into 64 bits), suffix (by sorting all suffixes) or auto (hash when they fit and are put out by length anyway, with --by-length or --top). hash puts the n-grams out by length instead of in symbol order.  */
+          else if (strcmp (long_options[option_index].name, "engine") == 0)
+          {
+            if (args_info->engine_given)
+              {
+                fprintf (stderr, "%s: `--engine' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->engine_given = 1;
+            args_info->engine_arg = gengetopt_strdup (optarg);
+            break;
+          }
+          
+          /* count approximately in fixed memory (count-min sketches and HyperLogLog), for corpora too large to count exactly.  */
+          else if (strcmp (long_options[option_index].name, "approx") == 0)
+          {
+            if (args_info->approx_given)
+              {
+                fprintf (stderr, "%s: `--approx' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->approx_given = 1;
+            args_info->approx_flag = !(args_info->approx_flag);
+            break;
+          }
+          
+          /* with --approx: counts are at most epsilon times the number of n-grams too high.  */
+          else if (strcmp (long_options[option_index].name, "epsilon") == 0)
+          {
+            if (args_info->epsilon_given)
+              {
+                fprintf (stderr, "%s: `--epsilon' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->epsilon_given = 1;
+            args_info->epsilon_arg = strtod (optarg,&stop_char);
+            break;
+          }
+          
+          /* with --approx: probability that a count exceeds that bound.  */
+          else if (strcmp (long_options[option_index].name, "delta") == 0)
+          {
+            if (args_info->delta_given)
+              {
+                fprintf (stderr, "%s: `--delta' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->delta_given = 1;
+            args_info->delta_arg = strtod (optarg,&stop_char);
+            break;
+          }
+          
+          /* with --approx: most n-grams reported, their text is kept once the sketch puts them at freq.  */
+          else if (strcmp (long_options[option_index].name, "candidates") == 0)
+          {
+            if (args_info->candidates_given)
+              {
+                fprintf (stderr, "%s: `--candidates' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->candidates_given = 1;
+            args_info->candidates_arg = strtol (optarg,&stop_char,0);
+            break;
+          }
+          
+          /* with --approx: precision of the distinct n-gram estimates, 2^hll-bits registers per length (error about 1.04/sqrt(2^hll-bits)).  */
+          else if (strcmp (long_options[option_index].name, "hll-bits") == 0)
+          {
+            if (args_info->hll_bits_given)
+              {
+                fprintf (stderr, "%s: `--hll-bits' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->hll_bits_given = 1;
+            args_info->hll_bits_arg = strtol (optarg,&stop_char,0);
+            break;
+          }
+          
+          /* keep only the given number of most frequent n-grams of each length, counted in a single pass in fixed memory (Space-Saving), counts may be too high by the smallest count kept.  */
+          else if (strcmp (long_options[option_index].name, "stream-top") == 0)
+          {
+            if (args_info->stream_top_given)
+              {
+                fprintf (stderr, "%s: `--stream-top' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->stream_top_given = 1;
+            args_info->stream_top_arg = strtol (optarg,&stop_char,0);
+            break;
+          }
+          
           /* exclude N gram with punctuations and special symbols (non-word).  */
           else if (strcmp (long_options[option_index].name, "nopunct") == 0)
           {
@@ -300,6 +588,34 @@ cmdline_parser (int argc, char * const *argv, struct gengetopt_args_info *args_i
             break;
           }
           
+          /* build the index (-o) from this many shards of the input files, each parsed and sorted on a thread of its own.  */
+          else if (strcmp (long_options[option_index].name, "shards") == 0)
+          {
+            if (args_info->shards_given)
+              {
+                fprintf (stderr, "%s: `--shards' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->shards_given = 1;
+            args_info->shards_arg = strtol (optarg,&stop_char,0);
+            break;
+          }
+          
+          /* write .vocab as plain text (one word per line) instead of the binary format.  */
+          else if (strcmp (long_options[option_index].name, "text-vocab") == 0)
+          {
+            if (args_info->text_vocab_given)
+              {
+                fprintf (stderr, "%s: `--text-vocab' option given more than once\n", CMDLINE_PARSER_PACKAGE);
+                clear_args ();
+                exit (EXIT_FAILURE);
+              }
+            args_info->text_vocab_given = 1;
+            args_info->text_vocab_flag = !(args_info->text_vocab_flag);
+            break;
+          }
+          
 
         case '?':	/* Invalid option.  */
           /* `getopt_long' already printed an error message.  */
@@ -27,14 +27,31 @@ struct gengetopt_args_info
   char * from_arg;	/* input stream encoding (for character ngram only) (default='UTF-8').  */
   char * to_arg;	/* output stream encoding (for character ngram only) (default='UTF-8').  */
   char * output_arg;	/* ngram file name.  */
-  int mem_arg;	/* size of memory(MB) to use (default='50').  */
+  int mem_arg;	/* memory budget in MB, 0 to size it from the cgroup limit and available memory (three quarters of it) (default='50').  */
   int char_flag;	/* counting char ngram (default=off).  */
   int mmap_flag;	/* use mmap() for disk merging (default=off).  */
+  int foreground_spill_flag;	/* sort and write temporary ptables on the parsing thread, with a single text buffer (default=off).  */
+  int resume_flag;	/* go on with an interrupted index build (-o) from its <base>.manifest (default=off).  */
+  int append_flag;	/* add the input files to the existing index (-o) instead of building a new one (default=off).  */
+  char * temp_dir_arg;	/* directory for temporary files, a comma separated list stripes them over several disks (default: current directory).  */
   int min_n_arg;	/* extract N gram (where N >= n).  */
   int max_n_arg;	/* extract N gram (N <= m) (max M=255,M=N if omitted).  */
   int freq_arg;	/* extract N gram whose freq >= f (default='1').  */
+  int top_arg;	/* extract only the given number of most frequent N grams of each length (exact counts), put out by length and decreasing count.  */
+  int by_length_flag;	/* put out the n-grams by length, each length in symbol order, so that outputs of several shards can be merged by ngramcluster (default=off).  */
+  char * engine_arg;	/* how to count n-grams when extracting without -o: hash (in hash tables, only for n-grams fitting into 64 bits), suffix (by sorting all suffixes) or auto (hash when they fit and are put out by length anyway, with --by-length or --top). hash puts the n-grams out by length instead of in symbol order (default='auto').  */
+  int approx_flag;	/* count approximately in fixed memory (count-min sketches and HyperLogLog), for corpora too large to count exactly (default=off).  */
+  double epsilon_arg;	/* with --approx: counts are at most epsilon times the number of n-grams too high (default='0.00001').  */
+  double delta_arg;	/* with --approx: probability that a count exceeds that bound (default='0.01').  */
+  int candidates_arg;	/* with --approx: most n-grams reported, their text is kept once the sketch puts them at freq (default='1000000').  */
+  int hll_bits_arg;	/* with --approx: precision of the distinct n-gram estimates, 2^hll-bits registers per length (error about 1.04/sqrt(2^hll-bits)) (default='14').  */
+  int stream_top_arg;	/* keep only the given number of most frequent n-grams of each length, counted in a single pass in fixed memory (Space-Saving), counts may be too high by the smallest count kept.  */
   int nopunct_flag;	/* exclude N gram with punctuations and special symbols (non-word) (default=off).  */
   int wordlen_arg;	/* average word length when count word ngrams.this option is a hint for pre-allocate memory (default='3').  */
+  int shards_arg;	/* build the index (-o) from this many shards of the input files, each parsed and sorted on a thread of its own (default='1').  */
+  int threads_arg;	/* number of threads used to tokenize word corpora and to compute the ltable (default='1').  */
+  int compress_flag;	/* compress the .ngram table (variable byte codes of frequency ranked symbols) (default=off).  */
+  int text_vocab_flag;	/* write .vocab as plain text (one word per line) instead of the binary format (default=off).  */
 
   int help_given ;	/* Whether help was given.  */
   int version_given ;	/* Whether version was given.  */
@@ -44,11 +61,28 @@ struct gengetopt_args_info
   int mem_given ;	/* Whether mem was given.  */
   int char_given ;	/* Whether char was given.  */
   int mmap_given ;	/* Whether mmap was given.  */
+  int foreground_spill_given ;	/* Whether foreground-spill was given.  */
+  int resume_given ;	/* Whether resume was given.  */
+  int append_given ;	/* Whether append was given.  */
+  int temp_dir_given ;	/* Whether temp-dir was given.  */
   int min_n_given ;	/* Whether min-n was given.  */
   int max_n_given ;	/* Whether max-n was given.  */
   int freq_given ;	/* Whether freq was given.  */
+  int top_given ;	/* Whether top was given.  */
+  int by_length_given ;	/* Whether by-length was given.  */
+  int engine_given ;	/* Whether engine was given.  */
+  int approx_given ;	/* Whether approx was given.  */
+  int epsilon_given ;	/* Whether epsilon was given.  */
+  int delta_given ;	/* Whether delta was given.  */
+  int candidates_given ;	/* Whether candidates was given.  */
+  int hll_bits_given ;	/* Whether hll-bits was given.  */
+  int stream_top_given ;	/* Whether stream-top was given.  */
   int nopunct_given ;	/* Whether nopunct was given.  */
   int wordlen_given ;	/* Whether wordlen was given.  */
+  int shards_given ;	/* Whether shards was given.  */
+  int threads_given ;	/* Whether threads was given.  */
+  int compress_given ;	/* Whether compress was given.  */
+  int text_vocab_given ;	/* Whether text-vocab was given.  */
 
   char **inputs ; /* unamed options */
   unsigned inputs_num ; /* unamed options number */
@@ -0,0 +1,94 @@
+/*
+ * vi:ts=4:tw=78:shiftwidth=4:expandtab
+ * vim600:fdm=marker
+ *
+ * thread.hpp  -  minimal pthread wrapper
+ *
+ * Thread runs a boost::function<void()> on a new thread, Mutex and
+ * ScopedLock give the usual scoped locking on top of pthread_mutex_t.
+ *
+ * Copyright (C) 2026 by the NGramTool contributors
+ * Begin       : 18-Oct-2026
+ * Last Change : 18-Oct-2026.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef THREAD_H
+#define THREAD_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+
+class Thread : boost::noncopyable {
+    public:
+        typedef boost::function<void()> Func;
+
+        Thread():m_running(false) {}
+
+        ~Thread() { if (m_running) join(); }
+
+        /**
+         * run f on a new thread, f is copied so it may be a temporary.
+         * throws runtime_error if the thread can not be created.
+         */
+        void start(const Func& f);
+
+        // wait for the thread to finish, do nothing if it was never started
+        void join();
+
+        bool running() const { return m_running; }
+
+    private:
+        static void* run(void* arg);
+
+        Func      m_func;
+        pthread_t m_thread;
+        bool      m_running;
+};
+
+class Mutex : boost::noncopyable {
+    public:
+        Mutex() { pthread_mutex_init(&m_mutex, 0); }
+        ~Mutex() { pthread_mutex_destroy(&m_mutex); }
+        void lock() { pthread_mutex_lock(&m_mutex); }
+        void unlock() { pthread_mutex_unlock(&m_mutex); }
+
+    private:
+        pthread_mutex_t m_mutex;
+};
+
+class ScopedLock : boost::noncopyable {
+    public:
+        ScopedLock(Mutex& m):m_mutex(m) { m_mutex.lock(); }
+        ~ScopedLock() { m_mutex.unlock(); }
+
+    private:
+        Mutex& m_mutex;
+};
+
+// number of online processors, at least 1
+unsigned cpu_count();
+
+#endif /* ifndef THREAD_H */
@@ -38,6 +38,7 @@
 #include <algorithm>
 #include <cassert>
 #include "tools.hpp"
+#include "thread.hpp"
 
 using namespace std;
 
@@ -291,9 +292,13 @@ void wsplit(const ustring& s,vector<ustring>& list,const uchar_t *delim) {
 }
 */
 
+// shards spill their runs side by side
+static Mutex s_temp_filename_mutex;
+
 string next_temp_filename(const char* prefix) {
     char name[100];
     static unsigned s_count;
+    ScopedLock lock(s_temp_filename_mutex);
     ++s_count;
 #if defined(WIN32)
     sprintf(name,"%s.%d.tmp",prefix,s_count);
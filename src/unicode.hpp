@@ -125,6 +125,10 @@ namespace std{
         : public __char_traits_base<uchar_t, uint_t>
         {};
     template<>
+    class char_traits<unsigned char>
+        : public __char_traits_base<unsigned char, unsigned>
+        {};
+    template<>
     class char_traits<unsigned>
         : public __char_traits_base<unsigned, unsigned>
         {};
@@ -33,8 +33,14 @@
 
 #include <cassert>
 
+#include <cstring>
+#include <algorithm>
 #include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <boost/shared_array.hpp>
 #include "vocab.hpp"
+#include "thread.hpp"
 
 using namespace std;
 
@@ -49,29 +55,74 @@ word_id g_id_bos;
 word_id g_id_eos;
 word_id g_id_special_last;
 
+// special words, in the order init_special_id() gives them ids
+static const char* s_special_words[] = {
+    "__NULL_ID__", " ", "\t", "\v", ".", "?", ";", "!", "BOS", "EOS"
+};
+static word_id* s_special_ids[] = {
+    0, &g_id_space, &g_id_tab, &g_id_vt, &g_id_peroid, &g_id_question,
+    &g_id_separator, &g_id_intr, &g_id_bos, &g_id_eos
+};
+static const size_t s_special_count =
+    sizeof(s_special_words) / sizeof(s_special_words[0]);
+
 //add space chars and punct symbol to wordmap
 void init_special_id(Vocab& v) {
     assert(v.size() == 0);
-    v.add("__NULL_ID__");
-    g_id_space     = v.add(" ");
-    g_id_tab       = v.add("\t");
-    g_id_vt        = v.add("\v");
-    g_id_peroid    = v.add(".");
-    g_id_question  = v.add("?");
-    g_id_separator = v.add(";");
-    g_id_intr      = v.add("!");
-    g_id_bos       = v.add("BOS");
-    g_id_eos       = v.add("EOS");
+    for (size_t i = 0; i < s_special_count; ++i) {
+        word_id id = v.add(s_special_words[i]);
+        if (s_special_ids[i])
+            *s_special_ids[i] = id;
+    }
     g_id_special_last = g_id_eos;
 }
 
-// load a vocab saved as plain text file
+// index of a special word, s_special_count for other words
+static size_t special_rank(const char* s, size_t len) {
+    for (size_t i = 0; i < s_special_count; ++i) {
+        if (strlen(s_special_words[i]) == len &&
+                memcmp(s_special_words[i], s, len) == 0)
+            return i;
+    }
+    return s_special_count;
+}
+
+int compare_words(const char* a, size_t alen, const char* b, size_t blen) {
+    size_t ra = special_rank(a, alen);
+    size_t rb = special_rank(b, blen);
+    if (ra != rb)
+        return ra < rb ? -1 : 1;
+    if (ra != s_special_count)
+        return 0;
+
+    int rc = memcmp(a, b, min(alen, blen));
+    if (rc != 0)
+        return rc;
+    return alen == blen ? 0 : (alen < blen ? -1 : 1);
+}
+
+// load a vocab saved as plain text file or by save_vocab()
 void load_vocab(const string& file, Vocab& v) {
+    assert (v.size() == 0);
+    if (Vocab::is_binary_file(file)) {
+        v.load(file);
+
+        // binary vocabs keep the special words at their usual ids
+        for (size_t i = 0; i < s_special_count; ++i) {
+            if (i >= v.size() || strcmp(v[i], s_special_words[i]) != 0)
+                throw runtime_error("vocab file lacks special words");
+            if (s_special_ids[i])
+                *s_special_ids[i] = i;
+        }
+        g_id_special_last = g_id_eos;
+        cerr << v.size() << " words mapped" << endl;
+        return;
+    }
+
     ifstream f(file.c_str());
     if (!f) 
         throw runtime_error("Fail to open vocab file to read");
 
-    assert (v.size() == 0);
     init_special_id(v);
 
     string s;
@@ -83,9 +134,16 @@ void load_vocab(const string& file, Vocab& v) {
     cerr << v.size() << " words loaded" << endl;
 }
 
+// save vocab in binary form, which load_vocab() maps without parsing
+void save_vocab(const string& file, const Vocab& vocab) {
+    cerr << "Writing vocab to: " << file << endl;
+    assert(vocab.size() >= g_id_special_last + 1);
+    vocab.save(file);
+}
+
 // save vocab to a plain text file, one word per line.
 // the words should not contains line separators like \r \n
-void save_vocab(const string& file, const Vocab& vocab) {
+void save_vocab_text(const string& file, const Vocab& vocab) {
     ofstream o(file.c_str());
     if (!o)
         throw runtime_error("Unable to open vocab file to write");
@@ -95,7 +153,93 @@ void save_vocab(const string& file, const Vocab& vocab) {
 
     for (size_t i = g_id_special_last + 1; i < vocab.size(); ++i) {
         o << vocab[i] << endl;
-        assert (vocab[i].find('\n') == string::npos);
-        assert (vocab[i].find('\r') == string::npos);
+        assert (strchr(vocab[i], '\n') == 0);
+        assert (strchr(vocab[i], '\r') == 0);
+    }
+}
+
+// renumber the words after the special ones in string order, so that
+// word ngrams sort by their ids the way they sort as strings
+void sort_vocab(Vocab& v) {
+    vector<word_id> remap;
+    sort_vocab(v, remap);
+}
+
+// as above, remap receives the new id of every old id
+void sort_vocab(Vocab& v, vector<word_id>& remap) {
+    assert(v.size() >= g_id_special_last + 1);
+    v.renumber(g_id_special_last + 1, remap);
+}
+
+// tokenize lines[m_begin, m_end) into a private vocab
+struct LocalTokenizer {
+    void operator()() {
+        m_ids.clear();
+        m_line_ends.clear();
+        for (size_t i = m_begin; i < m_end; ++i) {
+            add_words((*m_lines)[i], m_vocab, m_ids);
+            m_line_ends.push_back(m_ids.size());
+        }
+    }
+
+    const vector<string>* m_lines;
+    size_t                m_begin;
+    size_t                m_end;
+    FlatVocab             m_vocab;
+    vector<word_id>       m_ids;
+    vector<size_t>        m_line_ends;
+};
+
+// boost::function copies its target, so hand threads a pointer
+struct RunLocalTokenizer {
+    RunLocalTokenizer(LocalTokenizer* t):m_t(t) {}
+    void operator()() { (*m_t)(); }
+    LocalTokenizer* m_t;
+};
+
+void add_words_parallel(const vector<string>& lines, Vocab& v,
+        vector<word_id>& ids, vector<size_t>& line_ends, unsigned threads) {
+    ids.clear();
+    line_ends.clear();
+
+    // not worth starting threads for a handful of lines
+    if (threads > lines.size() / 64)
+        threads = lines.size() / 64;
+    if (threads <= 1) {
+        for (size_t i = 0; i < lines.size(); ++i) {
+            add_words(lines[i], v, ids);
+            line_ends.push_back(ids.size());
+        }
+        return;
+    }
+
+    boost::shared_array<LocalTokenizer> parts(new LocalTokenizer[threads]);
+    {
+        boost::shared_array<Thread> workers(new Thread[threads]);
+        size_t step = (lines.size() + threads - 1) / threads;
+        for (unsigned t = 0; t < threads; ++t) {
+            parts[t].m_lines = &lines;
+            parts[t].m_begin = min(lines.size(), t * step);
+            parts[t].m_end   = min(lines.size(), (t + 1) * step);
+            workers[t].start(RunLocalTokenizer(&parts[t]));
+        }
+        for (unsigned t = 0; t < threads; ++t)
+            workers[t].join();
+    }
+
+    // merge in line order: local ids are in first occurrence order, so
+    // adding them one by one reproduces the single threaded id assignment
+    vector<word_id> remap;
+    for (unsigned t = 0; t < threads; ++t) {
+        LocalTokenizer& part = parts[t];
+        remap.resize(part.m_vocab.size());
+        for (size_t i = 0; i < remap.size(); ++i)
+            remap[i] = v.add(part.m_vocab[i], part.m_vocab.length(i));
+
+        size_t base = ids.size();
+        for (size_t i = 0; i < part.m_ids.size(); ++i)
+            ids.push_back(remap[part.m_ids[i]]);
+        for (size_t i = 0; i < part.m_line_ends.size(); ++i)
+            line_ends.push_back(base + part.m_line_ends[i]);
     }
 }
@@ -35,9 +35,10 @@
 #endif
 
 #include <string>
-#include "itemmap.hpp"
+#include <vector>
+#include "flatvocab.hpp"
 
-typedef ItemMap<std::string> Vocab;
+typedef FlatVocab Vocab;
 typedef Vocab::id_type word_id;
 
 // pre-defined word ids, they are gloabl vars!
@@ -55,5 +56,52 @@ extern word_id g_id_special_last;
 void init_special_id(Vocab& v); 
 void load_vocab(const std::string& file, Vocab& v);
 void save_vocab(const std::string& file, const Vocab& v);
-#endif /* ifndef VOCAB_H */
+void save_vocab_text(const std::string& file, const Vocab& v);
+void sort_vocab(Vocab& v);
+void sort_vocab(Vocab& v, std::vector<word_id>& remap);
+
+/**
+ * compare two words in the order sort_vocab() gives them ids: the special
+ * words first, then strcmp() order
+ */
+int compare_words(const char* a, size_t alen, const char* b, size_t blen);
+
+inline bool is_word_separator(char c) {
+    return c == ' ' || c == '\t' || c == '\f' || c == '\v' || c == '\r' ||
+        c == '\n';
+}
+
+/**
+ * split line into blank separated words and append their ids to ids.
+ * words are looked up in place without building temporary std::strings.
+ */
+template <typename StringT>
+void add_words(const std::string& line, Vocab& v, StringT& ids) {
+    const char* p   = line.data();
+    const char* end = p + line.size();
+    while (p != end) {
+        while (p != end && is_word_separator(*p))
+            ++p;
+        const char* start = p;
+        while (p != end && !is_word_separator(*p))
+            ++p;
+        if (p != start)
+            ids.push_back(typename StringT::value_type(v.add(start, p - start)));
+    }
+}
+/**
+ * tokenize a batch of lines on up to `threads' threads.
+ *
+ * Each thread splits its share of the lines into a private vocab, then the
+ * private vocabs are merged into v in line order and their ids remapped. So
+ * every word gets exactly the id that calling add_words() on the lines one
+ * by one would give it, whatever the number of threads.
+ *
+ * ids receives the word ids of all lines back to back, line_ends[i] is the
+ * end of line i in ids.
+ */
+void add_words_parallel(const std::vector<std::string>& lines, Vocab& v,
+        std::vector<word_id>& ids, std::vector<size_t>& line_ends,
+        unsigned threads);
 
+#endif /* ifndef VOCAB_H */